@@ -11,7 +11,6 @@
 #include <stdlib.h>
 #include <array>
 #include <vector>
-#include <algorithm> // for std::sort
 
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -20,6 +19,7 @@
 #include <glm/ext/matrix_clip_space.hpp> // glm::perspective
 #include <glm/ext/scalar_constants.hpp>  // glm::pi
 
+#include "DepthSort.h"
 #include "MinimalSDLApp.h"
 
 using V3F = glm::vec3;
@@ -108,6 +108,8 @@ class AtomObj
     std::vector<V3F>    mPoses;
     std::vector<V3I>    mCols;
 
+    DepthSort           mDepthSort { true }; // points don't change order much
+
 public:
     AtomObj( float density ) : mDensity(density)
     {
@@ -211,14 +213,13 @@ public:
         }
 
         // sort with bigger Z first
-        std::sort( outVerts.begin(), outVerts.end(), []( const auto &l, const auto &r )
-        {
-            return l.pos.z > r.pos.z;
-        });
+        const auto &order = mDepthSort.SortBackToFront(
+                                outVerts.size(),
+                                [&]( size_t i ){ return outVerts[i].pos.z; } );
 
         // finally render the verts
-        for (const auto &v : outVerts)
-            DrawAtom( pRend, v.pos.x, v.pos.y, v.col );
+        for (const auto i : order)
+            DrawAtom( pRend, outVerts[i].pos.x, outVerts[i].pos.y, outVerts[i].col );
     }
 };
 
@@ -11,7 +11,6 @@
 #include <stdlib.h>
 #include <array>
 #include <vector>
-#include <algorithm> // for std::sort
 
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
@@ -20,6 +19,7 @@
 #include <glm/ext/matrix_clip_space.hpp> // glm::perspective
 #include <glm/ext/scalar_constants.hpp>  // glm::pi
 
+#include "DepthSort.h"
 #include "MinimalSDLApp.h"
 
 using V3F = glm::vec3;
@@ -76,6 +76,8 @@ class AtomObj
 {
     std::vector<V3F>    mVerts;
 
+    DepthSort           mDepthSort { true }; // points don't change order much
+
 public:
     void AddVertex( const V3F &vert )
     {
@@ -115,14 +117,13 @@ public:
         }
 
         // sort with bigger Z first
-        std::sort( xformedVerts.begin(), xformedVerts.end(), []( const auto &l, const auto &r )
-        {
-            return l.z > r.z;
-        });
+        const auto &order = mDepthSort.SortBackToFront(
+                                xformedVerts.size(),
+                                [&]( size_t i ){ return xformedVerts[i].z; } );
 
         // finally render the verts
-        for (const auto &v : xformedVerts)
-            DrawAtom( pRend, v.x, v.y, V3I(0,255,0) );
+        for (const auto i : order)
+            DrawAtom( pRend, xformedVerts[i].x, xformedVerts[i].y, V3I(0,255,0) );
     }
 };
 
@@ -7,6 +7,7 @@
 //==================================================================
 
 #include <float.h>
+#include <algorithm>
 #include "DBase.h"
 #include "Voxels.h"
 
@@ -24,29 +25,54 @@ inline VLenT log2ceil( VLenT val )
 }
 
 //==================================================================
-void Voxels::SetBBoxAndUnit( const BBoxT &bbox, float baseUnit, VLenT maxDimL2 )
+template <typename _T>
+void Voxels<_T>::SetBBoxAndUnit( const BBoxT &bbox, float baseUnit, VLenT maxDimL2 )
 {
-    mBBox = bbox;
-
-    c_auto bboxSiz = mBBox[1] - mBBox[0];
+    c_auto bboxSiz = bbox[1] - bbox[0];
 
-    mN0 = log2ceil( (VLenT)ceilf(bboxSiz[0] / baseUnit) );
-    mN1 = log2ceil( (VLenT)ceilf(bboxSiz[1] / baseUnit) );
-    mN2 = log2ceil( (VLenT)ceilf(bboxSiz[2] / baseUnit) );
+    auto n0 = log2ceil( (VLenT)ceilf(bboxSiz[0] / baseUnit) );
+    auto n1 = log2ceil( (VLenT)ceilf(bboxSiz[1] / baseUnit) );
+    auto n2 = log2ceil( (VLenT)ceilf(bboxSiz[2] / baseUnit) );
 
     if ( maxDimL2 != 0 )
     {
-        mN0 = std::min( mN0, maxDimL2 );
-        mN1 = std::min( mN1, maxDimL2 );
-        mN2 = std::min( mN2, maxDimL2 );
+        n0 = std::min( n0, maxDimL2 );
+        n1 = std::min( n1, maxDimL2 );
+        n2 = std::min( n2, maxDimL2 );
     }
 
+    SetBBoxAndDims( bbox, n0, n1, n2 );
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::SetBBoxAndDims( const BBoxT &bbox, VLenT n0, VLenT n1, VLenT n2, bool clearCells )
+{
+    // mips are rebuilt for the new grid, if they were in use
+    c_auto hadMips = HasMips();
+    mMips.clear();
+
+    mBBox = bbox;
+    mN0 = n0;
+    mN1 = n1;
+    mN2 = n2;
+
+    mChunkL2 = { std::min( mN0, CHUNK_L2 ),
+                 std::min( mN1, CHUNK_L2 ),
+                 std::min( mN2, CHUNK_L2 ) };
+
+    ClearChunkLoader();
+
+    c_auto bboxSiz = mBBox[1] - mBBox[0];
+
     c_auto nn0 = (float)(1 << mN0);
     c_auto nn1 = (float)(1 << mN1);
     c_auto nn2 = (float)(1 << mN2);
 
     mCells.clear();
     mCells.resize( (size_t)1 << (mN0 + mN1 + mN2) );
+    if ( clearCells )
+        std::fill( mCells.begin(), mCells.end(), CellType{} );
 
     mUnit[0] = nn0 > 1 ? (bboxSiz[0] / (nn0-1)) : 0.f;
     mUnit[1] = nn1 > 1 ? (bboxSiz[1] / (nn1-1)) : 0.f;
@@ -66,23 +92,270 @@ void Voxels::SetBBoxAndUnit( const BBoxT &bbox, float baseUnit, VLenT maxDimL2 )
     VOXASSERT( minUnit > EPS && minUnit != FLT_MAX );
 
     mOOUnitForTess = minUnit ? (1.f / minUnit * 1.00f) : 1.f;
+
+    // nothing to build from uninitialized cells
+    if ( hadMips && clearCells )
+        SetMipsEnabled( true );
 }
 
 //==================================================================
-void Voxels::ClearVox( const CellType &val )
+template <typename _T>
+void Voxels<_T>::ClearVox( const CellType &val )
 {
+    // everything gets overwritten, nothing left to stream
+    ClearChunkLoader();
+
     std::fill( mCells.begin(), mCells.end(), val );
+
+    for (auto &mip : mMips)
+        std::fill( mip.begin(), mip.end(), val );
 }
 
 //==================================================================
-bool Voxels::FindClosestNonEmptyCellCtr(
+template <typename _T>
+void Voxels<_T>::SetChunkLoader( ChunkLoadFnT fn )
+{
+    mMips.clear();
+
+    mChunkLoadFn = std::move( fn );
+    mChunkResident.assign( GetChunksN(), 0 );
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::ClearChunkLoader()
+{
+    mChunkLoadFn = {};
+    mChunkResident.clear();
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::TouchAllChunks() const
+{
+    if NOT( mChunkLoadFn )
+        return;
+
+    for (size_t i=0; i < mChunkResident.size(); ++i)
+        TouchChunk( i );
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::loadChunk( size_t chunkIdx ) const
+{
+    // set as resident first, so that the loader can touch cells freely
+    mChunkResident[ chunkIdx ] = 1;
+
+    // the content is logically already there, we just bring it in
+    mChunkLoadFn( const_cast<Voxels &>( *this ), chunkIdx );
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::SetMipsEnabled( bool onOff )
+{
+    mMips.clear();
+
+    if NOT( onOff )
+        return;
+
+    // mips need all the cells, so streaming is done with
+    TouchAllChunks();
+    ClearChunkLoader();
+
+    c_auto levsN = (size_t)std::max( mN0, std::max( mN1, mN2 ) );
+
+    mMips.resize( levsN );
+    for (size_t lev=1; lev <= levsN; ++lev)
+    {
+        c_auto n = GetMipN( lev );
+        mMips[lev-1].resize( (size_t)1 << (n[0] + n[1] + n[2]) );
+    }
+
+    // build everything, bottom-up
+    updateMipsBox( {0, 0, 0}, {1u << mN0, 1u << mN1, 1u << mN2} );
+}
+
+//==================================================================
+template <typename _T>
+typename Voxels<_T>::CellType Voxels<_T>::calcMipCell(
+                                size_t lev, VLenT p0, VLenT p1, VLenT p2 ) const
+{
+    c_auto cn = GetMipN( lev-1 );
+    c_auto *pSrc = GetMipCells( lev-1 );
+
+    // number of children on each axis, 1 if the axis is already collapsed
+    c_auto m0 = cn[0] ? 2u : 1u;
+    c_auto m1 = cn[1] ? 2u : 1u;
+    c_auto m2 = cn[2] ? 2u : 1u;
+
+    CellType vals[8];
+    int      cnts[8];
+    size_t   valsN = 0;
+
+    for (VLenT j2=0; j2 < m2; ++j2)
+    for (VLenT j1=0; j1 < m1; ++j1)
+    for (VLenT j0=0; j0 < m0; ++j0)
+    {
+        c_auto c0 = (size_t)(p0 * m0 + j0);
+        c_auto c1 = (size_t)(p1 * m1 + j1);
+        c_auto c2 = (size_t)(p2 * m2 + j2);
+
+        c_auto &val = pSrc[ (c2 << (cn[1] + cn[0])) + (c1 << cn[0]) + c0 ];
+        if NOT( val )
+            continue;
+
+        size_t i = 0;
+        for (; i < valsN; ++i)
+            if ( vals[i] == val )
+                break;
+
+        if ( i == valsN )
+        {
+            vals[valsN] = val;
+            cnts[valsN++] = 0;
+        }
+        ++cnts[i];
+    }
+
+    // most common non-empty value, the first one found wins the ties
+    size_t bestI = 0;
+    for (size_t i=1; i < valsN; ++i)
+        if ( cnts[i] > cnts[bestI] )
+            bestI = i;
+
+    return valsN ? vals[bestI] : CellType{};
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::updateMipsBox( std::array<VLenT,3> bmin, std::array<VLenT,3> bmax )
+{
+    for (size_t lev=1; lev <= mMips.size(); ++lev)
+    {
+        // parent cells of the box (max is exclusive)
+        for (size_t a=0; a < 3; ++a)
+        {
+            bmin[a] >>= 1;
+            bmax[a] = ((bmax[a] - 1) >> 1) + 1;
+        }
+
+        c_auto n = GetMipN( lev );
+        auto &mip = mMips[lev-1];
+
+        bool changed = false;
+        for (VLenT p2=bmin[2]; p2 < bmax[2]; ++p2)
+        for (VLenT p1=bmin[1]; p1 < bmax[1]; ++p1)
+        for (VLenT p0=bmin[0]; p0 < bmax[0]; ++p0)
+        {
+            c_auto newVal = calcMipCell( lev, p0, p1, p2 );
+
+            auto &val = mip[ ((size_t)p2 << (n[1] + n[0])) + ((size_t)p1 << n[0]) + p0 ];
+            if ( val != newVal )
+            {
+                val = newVal;
+                changed = true;
+            }
+        }
+
+        // upper levels can't change either
+        if NOT( changed )
+            break;
+    }
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::findClosestInMip(
+                size_t lev,
+                VLenT p0, VLenT p1, VLenT p2,
+                const Float3 &posVS,
+                float &io_closestSqr,
+                Float3 &io_closestCtrVS ) const
+{
+    c_auto n = GetMipN( lev );
+
+    if NOT( GetMipCells( lev )[ ((size_t)p2 << (n[1] + n[0])) + ((size_t)p1 << n[0]) + p0 ] )
+        return;
+
+    // range of the cell centers at level 0, covered by this cell
+    c_auto siz = Float3( (float)(1 << std::min( (VLenT)lev, mN0 )),
+                         (float)(1 << std::min( (VLenT)lev, mN1 )),
+                         (float)(1 << std::min( (VLenT)lev, mN2 )) );
+    c_auto ctrMin = Float3( (float)p0, (float)p1, (float)p2 ) * siz + 0.5f;
+    c_auto ctrMax = ctrMin + siz - 1.f;
+
+    if ( lev == 0 )
+    {
+        if ( c_auto distSqr = lengthSqr( ctrMin - posVS ); distSqr < io_closestSqr )
+        {
+            io_closestSqr = distSqr;
+            io_closestCtrVS = ctrMin;
+        }
+        return;
+    }
+
+    // nothing in here can be closer than what's been found
+    if ( lengthSqr( glm::clamp( posVS, ctrMin, ctrMax ) - posVS ) >= io_closestSqr )
+        return;
+
+    c_auto cn = GetMipN( lev-1 );
+    c_auto m0 = cn[0] ? 2u : 1u;
+    c_auto m1 = cn[1] ? 2u : 1u;
+    c_auto m2 = cn[2] ? 2u : 1u;
+
+    // visit the child on the side of the position first, to prune more
+    c_auto half = (ctrMin + ctrMax) * 0.5f;
+    c_auto s0 = (m0 > 1 && posVS[0] >= half[0]) ? 1u : 0u;
+    c_auto s1 = (m1 > 1 && posVS[1] >= half[1]) ? 1u : 0u;
+    c_auto s2 = (m2 > 1 && posVS[2] >= half[2]) ? 1u : 0u;
+
+    for (VLenT j2=0; j2 < m2; ++j2)
+    for (VLenT j1=0; j1 < m1; ++j1)
+    for (VLenT j0=0; j0 < m0; ++j0)
+    {
+        findClosestInMip(
+                lev-1,
+                p0 * m0 + (j0 ^ s0),
+                p1 * m1 + (j1 ^ s1),
+                p2 * m2 + (j2 ^ s2),
+                posVS,
+                io_closestSqr,
+                io_closestCtrVS );
+    }
+}
+
+//==================================================================
+template <typename _T>
+bool Voxels<_T>::FindClosestNonEmptyCellCtr(
                         const Float3 &posLS,
                         Float3 &out_foundCellCenterLS ) const
 {
+    if ( HasMips() )
+    {
+        c_auto posVS = mVS_LS * (posLS - mBBox[0]);
+
+        auto  closestSqr   = FLT_MAX;
+        auto  closestCtrVS = Float3( 0, 0, 0 );
+
+        // descend from the 1x1x1 top level
+        findClosestInMip( mMips.size(), 0, 0, 0, posVS, closestSqr, closestCtrVS );
+
+        if ( closestSqr == FLT_MAX )
+            return false;
+
+        out_foundCellCenterLS = closestCtrVS * mUnit + mBBox[0];
+        return true;
+    }
+
     c_auto nn0 = 1 << mN0;
     c_auto nn1 = 1 << mN1;
     c_auto nn2 = 1 << mN2;
 
+    // full scan, everything needs to be there
+    TouchAllChunks();
+
     // position to check in Voxels Space
     auto posVS = mVS_LS * (posLS - mBBox[0]);
 
@@ -129,7 +402,102 @@ bool Voxels::FindClosestNonEmptyCellCtr(
 }
 
 //==================================================================
-void Voxels::CheckLine(
+template <typename _T>
+bool Voxels<_T>::FindFirstNonEmptyCell(
+                        const Float3 &lineSta,
+                        const Float3 &lineEnd,
+                        Float3 &out_foundCellCenterLS ) const
+{
+    // voxel-space line, cells span from i to i+1
+    c_auto staVS = (lineSta - mBBox[0]) * mVS_LS;
+    c_auto dirVS = (lineEnd - mBBox[0]) * mVS_LS - staVS;
+
+    c_auto nn = Float3( (float)(1 << mN0), (float)(1 << mN1), (float)(1 << mN2) );
+
+    // clip to the grid
+    float t0 = 0.f;
+    float t1 = 1.f;
+    for (glm::length_t a=0; a < 3; ++a)
+    {
+        if ( dirVS[a] == 0 )
+        {
+            if ( staVS[a] < 0 || staVS[a] >= nn[a] )
+                return false;
+            continue;
+        }
+        c_auto oo = 1.f / dirVS[a];
+        auto ta = (0.f   - staVS[a]) * oo;
+        auto tb = (nn[a] - staVS[a]) * oo;
+        if ( ta > tb )
+            std::swap( ta, tb );
+        t0 = std::max( t0, ta );
+        t1 = std::min( t1, tb );
+    }
+    if ( t0 > t1 )
+        return false;
+
+    // small step past the boundaries, to get into the next cell
+    c_auto maxDir = std::max( fabs(dirVS[0]), std::max( fabs(dirVS[1]), fabs(dirVS[2]) ) );
+    c_auto tEps = maxDir ? 1e-4f / maxDir : 1.f;
+
+    c_auto topLev = mMips.size();
+
+    for (auto t=t0; t <= t1; )
+    {
+        c_auto pos = staVS + dirVS * t;
+
+        c_auto i0 = (VLenT)std::clamp( (int)pos[0], 0, (1 << mN0) - 1 );
+        c_auto i1 = (VLenT)std::clamp( (int)pos[1], 0, (1 << mN1) - 1 );
+        c_auto i2 = (VLenT)std::clamp( (int)pos[2], 0, (1 << mN2) - 1 );
+
+        // coarsest empty level containing the position, if any
+        size_t lev = topLev;
+        for (; ; --lev)
+        {
+            c_auto n = GetMipN( lev );
+            c_auto l = (VLenT)lev;
+            c_auto idx = ((size_t)(i2 >> l) << (n[1] + n[0])) +
+                         ((size_t)(i1 >> l) <<  n[0]) +
+                          (size_t)(i0 >> l);
+
+            if ( lev == 0 )
+                TouchCell( i0, i1, i2 );
+
+            if NOT( GetMipCells( lev )[ idx ] )
+                break;
+
+            if ( lev == 0 )
+            {
+                c_auto ctrVS = Float3( (float)i0, (float)i1, (float)i2 ) + 0.5f;
+                out_foundCellCenterLS = ctrVS * mUnit + mBBox[0];
+                return true;
+            }
+        }
+
+        // skip the empty box, up to where the line exits it
+        c_auto l = (VLenT)lev;
+        c_auto boxMin = Float3( (float)((i0 >> l) << l),
+                                (float)((i1 >> l) << l),
+                                (float)((i2 >> l) << l) );
+        c_auto boxMax = glm::min( boxMin + (float)(1 << l), nn );
+
+        auto tExit = FLT_MAX;
+        for (glm::length_t a=0; a < 3; ++a)
+        {
+            if ( dirVS[a] > 0 ) tExit = std::min( tExit, (boxMax[a] - staVS[a]) / dirVS[a] );
+            else
+            if ( dirVS[a] < 0 ) tExit = std::min( tExit, (boxMin[a] - staVS[a]) / dirVS[a] );
+        }
+
+        t = std::max( tExit, t ) + tEps;
+    }
+
+    return false;
+}
+
+//==================================================================
+template <typename _T>
+void Voxels<_T>::CheckLine(
                     const Float3 &lineSta,
                     const Float3 &lineEnd,
                     VVec<const CellType*> &out_checkRes ) const
@@ -144,3 +512,7 @@ void Voxels::CheckLine(
         [&]( c_auto idx, c_auto &desVal ){ out_checkRes[ idx ] = &desVal; } );
 }
 
+//==================================================================
+template class Voxels<uint8_t>;
+template class Voxels<uint16_t>;
+template class Voxels<uint32_t>;
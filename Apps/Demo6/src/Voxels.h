@@ -13,6 +13,8 @@
 #include <array>
 #include <vector>
 #include <functional>
+#include <memory>
+#include "DBase.h"
 #include "MathBase.h"
 
 //#define VOX_TEST_WORK
@@ -25,16 +27,108 @@
 
 template <typename T> using VVec = std::vector<T>;
 
+//==================================================================
+// allocator that leaves new elements uninitialized, so that a large
+// grid can be allocated without touching all of its memory upfront
+template <typename T>
+class VoxDefInitAlloc : public std::allocator<T>
+{
+public:
+    template <typename U> struct rebind { using other = VoxDefInitAlloc<U>; };
+
+    using std::allocator<T>::allocator;
+
+    template <typename U>
+    void construct( U *p ) { ::new ((void *)p) U; }
+
+    template <typename U, typename ...ARGS>
+    void construct( U *p, ARGS &&...args ) { ::new ((void *)p) U( std::forward<ARGS>(args)... ); }
+};
+
 using VLenT = unsigned int;
 using BBoxT = std::array<Float3,2>;
 
 //==================================================================
+/// Table of RGB colors, indexed by cells that are smaller than 32 bits.
+/// Index 0 is always the empty cell. A palette can be shared by
+/// several Voxels.
+class VoxPalette
+{
+    std::vector<uint32_t>   mCols { 0 };
+
+public:
+    VoxPalette() = default;
+    VoxPalette( std::vector<uint32_t> cols ) : mCols(std::move(cols))
+    {
+        if ( mCols.empty() )
+            mCols.push_back( 0 );
+    }
+
+    // index of the color, which is added if new and if there's room
+    // for it, otherwise the closest available color is picked
+    size_t FindOrAdd( uint32_t rgb, size_t maxN );
+
+    uint32_t GetCol( size_t idx ) const { return mCols[ idx ]; }
+    const auto &GetCols() const { return mCols; }
+};
+
+//==================================================================
+inline size_t VoxPalette::FindOrAdd( uint32_t rgb, size_t maxN )
+{
+    if NOT( rgb )
+        return 0;
+
+    for (size_t i=1; i < mCols.size(); ++i)
+        if ( mCols[i] == rgb )
+            return i;
+
+    if ( mCols.size() < maxN )
+    {
+        mCols.push_back( rgb );
+        return mCols.size() - 1;
+    }
+
+    // full, find the closest
+    auto dist = []( uint32_t a, uint32_t b )
+    {
+        int d = 0;
+        for (int s=0; s < 24; s += 8)
+            d += std::abs( (int)((a >> s) & 0xff) - (int)((b >> s) & 0xff) );
+        return d;
+    };
+
+    size_t bestIdx = 0;
+    int    bestDist = INT32_MAX;
+    for (size_t i=1; i < mCols.size(); ++i)
+    {
+        if ( c_auto d = dist( mCols[i], rgb ); d < bestDist )
+        {
+            bestDist = d;
+            bestIdx = i;
+        }
+    }
+    return bestIdx;
+}
+
+//==================================================================
+/// Grid of cells of type _T, which is either a 32 bit RGB color, or
+/// an index (8 or 16 bits) into a VoxPalette. 0 is the empty cell.
+template <typename _T>
 class Voxels
 {
 public:
-    using CellType = uint32_t;
+    using CellType = _T;
+
+    // cell holds the RGB color directly, no palette needed
+    static constexpr bool IS_RGB_CELL = sizeof(CellType) >= 4;
+
+    // log2 of the max chunk size on each axis (i.e. 16x16x16 cells)
+    static constexpr VLenT CHUNK_L2 = 4;
+
+    using ChunkLoadFnT = std::function<void (Voxels &, size_t chunkIdx)>;
 private:
-    std::vector<CellType>  mCells;
+    std::vector<CellType,VoxDefInitAlloc<CellType>>  mCells;
+    std::shared_ptr<VoxPalette> mpPalette = std::make_shared<VoxPalette>();
     BBoxT       mBBox  {};
     Float3      mUnit  {0,0,0};
     Float3      mVS_LS {0,0,0}; // Voxels Space from Local Space (scale only)
@@ -43,11 +137,111 @@ private:
     VLenT       mN1 = 0;
     VLenT       mN2 = 0;
 
+    // chunk size on each axis (log2)
+    std::array<VLenT,3> mChunkL2 {};
+
+    // streaming of chunks, loaded on first touch
+    ChunkLoadFnT                    mChunkLoadFn;
+    mutable std::vector<uint8_t>    mChunkResident;
+
+    // optional mip chain, levels 1..N (level 0 is mCells)
+    std::vector<std::vector<CellType>>  mMips;
+
 public:
     void SetBBoxAndUnit( const BBoxT &bbox, float baseUnit, VLenT maxDimL2 );
+    // like SetBBoxAndUnit(), but with explicit dimensions. Cells are left
+    // uninitialized if clearCells is false
+    void SetBBoxAndDims( const BBoxT &bbox, VLenT n0, VLenT n1, VLenT n2, bool clearCells=true );
 
     void ClearVox( const CellType &val );
 
+    void SetPalette( std::shared_ptr<VoxPalette> pPal ) { mpPalette = std::move( pPal ); }
+    const auto &GetPalette() const { return mpPalette; }
+
+    // make a cell value for the given RGB color
+    CellType MakeCell( uint32_t rgb )
+    {
+        if constexpr ( IS_RGB_CELL )
+            return (CellType)rgb;
+        else
+            return (CellType)mpPalette->FindOrAdd( rgb, (size_t)1 << (sizeof(CellType) * 8) );
+    }
+    // get the RGB color of a cell value
+    uint32_t GetCellRGB( const CellType &val ) const
+    {
+        if constexpr ( IS_RGB_CELL )
+            return (uint32_t)val;
+        else
+            return mpPalette->GetCol( val );
+    }
+
+    // mip levels are 2x2x2 reductions of the level below, down to 1x1x1.
+    // A mip cell is empty only if all its children are, otherwise it has
+    // the most common non-empty child value. Enabling the mips needs the
+    // whole grid, so it brings in any chunks that are still streaming
+    void SetMipsEnabled( bool onOff );
+    bool HasMips() const { return !mMips.empty(); }
+    // number of levels, including level 0
+    size_t GetMipLevelsN() const { return mMips.size() + 1; }
+    // log2 of the size on each axis, at the given level
+    std::array<VLenT,3> GetMipN( size_t lev ) const
+    {
+        c_auto l = (VLenT)lev;
+        return { mN0 > l ? mN0 - l : 0, mN1 > l ? mN1 - l : 0, mN2 > l ? mN2 - l : 0 };
+    }
+    const CellType *GetMipCells( size_t lev ) const
+    {
+        return lev ? mMips[lev-1].data() : mCells.data();
+    }
+    // to be called after writing cells directly (not via SetCell)
+    void NotifyCellChanged( size_t cellIdx )
+    {
+        if ( HasMips() )
+        {
+            c_auto i0 = (VLenT)(cellIdx & (((size_t)1 << mN0) - 1));
+            c_auto i1 = (VLenT)((cellIdx >> mN0) & (((size_t)1 << mN1) - 1));
+            c_auto i2 = (VLenT)(cellIdx >> (mN0 + mN1));
+            updateMipsBox( {i0, i1, i2}, {i0+1, i1+1, i2+1} );
+        }
+    }
+
+    // chunks are set as not resident and loaded with fn on first touch.
+    // Mips are disabled, since the content is not known yet
+    void SetChunkLoader( ChunkLoadFnT fn );
+    void ClearChunkLoader();
+    bool HasChunkLoader() const { return !!mChunkLoadFn; }
+
+    void TouchChunk( size_t chunkIdx ) const
+    {
+        if ( mChunkLoadFn && !mChunkResident[ chunkIdx ] )
+            loadChunk( chunkIdx );
+    }
+    void TouchCell( VLenT i0, VLenT i1, VLenT i2 ) const
+    {
+        if ( mChunkLoadFn )
+            TouchChunk( MakeChunkIdx( i0 >> mChunkL2[0], i1 >> mChunkL2[1], i2 >> mChunkL2[2] ) );
+    }
+    void TouchAllChunks() const;
+
+    const auto &GetChunkL2() const { return mChunkL2; }
+    // number of chunks on each axis
+    std::array<size_t,3> GetChunksSize() const
+    {
+        return { (size_t)1 << (mN0 - mChunkL2[0]),
+                 (size_t)1 << (mN1 - mChunkL2[1]),
+                 (size_t)1 << (mN2 - mChunkL2[2]) };
+    }
+    size_t GetChunksN() const
+    {
+        return (size_t)1 << (mN0 + mN1 + mN2 - mChunkL2[0] - mChunkL2[1] - mChunkL2[2]);
+    }
+    size_t MakeChunkIdx( size_t c0, size_t c1, size_t c2 ) const
+    {
+        c_auto cn0 = mN0 - mChunkL2[0];
+        c_auto cn1 = mN1 - mChunkL2[1];
+        return (c2 << (cn1 + cn0)) + (c1 << cn0) + c0;
+    }
+
     void SetCell( const Float3 &pos, const CellType &val );
 
     void CheckLine(
@@ -59,6 +253,13 @@ public:
                         const Float3 &posLS,
                         Float3 &out_foundCellCenterLS ) const;
 
+    // first non-empty cell along the line, skips empty space using the
+    // mips, if available
+    bool FindFirstNonEmptyCell(
+                        const Float3 &lineSta,
+                        const Float3 &lineEnd,
+                        Float3 &out_foundCellCenterLS ) const;
+
     std::array<size_t,3> GetVoxSize() const
     {
         return { (size_t)1 << mN0, (size_t)1 << mN1, (size_t)1 << mN2 };
@@ -77,10 +278,24 @@ public:
     auto GetVoxN2() const { return mN2; }
 
     auto GetVoxCellW() const { return mUnit[0]; }
+
+private:
+    void loadChunk( size_t chunkIdx ) const;
+
+    void updateMipsBox( std::array<VLenT,3> bmin, std::array<VLenT,3> bmax );
+    CellType calcMipCell( size_t lev, VLenT p0, VLenT p1, VLenT p2 ) const;
+
+    void findClosestInMip(
+                size_t lev,
+                VLenT p0, VLenT p1, VLenT p2,
+                const Float3 &posVS,
+                float &io_closestSqr,
+                Float3 &io_closestCtrVS ) const;
 };
 
 //==================================================================
-inline void Voxels::SetCell( const Float3 &pos, const CellType &val )
+template <typename _T>
+inline void Voxels<_T>::SetCell( const Float3 &pos, const CellType &val )
 {
     VOXASSERT(
         (pos[0] >= mBBox[0][0] && pos[0] <= mBBox[1][0]) &&
@@ -97,9 +312,16 @@ inline void Voxels::SetCell( const Float3 &pos, const CellType &val )
     if ( cell1 < 0 || cell1 >= (1 << mN1) ) return;
     if ( cell2 < 0 || cell2 >= (1 << mN2) ) return;
 
+    // make sure that the chunk is there, before modifying it
+    TouchCell( (VLenT)cell0, (VLenT)cell1, (VLenT)cell2 );
+
     mCells[ ((size_t)cell2 << (mN1 + mN0)) +
             ((size_t)cell1 <<        mN0 ) +
             ((size_t)cell0               )  ] = val;
+
+    if ( HasMips() )
+        updateMipsBox( {(VLenT)cell0,   (VLenT)cell1,   (VLenT)cell2},
+                       {(VLenT)cell0+1, (VLenT)cell1+1, (VLenT)cell2+1} );
 }
 
 //==================================================================
@@ -270,11 +492,22 @@ inline auto Voxels_LineScan = [](
 
     auto &cells = vox.GetVoxCells();
 
+    c_auto doTouch = vox.HasChunkLoader();
+
     for (VLenT a=a0; a <= a1; a += 1, b += db, c += dc)
     {
 #if defined(VOX_TEST_WORK)
         VOXASSERT( (VLenT)a < nna && (VLenT)b < nnb && (VLenT)c < nnc );
 #endif
+        if ( doTouch )
+        {
+            VLenT coords[3];
+            coords[ia] = a;
+            coords[ib] = (VLenT)b;
+            coords[ic] = (VLenT)c;
+            vox.TouchCell( coords[0], coords[1], coords[2] );
+        }
+
         c_auto a_idx = (size_t)a << ta;
         c_auto b_idx = (size_t)b << tb;
         c_auto c_idx = (size_t)c << tc;
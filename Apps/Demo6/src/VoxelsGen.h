@@ -12,13 +12,14 @@
 #include "Voxels.h"
 
 //==================================================================
+template <typename _T>
 inline void VGen_DrawQuad(
-        Voxels &vox,
+        Voxels<_T> &vox,
         const Float3 &p00,
         const Float3 &p01,
         const Float3 &p10,
         const Float3 &p11,
-        const Voxels::CellType &val )
+        const typename Voxels<_T>::CellType &val )
 {
     c_auto dh0 = p01 - p00;
     c_auto dh1 = p11 - p10;
@@ -68,12 +69,13 @@ inline void VGen_DrawQuad(
 }
 
 //==================================================================
+template <typename _T>
 inline void VGen_DrawTrig(
-        Voxels &vox,
+        Voxels<_T> &vox,
         const Float3 &v0,
         const Float3 &v1,
         const Float3 &v2,
-        const Voxels::CellType &val )
+        const typename Voxels<_T>::CellType &val )
 {
     c_auto mid = (v0 + v1 + v2) * (1.0f/3);
     c_auto a   = (v0 + v1) * 0.5f;
@@ -86,12 +88,13 @@ inline void VGen_DrawTrig(
 }
 
 //==================================================================
+template <typename _T>
 inline void VGen_DrawTrigs(
-            Voxels &vox,
+            Voxels<_T> &vox,
             const Float3 *pPos,
             const size_t posN,
             const VVec<uint16_t> *pIndices,
-            const Voxels::CellType &val )
+            const typename Voxels<_T>::CellType &val )
 {
     VOXASSERT( (pIndices && (*pIndices).size() % 3 == 0) || posN % 3 == 0 );
 
@@ -109,18 +112,23 @@ inline void VGen_DrawTrigs(
  }
 
 //==================================================================
+template <typename _T>
 inline void VGen_DrawLine(
-            Voxels &vox,
+            Voxels<_T> &vox,
             const Float3 &lineSta,
             const Float3 &lineEnd,
-            const Voxels::CellType &srcVal )
+            const typename Voxels<_T>::CellType &srcVal )
 {
     Voxels_LineScan(
         vox,
         lineSta,
         lineEnd,
         [&]( c_auto ) {},
-        [&]( c_auto idx, auto &desVal ){ desVal = srcVal; } );
+        [&]( c_auto idx, auto &desVal )
+        {
+            desVal = srcVal;
+            vox.NotifyCellChanged( (size_t)(&desVal - vox.GetVoxCells().data()) );
+        } );
 }
 
 #endif
@@ -0,0 +1,388 @@
+//==================================================================
+/// VoxelsIO.cpp
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include "DBase.h"
+#include "VoxelsIO.h"
+
+static constexpr char     VOXFILE_MAGIC[4] = { 'V','O','X','C' };
+static constexpr uint32_t VOXFILE_VERSION  = 2;
+
+//==================================================================
+// calls fn( cellIdx, rowLen ) for each row of cells of a chunk, in x,y,z order
+static void forEachChunkRow( const auto &vox, size_t chunkIdx, const auto &fn )
+{
+    c_auto &cl2 = vox.GetChunkL2();
+    c_auto cn0 = vox.GetVoxN0() - cl2[0];
+    c_auto cn1 = vox.GetVoxN1() - cl2[1];
+
+    c_auto c0 = chunkIdx & (((size_t)1 << cn0) - 1);
+    c_auto c1 = (chunkIdx >> cn0) & (((size_t)1 << cn1) - 1);
+    c_auto c2 = chunkIdx >> (cn0 + cn1);
+
+    c_auto n0 = vox.GetVoxN0();
+    c_auto n1 = vox.GetVoxN1();
+
+    c_auto len0 = (size_t)1 << cl2[0];
+    c_auto len1 = (size_t)1 << cl2[1];
+    c_auto len2 = (size_t)1 << cl2[2];
+
+    for (size_t z=0; z < len2; ++z)
+    {
+        c_auto i2 = (c2 << cl2[2]) + z;
+        for (size_t y=0; y < len1; ++y)
+        {
+            c_auto i1 = (c1 << cl2[1]) + y;
+            fn( (i2 << (n1 + n0)) + (i1 << n0) + (c0 << cl2[0]), len0 );
+        }
+    }
+}
+
+//==================================================================
+static void writeVarUInt( std::vector<uint8_t> &out, size_t val )
+{
+    while ( val >= 0x80 )
+    {
+        out.push_back( (uint8_t)(val | 0x80) );
+        val >>= 7;
+    }
+    out.push_back( (uint8_t)val );
+}
+
+//==================================================================
+static bool readVarUInt( const uint8_t *&p, const uint8_t *pEnd, size_t &out_val )
+{
+    out_val = 0;
+    for (size_t shift=0; p != pEnd && shift < 64; shift += 7)
+    {
+        c_auto b = *p++;
+        out_val |= (size_t)(b & 0x7f) << shift;
+        if NOT( b & 0x80 )
+            return true;
+    }
+    return false;
+}
+
+//==================================================================
+// encode a chunk as palette + runs, returns the palette size (0 if empty)
+template <typename CellType>
+static uint32_t encodeChunk(
+                    const VVec<CellType> &cells,
+                    std::vector<uint8_t> &out )
+{
+    if ( std::all_of( cells.begin(), cells.end(), []( c_auto c ){ return c == CellType{}; } ) )
+        return 0;
+
+    // build the palette
+    std::vector<CellType> pal;
+    std::unordered_map<CellType,uint32_t> palMap;
+    std::vector<uint32_t> idxs( cells.size() );
+    for (size_t i=0; i < cells.size(); ++i)
+    {
+        auto [it, isNew] = palMap.insert({ cells[i], (uint32_t)pal.size() });
+        if ( isNew )
+            pal.push_back( cells[i] );
+
+        idxs[i] = it->second;
+    }
+
+    c_auto palN = (uint32_t)pal.size();
+    c_auto isWide = palN > 256;
+
+    c_auto palBytes = palN * sizeof(CellType);
+    out.resize( palBytes );
+    memcpy( out.data(), pal.data(), palBytes );
+
+    // runs of indices
+    for (size_t i=0; i < idxs.size();)
+    {
+        size_t j = i + 1;
+        while ( j < idxs.size() && idxs[j] == idxs[i] )
+            ++j;
+
+        out.push_back( (uint8_t)idxs[i] );
+        if ( isWide )
+            out.push_back( (uint8_t)(idxs[i] >> 8) );
+
+        writeVarUInt( out, j - i );
+        i = j;
+    }
+
+    return palN;
+}
+
+//==================================================================
+template <typename _T>
+bool VoxelsIO_Save( const Voxels<_T> &vox, const std::string &pathFName )
+{
+    using CellType = _T;
+
+    // streamed chunks must be in memory before they can be written
+    vox.TouchAllChunks();
+
+    c_auto &bbox = vox.GetVoxBBox();
+    c_auto &cl2 = vox.GetChunkL2();
+
+    VoxFileHeader head {};
+    memcpy( head.magic, VOXFILE_MAGIC, sizeof(head.magic) );
+    head.version    = VOXFILE_VERSION;
+    head.cellSize   = (uint32_t)sizeof(CellType);
+    head.n[0]       = vox.GetVoxN0();
+    head.n[1]       = vox.GetVoxN1();
+    head.n[2]       = vox.GetVoxN2();
+    for (size_t i=0; i < 3; ++i)
+    {
+        head.chunkL2[i] = cl2[i];
+        head.bboxMin[i] = bbox[0][(glm::length_t)i];
+        head.bboxMax[i] = bbox[1][(glm::length_t)i];
+    }
+    head.chunksN    = (uint32_t)vox.GetChunksN();
+
+    // RGB cells don't need the palette
+    std::vector<uint32_t> pal;
+    if constexpr ( !Voxels<_T>::IS_RGB_CELL )
+        pal = vox.GetPalette()->GetCols();
+
+    head.palN       = (uint32_t)pal.size();
+
+    std::vector<VoxFileChunk> dir( head.chunksN );
+    std::vector<uint8_t> payloads;
+
+    c_auto dataOff = sizeof(head) + sizeof(pal[0]) * pal.size()
+                                  + sizeof(VoxFileChunk) * dir.size();
+
+    c_auto &cells = vox.GetVoxCells();
+    VVec<CellType> chunkCells;
+    std::vector<uint8_t> chunkData;
+    for (size_t ci=0; ci < dir.size(); ++ci)
+    {
+        // gather the chunk
+        chunkCells.clear();
+        forEachChunkRow( vox, ci, [&]( c_auto cellIdx, c_auto rowLen )
+        {
+            chunkCells.insert( chunkCells.end(),
+                               cells.begin() + cellIdx,
+                               cells.begin() + cellIdx + rowLen );
+        });
+
+        chunkData.clear();
+        auto &de = dir[ci];
+        de.palN   = encodeChunk( chunkCells, chunkData );
+        de.offset = dataOff + payloads.size();
+        de.size   = (uint32_t)chunkData.size();
+
+        payloads.insert( payloads.end(), chunkData.begin(), chunkData.end() );
+    }
+
+    std::ofstream file( pathFName, std::ios::binary );
+    if NOT( file.is_open() )
+    {
+        printf( "** ERROR could not open %s\n", pathFName.c_str() );
+        return false;
+    }
+
+    file.write( (const char *)&head, sizeof(head) );
+    file.write( (const char *)pal.data(), (std::streamsize)(sizeof(pal[0]) * pal.size()) );
+    file.write( (const char *)dir.data(), (std::streamsize)(sizeof(dir[0]) * dir.size()) );
+    file.write( (const char *)payloads.data(), (std::streamsize)payloads.size() );
+
+    if NOT( file.good() )
+    {
+        printf( "** ERROR failed writing %s\n", pathFName.c_str() );
+        return false;
+    }
+
+    printf( "** Saved %s (%zu bytes)\n", pathFName.c_str(), dataOff + payloads.size() );
+    return true;
+}
+
+//==================================================================
+template <typename _T>
+bool VoxelsFile::OpenAndAttach( const std::string &pathFName, Voxels<_T> &vox )
+{
+    // finish streaming from any previous file, before it gets replaced
+    vox.TouchAllChunks();
+    vox.ClearChunkLoader();
+
+    mpDir = nullptr;
+    mLoadedChunksN = 0;
+
+    if NOT( mFile.Open( pathFName ) )
+    {
+        printf( "** ERROR could not open %s\n", pathFName.c_str() );
+        return false;
+    }
+
+    auto fail = [&]( const char *pMsg )
+    {
+        printf( "** ERROR %s: %s\n", pathFName.c_str(), pMsg );
+        mFile.Close();
+        return false;
+    };
+
+    if ( mFile.GetSize() < sizeof(mHead) )
+        return fail( "file too small" );
+
+    memcpy( &mHead, mFile.GetData(), sizeof(mHead) );
+
+    if ( memcmp( mHead.magic, VOXFILE_MAGIC, sizeof(mHead.magic) ) != 0 ||
+         mHead.version != VOXFILE_VERSION )
+        return fail( "unknown format" );
+
+    if ( mHead.cellSize != sizeof(_T) )
+        return fail( "unsupported cell type" );
+
+    for (size_t i=0; i < 3; ++i)
+        if ( mHead.n[i] > 12 || mHead.chunkL2[i] != std::min( mHead.n[i], Voxels<_T>::CHUNK_L2 ) )
+            return fail( "bad dimensions" );
+
+    if ( mHead.palN > ((size_t)1 << (sizeof(_T) * 8)) )
+        return fail( "palette too large" );
+
+    // as Voxels::GetChunksN() will have it, checked before vox is touched
+    size_t chunksL2 = 0;
+    for (size_t i=0; i < 3; ++i)
+        chunksL2 += (size_t)(mHead.n[i] - mHead.chunkL2[i]);
+
+    if ( mHead.chunksN != ((size_t)1 << chunksL2) )
+        return fail( "bad chunks count" );
+
+    c_auto palOff = sizeof(mHead);
+    c_auto dirOff = palOff + sizeof(uint32_t) * (size_t)mHead.palN;
+    c_auto dirEnd = dirOff + sizeof(VoxFileChunk) * (size_t)mHead.chunksN;
+    if ( mFile.GetSize() < dirEnd )
+        return fail( "truncated chunk directory" );
+
+    c_auto bbox = BBoxT{{ { mHead.bboxMin[0], mHead.bboxMin[1], mHead.bboxMin[2] },
+                          { mHead.bboxMax[0], mHead.bboxMax[1], mHead.bboxMax[2] } }};
+
+    // no need to clear, every chunk gets written when it's loaded
+    vox.SetBBoxAndDims( bbox, mHead.n[0], mHead.n[1], mHead.n[2], false );
+
+    assert( vox.GetChunksN() == mHead.chunksN );
+
+    if constexpr ( !Voxels<_T>::IS_RGB_CELL )
+    {
+        std::vector<uint32_t> pal( mHead.palN );
+        memcpy( pal.data(), mFile.GetData() + palOff, sizeof(pal[0]) * pal.size() );
+        vox.SetPalette( std::make_shared<VoxPalette>( std::move( pal ) ) );
+    }
+
+    mpDir = mFile.GetData() + dirOff;
+
+    vox.SetChunkLoader( [this]( Voxels<_T> &v, size_t ci ){ decodeChunk( v, ci ); } );
+
+    return true;
+}
+
+//==================================================================
+template <typename _T>
+void VoxelsFile::decodeChunk( Voxels<_T> &vox, size_t chunkIdx )
+{
+    using CellType = _T;
+
+    mLoadedChunksN += 1;
+
+    auto &cells = vox.GetVoxCells();
+
+    // the directory is not necessarily aligned
+    VoxFileChunk de;
+    memcpy( &de, mpDir + sizeof(de) * chunkIdx, sizeof(de) );
+
+    // empty chunk, or bad data. Either way it gets cleared
+    auto clearChunk = [&]()
+    {
+        forEachChunkRow( vox, chunkIdx, [&]( c_auto cellIdx, c_auto rowLen )
+        {
+            std::fill_n( cells.begin() + cellIdx, rowLen, CellType{} );
+        });
+    };
+
+    if ( de.palN == 0 )
+    {
+        clearChunk();
+        return;
+    }
+
+    c_auto palBytes = (size_t)de.palN * sizeof(CellType);
+    if ( de.offset > mFile.GetSize() ||
+         de.size > mFile.GetSize() - de.offset ||
+         de.size < palBytes )
+    {
+        printf( "** ERROR bad chunk %zu\n", chunkIdx );
+        clearChunk();
+        return;
+    }
+
+    c_auto *p    = mFile.GetData() + de.offset;
+    c_auto *pEnd = p + de.size;
+
+    std::vector<CellType> pal( de.palN );
+    memcpy( pal.data(), p, palBytes );
+    p += palBytes;
+
+    c_auto isWide = de.palN > 256;
+
+    // current run
+    CellType runVal {};
+    size_t   runLeft = 0;
+
+    bool isBad = false;
+    forEachChunkRow( vox, chunkIdx, [&]( c_auto cellIdx, c_auto rowLen )
+    {
+        for (size_t i=0; i < rowLen;)
+        {
+            if NOT( runLeft )
+            {
+                size_t idx = 0;
+                if ( isBad || (pEnd - p) < (isWide ? 2 : 1) )
+                    isBad = true;
+                else
+                {
+                    idx = p[0];
+                    if ( isWide )
+                        idx |= (size_t)p[1] << 8;
+                    p += isWide ? 2 : 1;
+
+                    if ( idx >= pal.size() || !readVarUInt( p, pEnd, runLeft ) || !runLeft )
+                        isBad = true;
+                }
+
+                if ( isBad )
+                {
+                    runVal  = CellType{};
+                    runLeft = rowLen - i;
+                }
+                else
+                    runVal = pal[ idx ];
+            }
+
+            c_auto n = std::min( runLeft, rowLen - i );
+            std::fill_n( cells.begin() + cellIdx + i, n, runVal );
+            i += n;
+            runLeft -= n;
+        }
+    });
+
+    if ( isBad )
+        printf( "** ERROR bad chunk data %zu\n", chunkIdx );
+}
+
+//==================================================================
+#define VOXELSIO_INSTANTIATE(_T_) \
+    template bool VoxelsIO_Save( const Voxels<_T_> &, const std::string & ); \
+    template bool VoxelsFile::OpenAndAttach( const std::string &, Voxels<_T_> & );
+
+VOXELSIO_INSTANTIATE( uint8_t  )
+VOXELSIO_INSTANTIATE( uint16_t )
+VOXELSIO_INSTANTIATE( uint32_t )
@@ -0,0 +1,76 @@
+//==================================================================
+/// VoxelsIO.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef VOXELSIO_H
+#define VOXELSIO_H
+
+#include <string>
+#include "MappedFile.h"
+#include "Voxels.h"
+
+//==================================================================
+// File layout (little-endian):
+//  - VoxFileHeader
+//  - shared palette, palN x RGB uint32 (none for RGB cells)
+//  - VoxFileChunk x chunksN (the chunk directory)
+//  - chunk payloads: local palette (palN x CellType), then runs of
+//    (palette index, run length) covering the chunk in x,y,z order.
+//    The index is 1 byte if palN <= 256, 2 bytes otherwise, the
+//    run length is a LEB128 varint. Empty chunks have no payload.
+struct VoxFileHeader
+{
+    char        magic[4];       // "VOXC"
+    uint32_t    version;
+    uint32_t    cellSize;       // sizeof(Voxels::CellType)
+    uint32_t    n[3];           // log2 of the size on each axis
+    uint32_t    chunkL2[3];     // log2 of the chunk size on each axis
+    float       bboxMin[3];
+    float       bboxMax[3];
+    uint32_t    chunksN;
+    uint32_t    palN;           // colors in the shared palette
+    uint32_t    reserved;
+};
+static_assert( sizeof(VoxFileHeader) == 72 );
+
+struct VoxFileChunk
+{
+    uint64_t    offset;         // from the beginning of the file
+    uint32_t    size;           // size of the payload in bytes
+    uint32_t    palN;           // 0 for an empty chunk
+};
+static_assert( sizeof(VoxFileChunk) == 16 );
+
+//==================================================================
+template <typename _T>
+bool VoxelsIO_Save( const Voxels<_T> &vox, const std::string &pathFName );
+
+//==================================================================
+/// Memory-mapped voxels file. Opening only reads the header and the
+/// chunk directory, chunks are decoded when the attached Voxels first
+/// touches them. The object must outlive the streaming of the Voxels.
+/// The Voxels gets a new palette, loaded from the file.
+class VoxelsFile
+{
+    MappedFile              mFile;
+    VoxFileHeader           mHead {};
+    const uint8_t           *mpDir {};
+    size_t                  mLoadedChunksN {};
+
+public:
+    template <typename _T>
+    bool OpenAndAttach( const std::string &pathFName, Voxels<_T> &vox );
+
+    size_t GetLoadedChunksN() const { return mLoadedChunksN; }
+    size_t GetChunksN() const { return mHead.chunksN; }
+
+private:
+    template <typename _T>
+    void decodeChunk( Voxels<_T> &vox, size_t chunkIdx );
+};
+
+#endif
@@ -11,17 +11,30 @@
 #include <stdlib.h>
 #include <array>
 #include <vector>
-#include <algorithm> // for std::sort
 #include "DBase.h"
 #include "MathBase.h"
+#include "DepthSort.h"
+#include "ParallelFor.h"
 #include "Voxels.h"
 #include "VoxelsGen.h"
+#include "VoxelsIO.h"
 
 #include "MinimalSDLApp.h"
 
 //#define ENABLE_DEBUG_DRAW
 static bool DO_SPIN_TRIANGLE    = true;
 static bool ANIM_OBJ_POS        = true;
+static bool COHERENT_SORT       = true;
+static bool LIVE_SCENE          = true;
+static bool USE_MIPS            = false;
+static bool MT_DRAW             = true;
+static bool PICK_VIEW           = true; // mark the first cell at the view center
+static float LOD_MIN_CELL_PIX   = 2.f;  // coarser levels when cells get smaller
+
+static const std::string VOXELS_PATHFNAME = "demo6_voxels.vox";
+
+// only a few colors are used, so cells are palette indices
+using DemoVoxels = Voxels<uint8_t>;
 
 //==================================================================
 static constexpr float VOXEL_DIM        = 1.000f;   // 1 meter span
@@ -49,17 +62,15 @@ struct VertDev
 };
 
 //==================================================================
-inline VertDev makeDeviceVert(
-                    const Matrix44 &xform,
+// from an already transformed vertex, in homogeneous coordinates
+inline VertDev makeDeviceVertH(
+                    const glm::vec4 &posH,
                     const VertObj &vobj,
                     float deviceW,
                     float deviceH )
 {
     VertDev vdev;
 
-    // homogeneus coordinates (-w..w)
-    const auto posH = xform * glm::vec4( vobj.pos, 1.f );
-
     if ( posH[2] <= 0 ) // skip if it's behind the camera
         return vdev;
 
@@ -79,6 +90,17 @@ inline VertDev makeDeviceVert(
     return vdev;
 }
 
+//
+inline VertDev makeDeviceVert(
+                    const Matrix44 &xform,
+                    const VertObj &vobj,
+                    float deviceW,
+                    float deviceH )
+{
+    // homogeneus coordinates (-w..w)
+    return makeDeviceVertH( xform * glm::vec4( vobj.pos, 1.f ), vobj, deviceW, deviceH );
+}
+
 //
 inline bool isValidDeviceVert( const Float3 &vert )
 {
@@ -125,10 +147,39 @@ static std::array<T,8> makeCubeVerts( const T &mi, const T &ma )
     };
 }
 
+//==================================================================
+// true if the box is surely out of view. margin is in clip-space units
+inline bool isBoxOutOfView(
+                    const Matrix44 &xform,
+                    const Float3 &bmin,
+                    const Float3 &bmax,
+                    float margin )
+{
+    c_auto verts = makeCubeVerts( bmin, bmax );
+
+    // out-codes, a plane culls the box if all the verts are outside of it
+    uint32_t andCode = 0x3f;
+    for (c_auto &v : verts)
+    {
+        c_auto h = xform * glm::vec4( v, 1.f );
+
+        uint32_t code = 0;
+        if ( h[0] < -h[3] - margin ) code |= 1 << 0;
+        if ( h[0] >  h[3] + margin ) code |= 1 << 1;
+        if ( h[1] < -h[3] - margin ) code |= 1 << 2;
+        if ( h[1] >  h[3] + margin ) code |= 1 << 3;
+        if ( h[2] <= 0             ) code |= 1 << 4;
+        if ( h[2] >  h[3]          ) code |= 1 << 5;
+
+        andCode &= code;
+    }
+    return andCode != 0;
+}
+
 //==================================================================
 inline void voxel_DebugDraw(
                 auto *pRend,
-                const Voxels &vox,
+                const auto &vox,
                 float deviceW,
                 float deviceH,
                 const Matrix44 &proj_obj )
@@ -170,13 +221,13 @@ inline void voxel_DebugDraw(
 //==================================================================
 inline void voxel_Draw(
                 auto *pRend,
-                const Voxels &vox,
+                DepthSort &dsort,
+                const auto &vox,
                 float deviceW,
                 float deviceH,
-                const Matrix44 &proj_obj )
+                const Matrix44 &proj_obj,
+                size_t threadsN )
 {
-    std::vector<VertDev> vertsDev;
-
     c_auto siz3 = vox.GetVoxSize();
     c_auto bbox = vox.GetVoxBBox();
     c_auto vsca = (bbox[1] - bbox[0]) / Float3( siz3[0]-1, siz3[1]-1, siz3[2]-1 );
@@ -184,47 +235,194 @@ inline void voxel_Draw(
 
     c_auto cellW = vox.GetVoxCellW();
 
-    c_auto *pCells = vox.GetVoxCells().data();
+    c_auto cl2 = vox.GetChunkL2();
+    c_auto chunksSiz = vox.GetChunksSize();
+
+    // coarsest level usable, where a chunk still maps to its own mip cells
+    c_auto maxLev = std::min( (size_t)vox.CHUNK_L2, vox.GetMipLevelsN()-1 );
+
+    // chunk bounds, from the first to the last cell position
+    auto calcChunkBox = [&]( size_t c0, size_t c1, size_t c2 )
+    {
+        return std::array<Float3,2>{
+            vtra + vsca * Float3( (float)(c0 << cl2[0]),
+                                  (float)(c1 << cl2[1]),
+                                  (float)(c2 << cl2[2]) ),
+            vtra + vsca * Float3( (float)(((c0+1) << cl2[0]) - 1),
+                                  (float)(((c1+1) << cl2[1]) - 1),
+                                  (float)(((c2+1) << cl2[2]) - 1) ) };
+    };
 
-    size_t ci = 0;
-    for (size_t zi=0; zi < siz3[2]; ++zi)
+    // bring in the visible chunks that are still streaming. Done here,
+    // before the jobs, since the resident flags aren't thread-safe.
+    // There are no mips while streaming, so the cells are of level 0
+    if ( vox.HasChunkLoader() )
     {
-        c_auto z = vtra[2] + vsca[2] * (float)zi;
-        for (size_t yi=0; yi < siz3[1]; ++yi)
+        for (size_t c2=0; c2 < chunksSiz[2]; ++c2)
+            for (size_t c1=0; c1 < chunksSiz[1]; ++c1)
+                for (size_t c0=0; c0 < chunksSiz[0]; ++c0)
+                {
+                    c_auto box = calcChunkBox( c0, c1, c2 );
+                    if NOT( isBoxOutOfView( proj_obj, box[0], box[1], cellW ) )
+                        vox.TouchChunk( vox.MakeChunkIdx( c0, c1, c2 ) );
+                }
+    }
+
+    auto drawChunk = [&]( size_t c0, size_t c1, size_t c2, std::vector<VertDev> &out_verts )
+    {
+        c_auto box = calcChunkBox( c0, c1, c2 );
+        c_auto &chunkMin = box[0];
+        c_auto &chunkMax = box[1];
+
+        size_t lev = 0;
+        if ( maxLev )
         {
-            c_auto y = vtra[1] + vsca[1] * (float)yi;
-            for (size_t xi=0; xi < siz3[0]; ++xi)
-            {
-                c_auto val = pCells[ ci++ ];
-                if NOT( val )
-                    continue;
+            // projected size of a cell, at the center of the chunk
+            c_auto ctrDev = makeDeviceVert(
+                                proj_obj, { (chunkMin + chunkMax) * 0.5f, cellW, 0 },
+                                deviceW, deviceH );
+
+            // go coarser while the bigger cells are still small enough
+            if ( ctrDev.pos[2] > 0 )
+                while ( lev < maxLev && ctrDev.siz[0] * (float)(2 << lev) <= LOD_MIN_CELL_PIX )
+                    ++lev;
+        }
+
+        c_auto cellSiz = cellW * (float)(1 << lev);
+
+        // the cells are drawn as rects as big as the cell size
+        if ( isBoxOutOfView( proj_obj, chunkMin, chunkMax, cellSiz ) )
+            return;
+
+        c_auto n = vox.GetMipN( lev );
+        c_auto *pCells = vox.GetMipCells( lev );
 
-                c_auto x = vtra[0] + vsca[0] * (float)xi;
+        // level 0 cells covered by a cell of this level, on each axis
+        c_auto span = Float3( (float)(1 << std::min( (VLenT)lev, vox.GetVoxN0() )),
+                              (float)(1 << std::min( (VLenT)lev, vox.GetVoxN1() )),
+                              (float)(1 << std::min( (VLenT)lev, vox.GetVoxN2() )) );
 
-                VertObj vobj;
-                vobj.pos = {x,y,z};
-                vobj.siz = cellW;
-                vobj.col = val;
+        c_auto spanOff = (span - 1.f) * 0.5f;
 
-                // convert from object-space to device-space (2D display dimensions)
-                c_auto vout = makeDeviceVert( proj_obj, vobj, deviceW, deviceH );
+        c_auto sta0 = (c0 << cl2[0]) >> lev;
+        c_auto sta1 = (c1 << cl2[1]) >> lev;
+        c_auto sta2 = (c2 << cl2[2]) >> lev;
+        c_auto end0 = sta0 + std::max( (size_t)1, ((size_t)1 << cl2[0]) >> lev );
+        c_auto end1 = sta1 + std::max( (size_t)1, ((size_t)1 << cl2[1]) >> lev );
+        c_auto end2 = sta2 + std::max( (size_t)1, ((size_t)1 << cl2[2]) >> lev );
 
-                // store the vertex
-                if ( vout.pos[2] > 0 )
-                    vertsDev.push_back( vout );
+        // the projection is linear in the cell coordinates, so it's stepped
+        // along each axis, instead of transforming every cell
+        c_auto stepX = proj_obj[0] * (vsca[0] * span[0]);
+        c_auto stepY = proj_obj[1] * (vsca[1] * span[1]);
+        c_auto stepZ = proj_obj[2] * (vsca[2] * span[2]);
+
+        c_auto firstPos = vtra + vsca * (Float3( (float)sta0, (float)sta1, (float)sta2 ) * span + spanOff);
+
+        auto posH_Z = proj_obj * glm::vec4( firstPos, 1.f );
+
+        for (size_t zi=sta2; zi < end2; ++zi, posH_Z += stepZ)
+        {
+            auto posH_Y = posH_Z;
+            for (size_t yi=sta1; yi < end1; ++yi, posH_Y += stepY)
+            {
+                c_auto *pRow = &pCells[ (zi << (n[1] + n[0])) + (yi << n[0]) ];
+
+                auto posH = posH_Y;
+                for (size_t xi=sta0; xi < end0; ++xi, posH += stepX)
+                {
+                    c_auto val = pRow[ xi ];
+                    if NOT( val )
+                        continue;
+
+                    VertObj vobj;
+                    vobj.siz = cellSiz;
+                    vobj.col = vox.GetCellRGB( val );
+
+                    // convert to device-space (2D display dimensions)
+                    c_auto vout = makeDeviceVertH( posH, vobj, deviceW, deviceH );
+
+                    // skip if behind the camera or off-screen
+                    if ( vout.pos[2] <= 0 ||
+                         vout.pos[0] + vout.siz[0] * 0.5f < 0       ||
+                         vout.pos[0] - vout.siz[0] * 0.5f > deviceW ||
+                         vout.pos[1] + vout.siz[1] * 0.5f < 0       ||
+                         vout.pos[1] - vout.siz[1] * 0.5f > deviceH )
+                        continue;
+
+                    out_verts.push_back( vout );
+                }
             }
         }
+    };
+
+    // one job per slice of chunks along Z, each with its own output, so
+    // that the merged result doesn't depend on the threads timing
+    std::vector<std::vector<VertDev>> sliceVerts( chunksSiz[2] );
+
+    PF_RunJobs( chunksSiz[2], [&]( size_t c2 )
+    {
+        auto &verts = sliceVerts[ c2 ];
+        for (size_t c1=0; c1 < chunksSiz[1]; ++c1)
+            for (size_t c0=0; c0 < chunksSiz[0]; ++c0)
+                drawChunk( c0, c1, c2, verts );
+    }, threadsN );
+
+    std::vector<VertDev> vertsDev;
+    {
+        size_t totN = 0;
+        for (c_auto &verts : sliceVerts)
+            totN += verts.size();
+
+        vertsDev.reserve( totN );
+        for (c_auto &verts : sliceVerts)
+            vertsDev.insert( vertsDev.end(), verts.begin(), verts.end() );
     }
 
     // sort with bigger Z first
-    std::sort( vertsDev.begin(), vertsDev.end(), []( c_auto &l, c_auto &r )
-    {
-        return l.pos[2] > r.pos[2];
-    });
+    c_auto &order = dsort.SortBackToFront(
+                        vertsDev.size(),
+                        [&]( size_t i ){ return vertsDev[i].pos[2]; } );
 
     // finally render the verts
-    for (const auto &v : vertsDev)
-        drawAtom( pRend, v );
+    for (c_auto i : order)
+        drawAtom( pRend, vertsDev[i] );
+}
+
+//==================================================================
+// the first non-empty cell along the ray of the center of the view, with
+// the empty space skipped by the mips, when enabled. It's marked with a
+// frame of the size of 2 cells
+static bool voxel_DrawPick(
+                auto *pRend,
+                const auto &vox,
+                float deviceW,
+                float deviceH,
+                const Matrix44 &proj_obj,
+                const Matrix44 &world_obj,
+                Float3 &out_cellCtrLS )
+{
+    // the camera is at (0, 0, CAMERA_DIST), looking down Z
+    c_auto obj_world = glm::inverse( world_obj );
+    c_auto staLS = Float3( obj_world * glm::vec4( 0.f, 0.f, CAMERA_DIST, 1.f ) );
+    c_auto endLS = Float3( obj_world * glm::vec4( 0.f, 0.f, CAMERA_DIST - CAMERA_FAR, 1.f ) );
+
+    if NOT( vox.FindFirstNonEmptyCell( staLS, endLS, out_cellCtrLS ) )
+        return false;
+
+    c_auto vdev = makeDeviceVert( proj_obj, { out_cellCtrLS, VOXEL_CELL_UNIT * 2, 0 }, deviceW, deviceH );
+    if NOT( isValidDeviceVert( vdev.pos ) )
+        return true;
+
+    SDL_SetRenderDrawColor( pRend, 255, 255, 255, 255 );
+    SDL_FRect rc;
+    rc.x = vdev.pos[0] - vdev.siz[0] * 0.5f;
+    rc.y = vdev.pos[1] - vdev.siz[1] * 0.5f;
+    rc.w = vdev.siz[0];
+    rc.h = vdev.siz[1];
+    SDL_RenderDrawRectF( pRend, &rc );
+
+    return true;
 }
 
 //==================================================================
@@ -263,7 +461,7 @@ static void voxel_Update( auto &vox, size_t frameCnt )
                                       vox.GetVoxBBox()[1] );
 
         for (c_auto &v : verts)
-            vox.SetCell( v, 0x00ff00 );
+            vox.SetCell( v, vox.MakeCell( 0x00ff00 ) );
     }
 
     // a standing triangle
@@ -287,7 +485,7 @@ static void voxel_Update( auto &vox, size_t frameCnt )
             xformV( 0.50f, 0.9f, 0.5f ),
             xformV( 0.10f, 0.1f, 0.5f ),
             xformV( 0.90f, 0.1f, 0.5f ),
-            0xff0000 );
+            vox.MakeCell( 0xff0000 ) );
     }
     else
     {
@@ -295,14 +493,14 @@ static void voxel_Update( auto &vox, size_t frameCnt )
             V( 0.50f, 0.9f, 0.5f ),
             V( 0.10f, 0.1f, 0.5f ),
             V( 0.90f, 0.1f, 0.5f ),
-            0xff0000 );
+            vox.MakeCell( 0xff0000 ) );
     }
 
     // white floor
     VGen_DrawQuad( vox,
         V(0.00f, 0.f, 0.00f), V(0.00f, 0.f, 1.00f),
         V(1.00f, 0.f, 0.00f), V(1.00f, 0.f, 1.00f),
-        0xe0e0e0 );
+        vox.MakeCell( 0xe0e0e0 ) );
 
     // a flat quad bouncing up and down
     {
@@ -311,7 +509,7 @@ static void voxel_Update( auto &vox, size_t frameCnt )
         VGen_DrawQuad( vox,
             V(0.10f, y, 0.10f), V(0.10f, y, 0.90f),
             V(0.90f, y, 0.10f), V(0.90f, y, 0.90f),
-            0x0010ff );
+            vox.MakeCell( 0x0010ff ) );
     }
 
     // draw frame
@@ -321,7 +519,7 @@ static void voxel_Update( auto &vox, size_t frameCnt )
 
         auto drawLine = [&]( auto i, auto j )
         {
-            VGen_DrawLine( vox, verts[i], verts[j], 0x00ff00 );
+            VGen_DrawLine( vox, verts[i], verts[j], vox.MakeCell( 0x00ff00 ) );
         };
 
         // bottom and top
@@ -349,10 +547,20 @@ int main( int argc, char *argv[] )
     MinimalSDLApp app( argc, argv, W, H );
 
     // create the voxel
-    Voxels vox;
+    DemoVoxels vox;
 
     voxel_Init( vox );
 
+    // depth sorter, keeps its buffers across frames
+    DepthSort dsort;
+
+    // file that the voxels stream from, when loaded
+    VoxelsFile voxFile;
+
+    // the last pick at the view center
+    bool    pickFound = false;
+    Float3  pickCtrLS {};
+
     // begin the main/rendering loop
     for (size_t frameCnt=0; ; ++frameCnt)
     {
@@ -366,6 +574,27 @@ int main( int argc, char *argv[] )
             ImGui::Text( "Frame: %zu", frameCnt );
             ImGui::Checkbox( "Spin triangle", &DO_SPIN_TRIANGLE );
             ImGui::Checkbox( "Animate obj position", &ANIM_OBJ_POS );
+            ImGui::Checkbox( "Coherent depth sort", &COHERENT_SORT );
+            ImGui::Checkbox( "Live scene", &LIVE_SCENE );
+            ImGui::Checkbox( "Multithreaded draw", &MT_DRAW );
+            ImGui::Checkbox( "Use mips (LOD)", &USE_MIPS );
+            if ( USE_MIPS )
+                ImGui::SliderFloat( "LOD min cell pixels", &LOD_MIN_CELL_PIX, 0.5f, 8.f );
+
+            ImGui::Checkbox( "Pick at view center", &PICK_VIEW );
+            if ( PICK_VIEW && pickFound )
+                ImGui::Text( "Picked: %.3f %.3f %.3f", pickCtrLS[0], pickCtrLS[1], pickCtrLS[2] );
+
+            if ( ImGui::Button( "Save" ) )
+                VoxelsIO_Save( vox, VOXELS_PATHFNAME );
+
+            ImGui::SameLine();
+            if ( ImGui::Button( "Load" ) && voxFile.OpenAndAttach( VOXELS_PATHFNAME, vox ) )
+                LIVE_SCENE = false; // show what was loaded
+
+            if ( vox.HasChunkLoader() )
+                ImGui::Text( "Loaded chunks: %zu / %zu",
+                        voxFile.GetLoadedChunksN(), voxFile.GetChunksN() );
         } );
 #endif
         // get the renderer
@@ -410,13 +639,22 @@ int main( int argc, char *argv[] )
         // transforming obj -> projection
         const auto proj_obj = proj_camera * camera_world * world_obj;
 
+        // mips are built on demand, streaming chunks get loaded
+        if ( USE_MIPS != vox.HasMips() )
+            vox.SetMipsEnabled( USE_MIPS );
+
         // draw the outline
-        voxel_Update( vox, frameCnt );
+        if ( LIVE_SCENE )
+            voxel_Update( vox, frameCnt );
 #ifdef ENABLE_DEBUG_DRAW
         voxel_DebugDraw( pRend, vox, W, H, proj_obj );
 #endif
         // draw the voxel
-        voxel_Draw( pRend, vox, W, H, proj_obj );
+        dsort.SetUseCoherence( COHERENT_SORT );
+        voxel_Draw( pRend, dsort, vox, W, H, proj_obj, MT_DRAW ? 0 : 1 );
+
+        pickFound = PICK_VIEW &&
+                    voxel_DrawPick( pRend, vox, W, H, proj_obj, world_obj, pickCtrLS );
 
         // end of the frame (will present)
         app.EndFrame();
@@ -0,0 +1,338 @@
+//==================================================================
+/// MU_MinMaxPyramid.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef MU_MINMAXPYRAMID_H
+#define MU_MINMAXPYRAMID_H
+
+#include <float.h>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include "DBase.h"
+#include "MathBase.h"
+#include "ParallelFor.h"
+#include "Map2D.h"
+
+//==================================================================
+/// Min/max pyramid of a square map of heights, for ray casting.
+/// A cell of level 0 bounds a quad of the map, from the sample (x, y)
+/// to (x+1, y+1). A cell of level l bounds 2^l x 2^l quads, and the top
+/// level is a single cell. The quads of the last row and column would
+/// go past the map, and are empty.
+/// Rays are in map space, x and z are the column and the row in texels,
+/// y is the height. The surface is the mesh of the map, two triangles
+/// per quad, split on the (x, y) - (x+1, y+1) diagonal.
+/// The map is referenced, by rows of its pitch, and must stay valid.
+class MU_MinMaxPyramid
+{
+public:
+    struct Ray
+    {
+        Float3      pos;
+        Float3      dir;                // doesn't need to be normalized
+        float       maxT    {FLT_MAX};  // in units of dir
+    };
+
+    struct Hit
+    {
+        float       t       {FLT_MAX};  // pos + dir * t, FLT_MAX for no hit
+        uint32_t    x       {};         // the quad
+        uint32_t    y       {};
+
+        bool IsHit() const { return t != FLT_MAX; }
+    };
+
+private:
+    struct MinMax
+    {
+        float   mi  { FLT_MAX};
+        float   ma  {-FLT_MAX};
+    };
+
+    Map2DView<const float>              mMap;
+    size_t                              mSizL2  {};
+    std::vector<std::vector<MinMax>>    mLevels;    // [level][cell]
+
+public:
+    //==================================================================
+    void Build( const Map2DView<const float> &map, size_t threadsN=0 )
+    {
+        assert( map.GetW() == map.GetH() && std::has_single_bit( map.GetW() ) );
+
+        c_auto sizL2 = (size_t)std::countr_zero( map.GetW() );
+
+        mMap   = map;
+        mSizL2 = sizL2;
+
+        mLevels.resize( sizL2 + 1 );
+        for (size_t l=0; l <= sizL2; ++l)
+            mLevels[l].assign( (size_t)1 << ((sizL2 - l) * 2), MinMax() );
+
+        c_auto siz = (size_t)1 << sizL2;
+        updateLevels( 0, 0, siz, siz, threadsN );
+    }
+
+    //==================================================================
+    // after a change of the samples in [x0, x1) x [y0, y1) of the map
+    void UpdateRect( size_t x0, size_t y0, size_t x1, size_t y1, size_t threadsN=0 )
+    {
+        c_auto siz = (size_t)1 << mSizL2;
+
+        // the quads that use those samples
+        updateLevels( x0 ? x0 - 1 : 0,
+                      y0 ? y0 - 1 : 0,
+                      std::min( x1, siz ),
+                      std::min( y1, siz ),
+                      threadsN );
+    }
+
+    //==================================================================
+    float GetMinH() const { return mLevels.empty() ? 0.f : mLevels.back()[0].mi; }
+    float GetMaxH() const { return mLevels.empty() ? 0.f : mLevels.back()[0].ma; }
+
+    //==================================================================
+    /// Nearest hit of the ray with the surface. The cells are visited
+    /// from the top, nearest child first, and a cell is skipped with all
+    /// its quads when the ray misses its box, or when it starts beyond
+    /// the nearest hit found so far.
+    Hit CastRay( const Ray &ray ) const
+    {
+        Hit hit;
+        if ( mLevels.empty() )
+            return hit;
+
+        c_auto ooDir = Float3( 1.f / ray.dir[0], 1.f / ray.dir[1], 1.f / ray.dir[2] );
+
+        struct Node
+        {
+            uint32_t    level;
+            uint32_t    cx;
+            uint32_t    cy;
+        };
+        // each visit pops one and pushes up to 4
+        std::array<Node, 4 * 32> stack;
+        size_t stackN = 0;
+
+        stack[ stackN++ ] = { (uint32_t)mSizL2, 0, 0 };
+
+        while ( stackN )
+        {
+            c_auto node = stack[ --stackN ];
+
+            float tEnter;
+            if NOT( intersectCell( ray, ooDir, node.level, node.cx, node.cy,
+                                   std::min( ray.maxT, hit.t ), tEnter ) )
+                continue;
+
+            if ( node.level == 0 )
+            {
+                c_auto t = intersectQuad( ray, node.cx, node.cy );
+                if ( t < hit.t && t <= ray.maxT )
+                    hit = { t, node.cx, node.cy };
+                continue;
+            }
+
+            // children, the nearest on top of the stack
+            struct Child
+            {
+                Node    node;
+                float   tEnter;
+            };
+            Child children[4];
+            size_t childrenN = 0;
+            for (uint32_t i=0; i < 4; ++i)
+            {
+                c_auto child = Node{ node.level - 1, node.cx * 2 + (i & 1), node.cy * 2 + (i >> 1) };
+
+                float t;
+                if ( intersectCell( ray, ooDir, child.level, child.cx, child.cy,
+                                    std::min( ray.maxT, hit.t ), t ) )
+                    children[ childrenN++ ] = { child, t };
+            }
+
+            std::sort( children, children + childrenN, []( c_auto &l, c_auto &r )
+            {
+                return l.tEnter > r.tEnter;
+            });
+
+            for (size_t i=0; i < childrenN; ++i)
+                stack[ stackN++ ] = children[i].node;
+        }
+
+        return hit;
+    }
+
+    //==================================================================
+    // many rays, spread over threadsN threads (0 for all cores)
+    void CastRays( const Ray *pRays, size_t n, Hit *pOutHits, size_t threadsN=0 ) const
+    {
+        PF_ForRange( n, 64, [&]( size_t sta, size_t end )
+        {
+            for (size_t i=sta; i < end; ++i)
+                pOutHits[i] = CastRay( pRays[i] );
+        }, threadsN );
+    }
+
+private:
+    //==================================================================
+    // rebuilds the quads in [qx0, qx1) x [qy0, qy1) and their parents
+    void updateLevels( size_t qx0, size_t qy0, size_t qx1, size_t qy1, size_t threadsN )
+    {
+        c_auto sizL2 = mSizL2;
+        c_auto siz = (size_t)1 << sizL2;
+        c_auto pitch = mMap.GetPitch();
+
+        auto &lev0 = mLevels[0];
+        PF_ForRange( qy1 - qy0, 16, [&]( size_t sta, size_t end )
+        {
+            for (size_t y=qy0 + sta; y < qy0 + end; ++y)
+            {
+                for (size_t x=qx0; x < qx1; ++x)
+                {
+                    auto &mm = lev0[ (y << sizL2) + x ];
+                    if ( x == siz - 1 || y == siz - 1 )
+                    {
+                        mm = MinMax();
+                        continue;
+                    }
+
+                    c_auto *p = mMap.At( (ptrdiff_t)x, (ptrdiff_t)y );
+                    c_auto h00 = p[0];
+                    c_auto h01 = p[1];
+                    c_auto h10 = p[pitch];
+                    c_auto h11 = p[pitch + 1];
+                    mm.mi = std::min( std::min( h00, h01 ), std::min( h10, h11 ) );
+                    mm.ma = std::max( std::max( h00, h01 ), std::max( h10, h11 ) );
+                }
+            }
+        }, threadsN );
+
+        for (size_t l=1; l <= sizL2; ++l)
+        {
+            qx0 >>= 1;
+            qy0 >>= 1;
+            qx1 = (qx1 + 1) >> 1;
+            qy1 = (qy1 + 1) >> 1;
+
+            c_auto sideL2 = sizL2 - l;
+            c_auto &src = mLevels[l - 1];
+            auto &des = mLevels[l];
+
+            PF_ForRange( qy1 - qy0, 16, [&]( size_t sta, size_t end )
+            {
+                for (size_t y=qy0 + sta; y < qy0 + end; ++y)
+                {
+                    for (size_t x=qx0; x < qx1; ++x)
+                    {
+                        c_auto si = ((y * 2) << (sideL2 + 1)) + x * 2;
+                        c_auto &a = src[ si ];
+                        c_auto &b = src[ si + 1 ];
+                        c_auto &c = src[ si + ((size_t)1 << (sideL2 + 1)) ];
+                        c_auto &d = src[ si + ((size_t)1 << (sideL2 + 1)) + 1 ];
+
+                        auto &mm = des[ (y << sideL2) + x ];
+                        mm.mi = std::min( std::min( a.mi, b.mi ), std::min( c.mi, d.mi ) );
+                        mm.ma = std::max( std::max( a.ma, b.ma ), std::max( c.ma, d.ma ) );
+                    }
+                }
+            }, threadsN );
+        }
+    }
+
+    //==================================================================
+    // slabs test of the ray with the box of a cell, in [0, maxT]
+    bool intersectCell(
+            const Ray &ray,
+            const Float3 &ooDir,
+            uint32_t level,
+            uint32_t cx,
+            uint32_t cy,
+            float maxT,
+            float &out_tEnter ) const
+    {
+        c_auto &mm = mLevels[level][ ((size_t)cy << (mSizL2 - level)) + cx ];
+
+        // empty
+        if ( mm.mi > mm.ma )
+            return false;
+
+        c_auto bmin = Float3( (float)(cx << level),       mm.mi, (float)(cy << level) );
+        c_auto bmax = Float3( (float)((cx + 1) << level), mm.ma, (float)((cy + 1) << level) );
+
+        float tEnter = 0;
+        float tExit  = maxT;
+        for (int a=0; a < 3; ++a)
+        {
+            // parallel to the slab, in or out for good
+            if ( ray.dir[a] == 0 )
+            {
+                if ( ray.pos[a] < bmin[a] || ray.pos[a] > bmax[a] )
+                    return false;
+                continue;
+            }
+
+            c_auto t0 = (bmin[a] - ray.pos[a]) * ooDir[a];
+            c_auto t1 = (bmax[a] - ray.pos[a]) * ooDir[a];
+            tEnter = std::max( tEnter, std::min( t0, t1 ) );
+            tExit  = std::min( tExit,  std::max( t0, t1 ) );
+        }
+
+        out_tEnter = tEnter;
+        return tEnter <= tExit;
+    }
+
+    //==================================================================
+    // nearest hit with the 2 triangles of a quad, FLT_MAX for none
+    float intersectQuad( const Ray &ray, uint32_t x, uint32_t y ) const
+    {
+        c_auto pitch = mMap.GetPitch();
+        c_auto *p = mMap.At( (ptrdiff_t)x, (ptrdiff_t)y );
+
+        c_auto fx = (float)x;
+        c_auto fy = (float)y;
+        c_auto p00 = Float3( fx + 0, p[0],       fy + 0 );
+        c_auto p01 = Float3( fx + 1, p[1],       fy + 0 );
+        c_auto p10 = Float3( fx + 0, p[pitch],     fy + 1 );
+        c_auto p11 = Float3( fx + 1, p[pitch + 1], fy + 1 );
+
+        return std::min( intersectTri( ray, p01, p11, p00 ),
+                         intersectTri( ray, p11, p10, p00 ) );
+    }
+
+    //==================================================================
+    // Moller-Trumbore, both faces, FLT_MAX for no hit
+    static float intersectTri(
+            const Ray &ray, const Float3 &v0, const Float3 &v1, const Float3 &v2 )
+    {
+        c_auto e1 = v1 - v0;
+        c_auto e2 = v2 - v0;
+        c_auto pv = glm::cross( ray.dir, e2 );
+        c_auto det = glm::dot( e1, pv );
+
+        if ( std::abs( det ) < 1e-12f )
+            return FLT_MAX;
+
+        c_auto ooDet = 1.f / det;
+        c_auto tv = ray.pos - v0;
+        c_auto u = glm::dot( tv, pv ) * ooDet;
+        if ( u < 0 || u > 1 )
+            return FLT_MAX;
+
+        c_auto qv = glm::cross( tv, e1 );
+        c_auto v = glm::dot( ray.dir, qv ) * ooDet;
+        if ( v < 0 || u + v > 1 )
+            return FLT_MAX;
+
+        c_auto t = glm::dot( e2, qv ) * ooDet;
+        return t >= 0 ? t : FLT_MAX;
+    }
+};
+
+#endif
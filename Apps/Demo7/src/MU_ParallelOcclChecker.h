@@ -10,14 +10,31 @@
 #define MU_PARALLELOCCLCHECKER_H
 
 #include <cstdlib>
+#include <cassert>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define MU_OCCL_SSE
+#endif
 #include "DBase.h"
+#include "ParallelFor.h"
+#include "Map2D.h"
 
 //==================================================================
+/// Shadows of a square map of heights, with a side of a power of 2,
+/// that wraps around. The map is read by rows of its pitch, and must
+/// stay valid. The outputs are by (y << sizL2) + x
 class MU_ParallelOcclChecker
 {
 public:
-    const float *mpMap  {};
+    // queries marched together by IsOccludedAtPoints()
+    static constexpr size_t BATCH_LANES = 8;
+
+    const float *mpMap  {};     // texel (0, 0)
+    ptrdiff_t   mPitch  {};
     float       mMinY   {};
     float       mMaxY   {};
     size_t      mSizL2  {};
@@ -29,18 +46,26 @@ public:
     float       mD2n    {};
     float       mOo_d1n {};
 
+    // map index strides for the major and minor coordinates
+    ptrdiff_t   mStride0 {};
+    ptrdiff_t   mStride2 {};
+
     //==================================================================
     MU_ParallelOcclChecker(
-        const float *pMap,
+        const Map2DView<const float> &map,
         Float3 lightDirLS,
         float minY,
-        float maxY,
-        size_t sizL2 ) :
-            mpMap(pMap),
+        float maxY ) :
+            mpMap(map.Row( 0 )),
+            mPitch(map.GetPitch()),
             mMinY(minY),
             mMaxY(maxY),
-            mSizL2(sizL2)
+            mSizL2((size_t)std::countr_zero( map.GetW() ))
     {
+        assert( map.GetW() == map.GetH() && std::has_single_bit( map.GetW() ) );
+
+        c_auto sizL2 = mSizL2;
+
         // do we scan by x (0) or by z (2) ? Find the dominant axis
         if ( std::abs( lightDirLS[2] ) > std::abs( lightDirLS[0] ) )
         {
@@ -66,16 +91,20 @@ public:
         }
 
         mOo_d1n = (mD1n ? 1.f/mD1n : 0);
+
+        mStride0 = (mMajor == 0 ? 1 : mPitch);
+        mStride2 = (mMajor == 0 ? mPitch : 1);
     }
 
     //==================================================================
     bool IsOccludedAtPoint( int p0, int p2 ) const
     {
         c_auto sizL2 = mSizL2;
+        c_auto pitch = mPitch;
         c_auto *pMap = mpMap;
 
         // y value
-        c_auto p1 = pMap[ (p2 << sizL2) + p0 ];
+        c_auto p1 = pMap[ p2 * pitch + p0 ];
 
         if ( mMajor == 2 )
             std::swap( p0, p2 );
@@ -109,7 +138,7 @@ public:
 
                 c_auto i2_w = (int)i2 & coordMax;
                 c_auto i0_w = i0 & coordMax;
-                if ( pMap[ (i2_w << sizL2) + i0_w ] > i1 )
+                if ( pMap[ i2_w * pitch + i0_w ] > i1 )
                     return true;
             }
         }
@@ -124,13 +153,339 @@ public:
 
                 c_auto i2_w = (int)i2 & coordMax;
                 c_auto i0_w = i0 & coordMax;
-                if ( pMap[ (i0_w << sizL2) + i2_w ] > i1 )
+                if ( pMap[ i0_w * pitch + i2_w ] > i1 )
                     return true;
             }
         }
 
         return false;
     }
+
+    //==================================================================
+    /// Batched version of IsOccludedAtPoint(), with the same results.
+    /// Points are x,z map coordinates, pP1 optionally gives the heights,
+    /// otherwise the map's are used, so that points above the ground
+    /// can be checked too (i.e. objects placement).
+    /// BATCH_LANES rays are marched in lockstep, without branching on the
+    /// major axis, 4 lanes at a time with SSE2. The map reads stay 4
+    /// scalar loads, as SSE2 has no gather.
+    /// A lane that is done (occluded or out of steps) takes the next
+    /// query, so that lanes don't wait for the longest ray.
+    /// Large batches are split across threadsN threads (0 for all cores)
+    void IsOccludedAtPoints(
+                const int *pP0,
+                const int *pP2,
+                const float *pP1,
+                size_t n,
+                uint8_t *pOutIsOccl,
+                size_t threadsN=0 ) const
+    {
+        PF_ForRange( n, 4096, [&]( size_t sta, size_t end )
+        {
+            isOccludedAtPointsRange( sta, end - sta, pOutIsOccl + sta,
+                [&]( size_t qi, int &p0, int &p2, float &p1 )
+                {
+                    p0 = pP0[qi];
+                    p2 = pP2[qi];
+                    p1 = pP1 ? pP1[qi] : getMapY( p0, p2 );
+                } );
+        }, threadsN );
+    }
+
+    //==================================================================
+    /// IsOccludedAtPoint() for all the texels of the map, one byte per
+    /// texel (1 if occluded), as IsOccludedAtPoints() on the whole grid.
+    /// A march per texel, so O(N^3) for a map of N x N, it's the reference
+    /// for CalcAllOccludedApprox()
+    void CalcAllOccluded( uint8_t *pOutIsOccl, size_t threadsN=0 ) const
+    {
+        c_auto sizL2 = mSizL2;
+        c_auto coordMax = ((size_t)1 << sizL2) - 1;
+
+        PF_ForRange( (size_t)1 << (sizL2 * 2), 4096, [&]( size_t sta, size_t end )
+        {
+            isOccludedAtPointsRange( sta, end - sta, pOutIsOccl + sta,
+                [&]( size_t qi, int &p0, int &p2, float &p1 )
+                {
+                    p0 = (int)(qi & coordMax);
+                    p2 = (int)(qi >> sizL2);
+                    p1 = getMapY( p0, p2 );
+                } );
+        }, threadsN );
+    }
+
+    //==================================================================
+    /// An approximation of CalcAllOccluded(), in O(N^2) for a map of N x N,
+    /// that's what the terrain bake uses.
+    /// Instead of a march per texel, each scanline parallel to the light
+    /// is walked once, from the light side, keeping the max "horizon" of
+    /// the last (siz-1) steps with a sliding window. The stepping and the
+    /// wrap-around are the same, but a scanline keeps its fractional minor
+    /// coordinate and floors it, where a texel's own march starts from a
+    /// whole one, accumulates the steps and truncates. So the texels on
+    /// shadow edges can differ, up to a few percent of them.
+    void CalcAllOccludedApprox( uint8_t *pOutIsOccl, size_t threadsN=0 ) const
+    {
+        c_auto sizL2 = mSizL2;
+        c_auto pitch = mPitch;
+        c_auto *pMap = mpMap;
+
+        c_auto siz = (int)(1 << sizL2);
+        c_auto coordMax = siz - 1;
+
+        // steps to the light that a texel can see
+        c_auto winLen = siz - 1;
+        c_auto lastK  = (siz - 1) + winLen;
+
+        // scanlines are walked in blocks, in lockstep, so that the
+        // reads of a step are on neighboring texels.
+        // k goes toward the light, c is the minor coordinate at k = 0
+        constexpr int LINES_N = 16;
+
+        struct DQEntry
+        {
+            int     k;
+            float   g;
+        };
+
+        PF_ForRange( (size_t)siz, LINES_N, [&]( size_t c0, size_t c1 )
+        {
+            c_auto linesN = (int)(c1 - c0);
+
+            // sliding window max for each line, with the max at the head
+            std::vector<DQEntry> dques( (size_t)(lastK + 1) * LINES_N );
+            size_t dqHead[LINES_N] {};
+            size_t dqTail[LINES_N] {};
+
+            for (int k=lastK; k >= 0; --k)
+            {
+                c_auto i0 = (mD0n > 0 ? k : coordMax - k) & coordMax;
+                c_auto minorK = (float)k * mD2n;
+                c_auto rayK = (float)k * mD1n;
+
+                for (int li=0; li < linesN; ++li)
+                {
+                    c_auto c = (int)c0 + li;
+                    c_auto i2 = (int)floorf( (float)c + minorK ) & coordMax;
+
+                    c_auto x = mMajor == 0 ? i0 : i2;
+                    c_auto y = mMajor == 0 ? i2 : i0;
+
+                    // height relative to the light ray, so that rays from
+                    // different texels can be compared
+                    c_auto g = pMap[ y * pitch + x ] - rayK;
+
+                    auto *pDQ = &dques[ (size_t)li * (lastK + 1) ];
+                    auto &head = dqHead[li];
+                    auto &tail = dqTail[li];
+
+                    // drop what's beyond the reach of texel k
+                    while ( head != tail && pDQ[head].k > k + winLen )
+                        ++head;
+
+                    if ( k < siz )
+                        pOutIsOccl[ ((size_t)y << sizL2) + (size_t)x ] = (head != tail && pDQ[head].g > g) ? 1 : 0;
+
+                    // keep the window max at the head
+                    while ( head != tail && pDQ[tail-1].g <= g )
+                        --tail;
+
+                    pDQ[ tail++ ] = { k, g };
+                }
+            }
+        }, threadsN );
+    }
+
+private:
+    //==================================================================
+    float getMapY( int p0, int p2 ) const
+    {
+        c_auto coordMax = (int)(1 << mSizL2) - 1;
+        return mpMap[ (p2 & coordMax) * mPitch + (p0 & coordMax) ];
+    }
+
+    //==================================================================
+    // queries sta..sta+n-1, getPt( qi, p0, p2, p1 ) gives the point of
+    // query qi, the output is by qi - sta
+    template <typename GET_PT>
+    void isOccludedAtPointsRange(
+                size_t sta,
+                size_t n,
+                uint8_t *pOutIsOccl,
+                const GET_PT &getPt ) const
+    {
+        constexpr auto LN = BATCH_LANES;
+
+        c_auto *pMap = mpMap;
+
+        c_auto coordMax = (int32_t)(1 << mSizL2) - 1;
+
+        c_auto d0n = (int32_t)mD0n;
+        c_auto d1n = mD1n;
+        c_auto d2n = mD2n;
+
+        c_auto stride0 = mStride0;
+        c_auto stride2 = mStride2;
+
+        BatchLanes ln {};
+        size_t nextQuery = 0;
+
+        uint32_t activeMask = 0;
+        for (size_t l=0; l < LN; ++l)
+            if ( fillBatchLane( ln, l, nextQuery, sta, n, pOutIsOccl, getPt ) )
+                activeMask |= 1u << l;
+
+#if defined(MU_OCCL_SSE)
+        c_auto vD0n  = _mm_set1_epi32( d0n );
+        c_auto vD1n  = _mm_set1_ps( d1n );
+        c_auto vD2n  = _mm_set1_ps( d2n );
+        c_auto vOne  = _mm_set1_epi32( 1 );
+        c_auto vMask = _mm_set1_epi32( coordMax );
+#endif
+
+        while ( activeMask )
+        {
+            uint32_t occlMask = 0;
+            uint32_t doneMask = 0;
+
+            // one step for all lanes, idle lanes keep stepping harmlessly
+#if defined(MU_OCCL_SSE)
+            static_assert( LN % 4 == 0 );
+            for (size_t l=0; l < LN; l += 4)
+            {
+                auto *pI0 = (__m128i *)(ln.i0 + l);
+                auto *pSt = (__m128i *)(ln.stepsLeft + l);
+
+                c_auto i0 = _mm_add_epi32( _mm_loadu_si128( pI0 ), vD0n );
+                c_auto i1 = _mm_add_ps( _mm_loadu_ps( ln.i1 + l ), vD1n );
+                c_auto i2 = _mm_add_ps( _mm_loadu_ps( ln.i2 + l ), vD2n );
+                c_auto st = _mm_sub_epi32( _mm_loadu_si128( pSt ), vOne );
+
+                _mm_storeu_si128( pI0, i0 );
+                _mm_storeu_ps( ln.i1 + l, i1 );
+                _mm_storeu_ps( ln.i2 + l, i2 );
+                _mm_storeu_si128( pSt, st );
+
+                // truncated, as the scalar cast
+                c_auto i0_w = _mm_and_si128( i0, vMask );
+                c_auto i2_w = _mm_and_si128( _mm_cvttps_epi32( i2 ), vMask );
+
+                // SSE2 has no 32 bit multiply, the pitch is applied
+                // with the loads
+                alignas(16) int32_t w0[4];
+                alignas(16) int32_t w2[4];
+                _mm_store_si128( (__m128i *)w0, i0_w );
+                _mm_store_si128( (__m128i *)w2, i2_w );
+
+                auto ld = [&]( size_t j ) { return pMap[ w0[j] * stride0 + w2[j] * stride2 ]; };
+
+                c_auto h = _mm_setr_ps( ld( 0 ), ld( 1 ), ld( 2 ), ld( 3 ) );
+
+                c_auto occl = _mm_cmpgt_ps( h, i1 );
+                c_auto done = _mm_or_ps( occl, _mm_castsi128_ps( _mm_cmplt_epi32( st, vOne ) ) );
+
+                occlMask |= (uint32_t)_mm_movemask_ps( occl ) << l;
+                doneMask |= (uint32_t)_mm_movemask_ps( done ) << l;
+            }
+#else
+            for (size_t l=0; l < LN; ++l)
+            {
+                ln.i0[l] += d0n;
+                ln.i1[l] += d1n;
+                ln.i2[l] += d2n;
+                ln.stepsLeft[l] -= 1;
+
+                c_auto i0_w = ln.i0[l] & coordMax;
+                c_auto i2_w = (int32_t)ln.i2[l] & coordMax;
+
+                c_auto isOccl = pMap[ i0_w * stride0 + i2_w * stride2 ] > ln.i1[l];
+
+                occlMask |= (uint32_t)isOccl << l;
+                doneMask |= (uint32_t)(isOccl | (ln.stepsLeft[l] <= 0)) << l;
+            }
+#endif
+            doneMask &= activeMask;
+            if NOT( doneMask )
+                continue;
+
+            // output and refill the lanes that are done
+            for (size_t l=0; l < LN; ++l)
+            {
+                if NOT( doneMask & (1u << l) )
+                    continue;
+
+                pOutIsOccl[ ln.queryIdx[l] ] = (uint8_t)((occlMask >> l) & 1);
+
+                if NOT( fillBatchLane( ln, l, nextQuery, sta, n, pOutIsOccl, getPt ) )
+                    activeMask &= ~(1u << l);
+            }
+        }
+    }
+
+
+    struct BatchLanes
+    {
+        int32_t     i0[BATCH_LANES];
+        float       i1[BATCH_LANES];
+        float       i2[BATCH_LANES];
+        int32_t     stepsLeft[BATCH_LANES];
+        size_t      queryIdx[BATCH_LANES];
+    };
+
+    //==================================================================
+    // sets up the lane with the next query that needs marching,
+    // false if there are none left
+    template <typename GET_PT>
+    bool fillBatchLane(
+                BatchLanes &ln,
+                size_t l,
+                size_t &io_nextQuery,
+                size_t sta,
+                size_t n,
+                uint8_t *pOutIsOccl,
+                const GET_PT &getPt ) const
+    {
+        c_auto coordMax = (int)(1 << mSizL2) - 1;
+
+        for (; io_nextQuery < n; ++io_nextQuery)
+        {
+            c_auto qi = io_nextQuery;
+
+            int p0, p2;
+            float p1;
+            getPt( sta + qi, p0, p2, p1 );
+
+            p0 &= coordMax;
+            p2 &= coordMax;
+
+            if ( mMajor == 2 )
+                std::swap( p0, p2 );
+
+            // where the ray leaves the range of heights
+            auto q0 = p0 + mLen0;
+
+            c_auto q1 = p1 + mD1n * (float)mLen0;
+
+            if ( q1 > mMaxY ) q0 = p0 + (int)((mMaxY - p1) * mOo_d1n); else
+            if ( q1 < mMinY ) q0 = p0 + (int)((mMinY - p1) * mOo_d1n);
+
+            c_auto stepsN = mD0n > 0 ? q0 - p0 : p0 - q0;
+            if ( stepsN <= 0 )
+            {
+                pOutIsOccl[ qi ] = 0;
+                continue;
+            }
+
+            ln.i0[l] = p0;
+            ln.i1[l] = p1;
+            ln.i2[l] = (float)p2;
+            ln.stepsLeft[l] = stepsN;
+            ln.queryIdx[l] = qi;
+            ++io_nextQuery;
+            return true;
+        }
+        return false;
+    }
 };
 
 #endif
@@ -9,74 +9,130 @@
 #ifndef MU_WRAPMAP_H
 #define MU_WRAPMAP_H
 
+#include <assert.h>
+#include <vector>
+#include <type_traits>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define MU_WRAPMAP_SSE
+#endif
 #include "MathBase.h"
+#include "ParallelFor.h"
+#include "Map2D.h"
+
+//==================================================================
+// pA[e] = mix( pB[e], pA[e], t1 ), pB[e] = mix( pA[e], pB[e], t2 ),
+// for n elements. Floats go 4 at a time, with the same operations as
+// glm::mix(), so that the results are identical
+template <class _T>
+inline void mu_WrapBlendRows( _T *pA, _T *pB, size_t n, float t1, float t2 )
+{
+    size_t e = 0;
+#if defined(MU_WRAPMAP_SSE)
+    if constexpr ( std::is_same_v<_T,float> )
+    {
+        c_auto vt1  = _mm_set1_ps( t1 );
+        c_auto vt2  = _mm_set1_ps( t2 );
+        c_auto vot1 = _mm_set1_ps( 1 - t1 );
+        c_auto vot2 = _mm_set1_ps( 1 - t2 );
+
+        for (; (e + 4) <= n; e += 4)
+        {
+            c_auto a = _mm_loadu_ps( pA + e );
+            c_auto b = _mm_loadu_ps( pB + e );
+            _mm_storeu_ps( pA + e, _mm_add_ps( _mm_mul_ps( b, vot1 ), _mm_mul_ps( a, vt1 ) ) );
+            _mm_storeu_ps( pB + e, _mm_add_ps( _mm_mul_ps( a, vot2 ), _mm_mul_ps( b, vt2 ) ) );
+        }
+    }
+#endif
+    // what's left (or everything, for the other types)
+    for (; e < n; ++e)
+    {
+        c_auto a = pA[e];
+        c_auto b = pB[e];
+        pA[e] = (_T)glm::mix( b, a, t1 );
+        pB[e] = (_T)glm::mix( a, b, t2 );
+    }
+}
 
 //==================================================================
+/// Blends the opposite edges of the map over wrapHDim texels, so that
+/// it tiles. Rows first, then columns.
+/// Each pair of rows i and h-1-i (or of columns i and w-1-i) is
+/// independent of the others, so the pairs are spread over threadsN threads (0 for all
+/// cores). The columns are done a row at a time, blending its left
+/// strip with its mirrored right one, so that the memory is walked in
+/// order, as for the rows.
 template <class _T, size_t CHANS_N>
-void MU_WrapMap( _T *pMap, size_t dimL2, size_t wrapHDim )
+void MU_WrapMap( const Map2DView<_T,CHANS_N> &map, size_t wrapHDim, size_t threadsN=0 )
 {
-    assert( wrapHDim >= 1 && wrapHDim <= ((1U << dimL2)/2) );
+    c_auto w = map.GetW();
+    c_auto h = map.GetH();
+
+    assert( wrapHDim >= 1 && wrapHDim <= std::min( w, h ) / 2 );
 
     auto cosLerpCoe = []( float a )
     {
         return (1.0f - cosf(a * (float)M_PI)) * 0.5f;
     };
 
-    c_auto dim = 1 << dimL2;
-
-    for (int i=0; i < (int)wrapHDim; ++i)
+    // weights of the pair at i
+    std::vector<float> t1s( wrapHDim );
+    std::vector<float> t2s( wrapHDim );
+    for (size_t i=0; i < wrapHDim; ++i)
     {
-        c_auto t1 = cosLerpCoe( 0.5f + 0.5f * (float)i / wrapHDim );
-        c_auto t2 = cosLerpCoe( 0.5f + 0.5f * (float)(i+1) / (wrapHDim + 1) );
-
-        c_auto i1 = i;
-        c_auto i2 = dim-1 - i;
-
-        // rows
-        c_auto row1 = i1 << dimL2;
-        c_auto row2 = i2 << dimL2;
-        for (int j=0; j < dim; ++j)
-        {
-            c_auto j1 = j + row1;
-            c_auto j2 = j + row2;
-            for (int k=0; k < (int)CHANS_N; ++k)
-            {
-                c_auto jj1 = j1 * CHANS_N + k;
-                c_auto jj2 = j2 * CHANS_N + k;
-                c_auto val1 = pMap[ jj1 ];
-                c_auto val2 = pMap[ jj2 ];
-                pMap[ jj1 ] = (_T)glm::mix( val2, val1, t1 );
-                pMap[ jj2 ] = (_T)glm::mix( val1, val2, t2 );
-            }
-        }
+        t1s[i] = cosLerpCoe( 0.5f + 0.5f * (float)i / wrapHDim );
+        t2s[i] = cosLerpCoe( 0.5f + 0.5f * (float)(i+1) / (wrapHDim + 1) );
     }
 
-    for (int i=0; i < (int)wrapHDim; ++i)
+    // rows
+    PF_ForRange( wrapHDim, 1, [&]( size_t sta, size_t end )
     {
-        c_auto t1 = cosLerpCoe( 0.5f + 0.5f * (float)i / wrapHDim );
-        c_auto t2 = cosLerpCoe( 0.5f + 0.5f * (float)(i+1) / (wrapHDim + 1) );
-
-        c_auto i1 = i;
-        c_auto i2 = dim-1 - i;
+        for (size_t i=sta; i < end; ++i)
+            mu_WrapBlendRows(
+                    map.Row( i ),
+                    map.Row( h-1 - i ),
+                    w * CHANS_N,
+                    t1s[i],
+                    t2s[i] );
+    }, threadsN );
 
-        // cols
-        for (int j=0; j < dim; ++j)
+    // cols
+    PF_ForRange( h, 16, [&]( size_t sta, size_t end )
+    {
+        for (size_t j=sta; j < end; ++j)
         {
-            c_auto j1 = i1 + (j << dimL2);
-            c_auto j2 = i2 + (j << dimL2);
-            for (int k=0; k < (int)CHANS_N; ++k)
+            for (size_t i=0; i < wrapHDim; ++i)
             {
-                c_auto jj1 = j1 * CHANS_N + k;
-                c_auto jj2 = j2 * CHANS_N + k;
-                c_auto val1 = pMap[ jj1 ];
-                c_auto val2 = pMap[ jj2 ];
-                pMap[ jj1 ] = (_T)glm::mix( val2, val1, t1 );
-                pMap[ jj2 ] = (_T)glm::mix( val1, val2, t2 );
+                auto *p1 = map.At( i, j );
+                auto *p2 = map.At( w-1 - i, j );
+                c_auto t1 = t1s[i];
+                c_auto t2 = t2s[i];
+                for (size_t k=0; k < CHANS_N; ++k)
+                {
+                    c_auto val1 = p1[k];
+                    c_auto val2 = p2[k];
+                    p1[k] = (_T)glm::mix( val2, val1, t1 );
+                    p2[k] = (_T)glm::mix( val1, val2, t2 );
+                }
             }
         }
-    }
+    }, threadsN );
 }
 
+// for a plain square map of (1 << dimL2) texels per side
+template <class _T, size_t CHANS_N>
+void MU_WrapMap( _T *pMap, size_t dimL2, size_t wrapHDim, size_t threadsN=0 )
+{
+    c_auto dim = (size_t)1 << dimL2;
+    MU_WrapMap( Map2DView<_T,CHANS_N>( pMap, dim, dim, (ptrdiff_t)(dim * CHANS_N) ),
+                wrapHDim, threadsN );
+}
 
-#endif
+template <class _T, size_t CHANS_N>
+void MU_WrapMap( Map2D<_T,CHANS_N> &map, size_t wrapHDim, size_t threadsN=0 )
+{
+    MU_WrapMap( map.GetView(), wrapHDim, threadsN );
+}
 
+#endif
@@ -7,80 +7,246 @@
 //==================================================================
 
 #include <random>
+#include <array>
+#include <algorithm>
+#include <chrono>
 #include <assert.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define PLASMA2_SSE
+#endif
+#if defined(__SSE4_1__)
+# include <smmintrin.h>
+#endif
 #include "DBase.h"
 #include "MathBase.h"
+#include "ParallelFor.h"
 #include "Plasma2.h"
 
 //==================================================================
-class Rand2D
+// integer hash of 32 bits (the "lowbias32" mix), each bit of the input
+// flips about half of the output
+inline uint32_t hn_Mix( uint32_t h )
 {
-    size_t                  mMask   {};
-    size_t                  mNL2    {};
-    std::vector<uint16_t>   mV1;
-    std::vector<uint16_t>   mV2;
-
-public:
-    Rand2D( uint32_t seed, size_t nl2 )
-    {
-        c_auto n = (size_t)1 << nl2;
+    h ^= h >> 16;
+    h *= 0x7feb352dU;
+    h ^= h >> 15;
+    h *= 0x846ca68bU;
+    h ^= h >> 16;
+    return h;
+}
 
-        mNL2 = nl2;
-        mMask = n - 1;
+#if defined(PLASMA2_SSE)
+// 4 x 32 bit multiply, SSE2 only has the 64 bit one
+inline __m128i hn_MulLo32( __m128i a, __m128i b )
+{
+# if defined(__SSE4_1__)
+    return _mm_mullo_epi32( a, b );
+# else
+    c_auto even = _mm_mul_epu32( a, b );
+    c_auto odd  = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+    return _mm_unpacklo_epi32(
+                _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+                _mm_shuffle_epi32( odd,  _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+# endif
+}
 
-        std::default_random_engine rndGen( seed );
-        std::uniform_int_distribution<uint16_t> dist( 0 );
+inline __m128i hn_Mix( __m128i h )
+{
+    h = _mm_xor_si128( h, _mm_srli_epi32( h, 16 ) );
+    h = hn_MulLo32( h, _mm_set1_epi32( (int)0x7feb352dU ) );
+    h = _mm_xor_si128( h, _mm_srli_epi32( h, 15 ) );
+    h = hn_MulLo32( h, _mm_set1_epi32( (int)0x846ca68bU ) );
+    h = _mm_xor_si128( h, _mm_srli_epi32( h, 16 ) );
+    return h;
+}
+#endif
 
-        mV1.resize( n );
-        mV2.resize( n );
+//==================================================================
+/// Values in 0..1 at the points of an integer lattice, from a hash of
+/// the coordinates, the seed and the octave. There are no tables, so
+/// nothing repeats until the coordinates wrap at 2^32, and it's the
+/// same at any world position.
+/// The row goes in the hash first, so that a row of values is one mix
+/// per value, 4 at a time in SIMD, with the same results as GetVal()
+class HashNoise2D
+{
+    uint32_t    mSeed {};
 
-        for (size_t i=0; i < n; ++i)
-            mV1[i] = dist( rndGen );
+public:
+    HashNoise2D( uint32_t seed, size_t octave )
+        : mSeed( hn_Mix( seed ^ hn_Mix( (uint32_t)octave + 0x9e3779b9U ) ) )
+    {}
 
-        for (size_t i=0; i < n; ++i)
-            mV2[i] = dist( rndGen );
+    float GetVal( int64_t y, int64_t x ) const
+    {
+        c_auto h = hn_Mix( (uint32_t)x ^ rowSeed( y ) );
+        return (float)(h >> 16) * (1.f/65535);
     }
 
-
-    float GetVal( size_t y, size_t x ) const
+    //==================================================================
+    // pOut[i] (+)= GetVal( y, x0 + i * xStep ) * sca, for i in [0, n)
+    template <bool ADD>
+    void EvalRow(
+            float *pOut,
+            int64_t y,
+            int64_t x0,
+            size_t xStep,
+            size_t n,
+            float sca,
+            bool useSIMD ) const
     {
-        c_auto v2 = (uint32_t)mV2[y & mMask];
-        c_auto v1 = (uint32_t)mV1[(x+v2) & mMask];
+        c_auto rs = rowSeed( y );
+        auto x = (uint32_t)x0;
+        c_auto step = (uint32_t)xStep;
 
-        c_auto vv = v1 ^ v2;
+        size_t i = 0;
+#if defined(PLASMA2_SSE)
+        if ( useSIMD && n >= 4 )
+        {
+            c_auto vrs   = _mm_set1_epi32( (int)rs );
+            c_auto vstp4 = _mm_set1_epi32( (int)(step * 4) );
+            c_auto vnorm = _mm_set1_ps( 1.f/65535 );
+            c_auto vsca  = _mm_set1_ps( sca );
+
+            auto vx = _mm_add_epi32( _mm_set1_epi32( (int)x ),
+                            _mm_setr_epi32( 0, (int)step, (int)(step * 2), (int)(step * 3) ) );
+
+            for (; (i + 4) <= n; i += 4)
+            {
+                c_auto h = hn_Mix( _mm_xor_si128( vx, vrs ) );
+
+                // < 65536, so the conversion is exact, as for the scalar
+                c_auto v = _mm_mul_ps( _mm_mul_ps(
+                                _mm_cvtepi32_ps( _mm_srli_epi32( h, 16 ) ), vnorm ), vsca );
+
+                if constexpr ( ADD )
+                    _mm_storeu_ps( pOut + i, _mm_add_ps( _mm_loadu_ps( pOut + i ), v ) );
+                else
+                    _mm_storeu_ps( pOut + i, v );
 
-        return (vv & 65535) * (1.f/65535);
+                vx = _mm_add_epi32( vx, vstp4 );
+            }
 
-        //uint32_t v1h = v1l >> (13 + ((y >> (mNL2-2)) & 3));
-        //uint32_t v2h = v2l >> (13 + ((x >> (mNL2-2)) & 3));
+            x += step * (uint32_t)i;
+        }
+#else
+        (void)useSIMD;
+#endif
+        for (; i < n; ++i, x += step)
+        {
+            c_auto v = (float)(hn_Mix( x ^ rs ) >> 16) * (1.f/65535) * sca;
 
-        //return ((v1l+v1h+v2l+v2h) & 65535) * (1.f/65535);
+            if constexpr ( ADD )
+                pOut[i] += v;
+            else
+                pOut[i] = v;
+        }
     }
+
+private:
+    uint32_t rowSeed( int64_t y ) const { return hn_Mix( (uint32_t)y + mSeed ); }
 };
 
 //==================================================================
-static float _gsCosIntpl2Data[1024];
+static constexpr size_t COSINTPL2_MAX_L2 = 16;
 
-static void CosIntpl2Setup( size_t siz )
+// cosine interpolation weights, one table per power-of-two size.
+// Built once and read-only after, so that blocks can run in parallel
+static const float *getCosIntpl2Table( size_t sizL2 )
 {
-    assert( siz <= std::size(_gsCosIntpl2Data) );
-    c_auto angStep = FM_PI / siz;
-    for (size_t i=0; i < siz; ++i)
+    assert( sizL2 <= COSINTPL2_MAX_L2 );
+
+    static const auto sTables = []()
     {
-        c_auto angle = i * angStep;
-        _gsCosIntpl2Data[i] = (1.0f - cosf(angle)) * 0.5f;
-    }
+        std::array<std::vector<float>,COSINTPL2_MAX_L2+1> tables;
+        for (size_t l2=0; l2 <= COSINTPL2_MAX_L2; ++l2)
+        {
+            c_auto siz = (size_t)1 << l2;
+            auto &tab = tables[l2];
+            tab.resize( siz );
+
+            c_auto angStep = FM_PI / siz;
+            for (size_t i=0; i < siz; ++i)
+            {
+                c_auto angle = i * angStep;
+                tab[i] = (1.0f - cosf(angle)) * 0.5f;
+            }
+        }
+        return tables;
+    }();
+
+    return sTables[ sizL2 ].data();
 }
 
 //==================================================================
-inline float CosIntpl2(float v1, float v2, size_t idx)
+inline float CosIntpl2(float v1, float v2, const float *pCosTab, size_t idx)
 {
     auto dlerp = []( c_auto &l, c_auto &r, c_auto t )
     {
         return l * (1 - t) + r * t;
     };
 
-    return dlerp( v1, v2, _gsCosIntpl2Data[ idx ] );
+    return dlerp( v1, v2, pCosTab[ idx ] );
+}
+
+//==================================================================
+// a row of pDst[x] = CosIntpl2( l, r, pCosTab, x ), or += with DO_ADD
+template <bool DO_ADD>
+inline void rowCosIntpl2_Scalar( float *pDst, float l, float r, const float *pCosTab, size_t n )
+{
+    for (size_t x=0; x < n; ++x)
+    {
+        if constexpr ( DO_ADD )
+            pDst[x] += CosIntpl2( l, r, pCosTab, x );
+        else
+            pDst[x]  = CosIntpl2( l, r, pCosTab, x );
+    }
+}
+
+//==================================================================
+// same as the scalar version, 8 pixels at a time. Same operations in
+// the same order, so that the results are identical
+template <bool DO_ADD>
+inline void rowCosIntpl2_SIMD( float *pDst, float l, float r, const float *pCosTab, size_t n )
+{
+    size_t x = 0;
+#if defined(PLASMA2_SSE)
+    c_auto vl   = _mm_set1_ps( l );
+    c_auto vr   = _mm_set1_ps( r );
+    c_auto vone = _mm_set1_ps( 1.f );
+
+    auto lerp4 = [&]( const float *pT )
+    {
+        c_auto t = _mm_loadu_ps( pT );
+        return _mm_add_ps( _mm_mul_ps( vl, _mm_sub_ps( vone, t ) ), _mm_mul_ps( vr, t ) );
+    };
+
+    for (; (x+8) <= n; x += 8)
+    {
+        auto a = lerp4( pCosTab + x + 0 );
+        auto b = lerp4( pCosTab + x + 4 );
+        if constexpr ( DO_ADD )
+        {
+            a = _mm_add_ps( _mm_loadu_ps( pDst + x + 0 ), a );
+            b = _mm_add_ps( _mm_loadu_ps( pDst + x + 4 ), b );
+        }
+        _mm_storeu_ps( pDst + x + 0, a );
+        _mm_storeu_ps( pDst + x + 4, b );
+    }
+#endif
+    // what's left (or everything, without SIMD)
+    rowCosIntpl2_Scalar<DO_ADD>( pDst + x, l, r, pCosTab + x, n - x );
+}
+
+//==================================================================
+template <bool DO_ADD>
+inline void rowCosIntpl2( bool useSIMD, float *pDst, float l, float r, const float *pCosTab, size_t n )
+{
+    if ( useSIMD )
+        rowCosIntpl2_SIMD<DO_ADD>( pDst, l, r, pCosTab, n );
+    else
+        rowCosIntpl2_Scalar<DO_ADD>( pDst, l, r, pCosTab, n );
 }
 
 //==================================================================
@@ -92,16 +258,34 @@ inline float CosInterpolate(float v1, float v2, float a)
 }
 
 //==================================================================
+// [ya, yb) of the rows [ry0, ry1) that fall in the cell that starts at
+// row cy0, false if none
+inline bool getCellRows( size_t cy0, size_t cellSiz, size_t ry0, size_t ry1, size_t &ya, size_t &yb )
+{
+    ya = std::max( ry0, cy0 ) - cy0;
+    yb = std::min( ry1, cy0 + cellSiz );
+    if ( yb <= cy0 + ya )
+        return false;
+
+    yb -= cy0;
+    return true;
+}
+
+//==================================================================
+// only the rows [ry0, ry1) of the destination block
 static void blitStretch(
                 float *pDest,
                 size_t dstSizL2,
-                size_t dstPitchL2,
+                size_t dstPitch,
+                size_t ry0,
+                size_t ry1,
                 float scaLev,
                 const float *pSrc,
                 size_t srcSizL2,
                 size_t srcPitchL2,
                 size_t sx0,
-                size_t sy0
+                size_t sy0,
+                bool useSIMD
                 )
 {
     c_auto srcSiz = (size_t)1 << srcSizL2;
@@ -109,9 +293,7 @@ static void blitStretch(
     c_auto dsubSizL2 = (dstSizL2 - srcSizL2);
     c_auto dsubSiz = (size_t)1 << dsubSizL2;
 
-    c_auto dsubPitchL2 = (dstPitchL2 - srcPitchL2);
-
-    CosIntpl2Setup( dsubSiz );
+    c_auto *pCosTab = getCosIntpl2Table( dsubSizL2 );
 
     c_auto sx1 = sx0 + srcSiz;
     c_auto sy1 = sy0 + srcSiz;
@@ -120,8 +302,12 @@ static void blitStretch(
         c_auto siy0 = (sy+0) + ((sy+0) << srcPitchL2);
         c_auto siy1 = (sy+1) + ((sy+1) << srcPitchL2);
 
+        size_t ya, yb;
+        if NOT( getCellRows( (sy - sy0) << dsubSizL2, dsubSiz, ry0, ry1, ya, yb ) )
+            continue;
+
         //assert( ((sy+0) << dsubSizL2) <= 2047 );
-        c_auto diy0 = (sy+0) << (dsubPitchL2 + dstPitchL2);
+        c_auto diy0 = (((sy+0) << dsubSizL2) + ya) * dstPitch;
 
         for (size_t sx=sx0; sx < sx1; ++sx)
         {
@@ -134,78 +320,102 @@ static void blitStretch(
 
             auto *pDstRowSub = pDest + di00;
 
-            for (size_t y=0; y < dsubSiz; ++y)
+            for (size_t y=ya; y < yb; ++y)
             {
-                c_auto sv0 = CosIntpl2( sv00, sv10, y );
-                c_auto sv1 = CosIntpl2( sv01, sv11, y );
-                for (size_t x=0; x < dsubSiz; ++x)
-                {
-                    pDstRowSub[x] = CosIntpl2( sv0, sv1, x );
-                }
+                c_auto sv0 = CosIntpl2( sv00, sv10, pCosTab, y );
+                c_auto sv1 = CosIntpl2( sv01, sv11, pCosTab, y );
+
+                rowCosIntpl2<false>( useSIMD, pDstRowSub, sv0, sv1, pCosTab, dsubSiz );
 
-                pDstRowSub += (size_t)1 << dstPitchL2;
+                pDstRowSub += dstPitch;
             }
         }
     }
 }
 
 //==================================================================
+// only the rows [ry0, ry1) of the destination block
 static void randomBlitStretchPool(
                 float *pDest,
                 size_t dstSizL2,
-                size_t dstPitchL2,
+                size_t dstPitch,
                 size_t dx0,
                 size_t dy0,
+                size_t ry0,
+                size_t ry1,
                 float scaLev,
                 size_t srcSizL2,
-                const Rand2D &randPool
+                const HashNoise2D &noise,
+                bool useSIMD
                 )
 {
     c_auto srcSiz = (size_t)1 << srcSizL2;
 
-    c_auto desIdxBase = (dy0 << dstPitchL2) + dx0;
+    c_auto desIdxBase = dy0 * dstPitch + dx0;
 
     // optimize the 2 main special cases
     if ( dstSizL2 == srcSizL2 )
     {
-        assert( srcSiz >= 4 );
-
-        for (size_t sy=0; sy < srcSiz; ++sy)
+        for (size_t sy=ry0; sy < ry1; ++sy)
         {
-              auto di = desIdxBase + (sy << dstPitchL2);
-            c_auto dy = dy0 + sy;
-            for (size_t sx=dx0; sx < srcSiz; sx += 4, di += 4)
-            {
-                pDest[di+0] += randPool.GetVal(dy,sx+0) * scaLev;
-                pDest[di+1] += randPool.GetVal(dy,sx+1) * scaLev;
-                pDest[di+2] += randPool.GetVal(dy,sx+2) * scaLev;
-                pDest[di+3] += randPool.GetVal(dy,sx+3) * scaLev;
-            }
+            noise.EvalRow<true>(
+                    pDest + desIdxBase + sy * dstPitch,
+                    (int64_t)(dy0 + sy),
+                    (int64_t)dx0,
+                    1,
+                    srcSiz,
+                    scaLev,
+                    useSIMD );
         }
 
         return;
     }
-    else
-    if ( dstSizL2 == (srcSizL2+1) )
+
+    c_auto dsubSizL2 = (dstSizL2 - srcSizL2);
+    c_auto dsubSiz = (size_t)1 << dsubSizL2;
+
+    // the lattice values at the top and bottom of a row of cells,
+    // sampled every dsubSiz texels
+    std::vector<float> latTop( srcSiz + 1 );
+    std::vector<float> latBot( srcSiz + 1 );
+
+    auto evalLatRow = [&]( std::vector<float> &lat, size_t sy )
     {
-        c_auto dsubSizL2 = (size_t)1;
+        noise.EvalRow<false>(
+                lat.data(),
+                (int64_t)(dy0 + (sy << dsubSizL2)),
+                (int64_t)dx0,
+                dsubSiz,
+                srcSiz + 1,
+                scaLev,
+                useSIMD );
+    };
+
+    // the rows of cells over [ry0, ry1)
+    c_auto sy0 = ry0 >> dsubSizL2;
+    c_auto sy1 = ((ry1 - 1) >> dsubSizL2) + 1;
+
+    evalLatRow( latBot, sy0 );
 
-        for (size_t sy=0; sy < srcSiz; ++sy)
+    if ( dstSizL2 == (srcSizL2+1) )
+    {
+        for (size_t sy=sy0; sy < sy1; ++sy)
         {
-            c_auto diy0 = desIdxBase + ((sy+0) << (dsubSizL2 + dstPitchL2));
+            std::swap( latTop, latBot );
+            evalLatRow( latBot, sy + 1 );
 
-            auto sv00 = randPool.GetVal(dy0+((sy+0)<<dsubSizL2), dx0) * scaLev;
-            auto sv10 = randPool.GetVal(dy0+((sy+1)<<dsubSizL2), dx0) * scaLev;
+            c_auto diy0 = desIdxBase + ((sy+0) << dsubSizL2) * dstPitch;
 
-            c_auto dya = dy0 + ((sy+0)<<dsubSizL2);
-            c_auto dyb = dy0 + ((sy+1)<<dsubSizL2);
+            // the 2 rows of the cells, when in range
+            c_auto doRow0 = (sy << 1) + 0 >= ry0;
+            c_auto doRow1 = (sy << 1) + 1 < ry1;
 
             for (size_t sx=0; sx < srcSiz; ++sx)
             {
-                c_auto dxb = dx0 + ((sx+1)<<dsubSizL2);
-
-                c_auto sv01 = randPool.GetVal( dya, dxb ) * scaLev;
-                c_auto sv11 = randPool.GetVal( dyb, dxb ) * scaLev;
+                c_auto sv00 = latTop[sx+0];
+                c_auto sv01 = latTop[sx+1];
+                c_auto sv10 = latBot[sx+0];
+                c_auto sv11 = latBot[sx+1];
 
                 c_auto di00 = diy0 + (sx<<dsubSizL2);
 
@@ -216,62 +426,57 @@ static void randomBlitStretchPool(
                 c_auto sv1_l = (sv00+sv10) * 0.5f;
                 c_auto sv1_r = (sv01+sv11) * 0.5f;
 
-                pDstRowSub[0] += sv0_l;
-                pDstRowSub[1] += (sv0_l + sv0_r) * 0.5f;
-
-                pDstRowSub  += (size_t)1 << dstPitchL2;
+                if ( doRow0 )
+                {
+                    pDstRowSub[0] += sv0_l;
+                    pDstRowSub[1] += (sv0_l + sv0_r) * 0.5f;
+                }
 
-                pDstRowSub[0] += sv1_l;
-                pDstRowSub[1] += (sv1_l + sv1_r) * 0.5f;
+                pDstRowSub  += dstPitch;
 
-                sv00 = sv01;
-                sv10 = sv11;
+                if ( doRow1 )
+                {
+                    pDstRowSub[0] += sv1_l;
+                    pDstRowSub[1] += (sv1_l + sv1_r) * 0.5f;
+                }
             }
         }
 
         return;
     }
 
-    c_auto dsubSizL2 = (dstSizL2 - srcSizL2);
-    c_auto dsubSiz = (size_t)1 << dsubSizL2;
-
-    CosIntpl2Setup( dsubSiz );
+    c_auto *pCosTab = getCosIntpl2Table( dsubSizL2 );
 
-    for (size_t sy=0; sy < srcSiz; ++sy)
+    for (size_t sy=sy0; sy < sy1; ++sy)
     {
-        c_auto diy0 = desIdxBase + ((sy+0) << (dsubSizL2 + dstPitchL2));
+        std::swap( latTop, latBot );
+        evalLatRow( latBot, sy + 1 );
 
-        auto sv00 = randPool.GetVal(dy0+((sy+0)<<dsubSizL2), dx0) * scaLev;
-        auto sv10 = randPool.GetVal(dy0+((sy+1)<<dsubSizL2), dx0) * scaLev;
+        size_t ya, yb;
+        getCellRows( sy << dsubSizL2, dsubSiz, ry0, ry1, ya, yb );
 
-        c_auto dya = dy0 + ((sy+0)<<dsubSizL2);
-        c_auto dyb = dy0 + ((sy+1)<<dsubSizL2);
+        c_auto diy0 = desIdxBase + ((sy << dsubSizL2) + ya) * dstPitch;
 
         for (size_t sx=0; sx < srcSiz; ++sx)
         {
-            c_auto dxb = dx0 + ((sx+1)<<dsubSizL2);
-
-            c_auto sv01 = randPool.GetVal( dya, dxb ) * scaLev;
-            c_auto sv11 = randPool.GetVal( dyb, dxb ) * scaLev;
+            c_auto sv00 = latTop[sx+0];
+            c_auto sv01 = latTop[sx+1];
+            c_auto sv10 = latBot[sx+0];
+            c_auto sv11 = latBot[sx+1];
 
             c_auto di00 = diy0 + (sx<<dsubSizL2);
 
             auto *pDstRowSub = pDest + di00;
 
-            for (size_t y=0; y < dsubSiz; ++y)
+            for (size_t y=ya; y < yb; ++y)
             {
-                c_auto sv0 = CosIntpl2( sv00, sv10, y );
-                c_auto sv1 = CosIntpl2( sv01, sv11, y );
-                for (size_t x=0; x < dsubSiz; ++x)
-                {
-                    pDstRowSub[x] += CosIntpl2( sv0, sv1, x );
-                }
+                c_auto sv0 = CosIntpl2( sv00, sv10, pCosTab, y );
+                c_auto sv1 = CosIntpl2( sv01, sv11, pCosTab, y );
 
-                pDstRowSub  += (size_t)1 << dstPitchL2;
-            }
+                rowCosIntpl2<true>( useSIMD, pDstRowSub, sv0, sv1, pCosTab, dsubSiz );
 
-            sv00 = sv01;
-            sv10 = sv11;
+                pDstRowSub  += dstPitch;
+            }
         }
     }
 }
@@ -279,7 +484,6 @@ static void randomBlitStretchPool(
 //==================================================================
 Plasma2::Plasma2( Params &par )
     : mPar(par)
-    , mGen_oRandPool( std::make_unique<Rand2D>( par.seed, 10 ) )
     , BLOCKS_NL2(par.baseSizL2)
 {
     c_auto baseGridSiz = ((size_t)1 << mPar.baseSizL2) + 1;
@@ -299,42 +503,128 @@ Plasma2::Plasma2( Params &par )
 Plasma2::~Plasma2() = default;
 
 //==================================================================
-void Plasma2::RendBlock( size_t ix, size_t iy )
+void Plasma2::rendBlockOctave( size_t ix, size_t iy, size_t ry0, size_t ry1, size_t d, float scaLev )
 {
     c_auto blockDim = mPar.sizL2 - BLOCKS_NL2;
 
-    auto scaLev = mPar.sca;
+    // octave 0 is the base grid, the others add noise at finer scales
+    if ( d == 0 )
+    {
+        blitStretch(
+            mPar.pDest,
+            blockDim,
+            GetDestPitch( mPar ),
+            ry0,
+            ry1,
+            scaLev,
+            mBaseGrid.data(),
+            0,
+            mPar.baseSizL2,
+            ix,
+            iy,
+            mPar.useSIMD );
+        return;
+    }
 
-    blitStretch(
+    c_auto dx0 = (size_t)ix << (mPar.sizL2 - BLOCKS_NL2);
+    c_auto dy0 = (size_t)iy << (mPar.sizL2 - BLOCKS_NL2);
+
+    randomBlitStretchPool(
         mPar.pDest,
         blockDim,
-        mPar.sizL2,
+        GetDestPitch( mPar ),
+        dx0,
+        dy0,
+        ry0,
+        ry1,
         scaLev,
-        mBaseGrid.data(),
-        0,
-        mPar.baseSizL2,
-        ix,
-        iy );
+        d,
+        HashNoise2D( mPar.seed, d ),
+        mPar.useSIMD );
+}
 
-    c_auto dx0 = (size_t)ix << (mPar.sizL2 - BLOCKS_NL2);
-    c_auto dy0 = (size_t)iy << (mPar.sizL2 - BLOCKS_NL2);
+//==================================================================
+// all the octaves of the rows [ry0, ry1) of a block. A texel gets the
+// same operations, in the same order, whatever the rows
+void Plasma2::rendBlockRows( size_t ix, size_t iy, size_t ry0, size_t ry1 )
+{
+    auto scaLev = mPar.sca;
+
+    rendBlockOctave( ix, iy, ry0, ry1, 0, scaLev );
 
     for (size_t d=1; d <= (mPar.sizL2-BLOCKS_NL2); ++d)
     {
         scaLev *= mPar.rough;
 
-        randomBlitStretchPool(
-            mPar.pDest,
-            blockDim,
-            mPar.sizL2,
-            dx0,
-            dy0,
-            scaLev,
-            d,
-            *mGen_oRandPool );
+        rendBlockOctave( ix, iy, ry0, ry1, d, scaLev );
     }
 }
 
+//==================================================================
+void Plasma2::RendBlock( size_t ix, size_t iy )
+{
+    rendBlockRows( ix, iy, 0, (size_t)1 << GetBlockSizL2() );
+}
+
+//==================================================================
+// bands of rows per block (log2), for a few jobs per thread when the
+// blocks are few, with bands of at least 1 << PLASMA2_MIN_BAND_ROWS_L2 rows
+size_t Plasma2::calcBandsL2( size_t blocksN, size_t threadsN ) const
+{
+    if NOT( threadsN )
+        threadsN = PF_GetThreadsN();
+
+    size_t bandsL2 = 0;
+    while ( (blocksN << bandsL2) < threadsN * 4 &&
+            (GetBlockSizL2() - bandsL2) > PLASMA2_MIN_BAND_ROWS_L2 )
+        ++bandsL2;
+
+    return bandsL2;
+}
+
+//==================================================================
+void Plasma2::GenerateParallel( size_t threadsN )
+{
+    c_auto n = (size_t)1 << BLOCKS_NL2;
+
+    RendBlocks( 0, n * n, threadsN );
+
+    // nothing left for the iterators
+    mGen_IterIX = n - 1;
+    mGen_IterIY = n;
+}
+
+//==================================================================
+void Plasma2::RendBlocks( size_t sta, size_t end, size_t threadsN )
+{
+    c_auto bandsL2 = calcBandsL2( end - sta, threadsN );
+    c_auto bandRowsL2 = GetBlockSizL2() - bandsL2;
+
+    // blocks and bands write to separate areas, so they can go in any order
+    PF_RunJobs( (end - sta) << bandsL2, [&]( size_t i )
+    {
+        c_auto bi = sta + (i >> bandsL2);
+        c_auto ry0 = (i & (((size_t)1 << bandsL2) - 1)) << bandRowsL2;
+
+        rendBlockRows(
+            bi & (((size_t)1 << BLOCKS_NL2) - 1),
+            bi >> BLOCKS_NL2,
+            ry0,
+            ry0 + ((size_t)1 << bandRowsL2) );
+    }, threadsN );
+}
+
+//==================================================================
+float Plasma2::CalcMaxVal() const
+{
+    float sum = 0;
+    auto scaLev = mPar.sca;
+    for (size_t d=0; d <= (mPar.sizL2-BLOCKS_NL2); ++d, scaLev *= mPar.rough)
+        sum += scaLev;
+
+    return sum;
+}
+
 //==================================================================
 bool Plasma2::IterateBlock()
 {
@@ -380,3 +670,128 @@ bool Plasma2::IterateRow()
     return true;
 }
 
+
+//==================================================================
+void Plasma2::GenerateTile( const TileParams &par )
+{
+    assert( par.topCellL2 <= COSINTPL2_MAX_L2 );
+
+    c_auto siz = (size_t)1 << par.sizL2;
+    c_auto pitch = GetDestPitch( par );
+
+    for (size_t y=0; y < siz; ++y)
+        std::fill_n( par.pDest + y * pitch, siz, 0.f );
+
+    // the lattice values of the cells over a row of the tile, at the top
+    // and bottom of the cells
+    std::vector<float> latTop;
+    std::vector<float> latBot;
+
+    auto scaLev = par.sca;
+    for (size_t d=0; d <= par.topCellL2; ++d, scaLev *= par.rough)
+    {
+        c_auto cellL2 = par.topCellL2 - d;
+        c_auto cellSiz = (size_t)1 << cellL2;
+        c_auto cellMask = (int64_t)cellSiz - 1;
+
+        c_auto *pCosTab = getCosIntpl2Table( cellL2 );
+
+        // each octave has its own lattice values, picked by world lattice
+        // coordinates, so that they don't repeat across the world
+        const HashNoise2D noise( par.seed, d );
+
+        // >> floors also the negative coordinates
+        c_auto lx0 = par.x0 >> cellL2;
+        c_auto latN = (size_t)(((par.x0 + (int64_t)siz - 1) >> cellL2) - lx0) + 2;
+        latTop.resize( latN );
+        latBot.resize( latN );
+
+        int64_t lastLY = INT64_MIN;
+
+        for (size_t y=0; y < siz; ++y)
+        {
+            c_auto wy = par.y0 + (int64_t)y;
+            c_auto ly = wy >> cellL2;
+            c_auto ty = (size_t)(wy & cellMask);
+
+            // a new row of cells
+            if ( ly != lastLY )
+            {
+                lastLY = ly;
+                noise.EvalRow<false>( latTop.data(), ly+0, lx0, 1, latN, scaLev, par.useSIMD );
+                noise.EvalRow<false>( latBot.data(), ly+1, lx0, 1, latN, scaLev, par.useSIMD );
+            }
+
+            auto *pRow = par.pDest + y * pitch;
+
+            // the spans of the row that fall in the same cell
+            for (size_t x=0; x < siz;)
+            {
+                c_auto wx = par.x0 + (int64_t)x;
+                c_auto lx = wx >> cellL2;
+                c_auto tx = (size_t)(wx & cellMask);
+                c_auto n = std::min( cellSiz - tx, siz - x );
+
+                c_auto li = (size_t)(lx - lx0);
+                c_auto l = CosIntpl2( latTop[li+0], latBot[li+0], pCosTab, ty );
+                c_auto r = CosIntpl2( latTop[li+1], latBot[li+1], pCosTab, ty );
+
+                rowCosIntpl2<true>( par.useSIMD, pRow + x, l, r, pCosTab + tx, n );
+
+                x += n;
+            }
+        }
+    }
+}
+
+//==================================================================
+float Plasma2::CalcTileMaxVal( const TileParams &par )
+{
+    float sum = 0;
+    auto scaLev = par.sca;
+    for (size_t d=0; d <= par.topCellL2; ++d, scaLev *= par.rough)
+        sum += scaLev;
+
+    return sum;
+}
+
+//==================================================================
+std::vector<double> Plasma2::BenchmarkOctaves( Params par, size_t repsN )
+{
+    std::vector<float> dest( (size_t)1 << (par.sizL2 * 2) );
+    par.pDest = dest.data();
+    par.destPitch = 0;
+
+    Plasma2 plasma( par );
+
+    c_auto n = (size_t)1 << plasma.BLOCKS_NL2;
+
+    auto getTimeS = []()
+    {
+        return
+            (double)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count() * 1e-6;
+    };
+
+    std::vector<double> mpixPerS;
+
+    auto scaLev = par.sca;
+    for (size_t d=0; d <= (par.sizL2 - plasma.BLOCKS_NL2); ++d)
+    {
+        if ( d )
+            scaLev *= par.rough;
+
+        c_auto t0 = getTimeS();
+        for (size_t r=0; r < repsN; ++r)
+            for (size_t iy=0; iy < n; ++iy)
+                for (size_t ix=0; ix < n; ++ix)
+                    plasma.rendBlockOctave( ix, iy, 0, (size_t)1 << plasma.GetBlockSizL2(), d, scaLev );
+
+        c_auto elapsedS = std::max( getTimeS() - t0, 1e-6 );
+
+        // every octave covers the whole map
+        mpixPerS.push_back( (double)dest.size() * (double)repsN / elapsedS * 1e-6 );
+    }
+
+    return mpixPerS;
+}
@@ -10,9 +10,13 @@
 #define PLASMA2_H
 
 #include <stdint.h>
-#include <memory>
+#include <assert.h>
+#include <vector>
+#include <bit>
+#include "Map2D.h"
 
-class Rand2D;
+// the rows of a band of a block, at least (log2), see RendBlocks()
+static constexpr size_t PLASMA2_MIN_BAND_ROWS_L2 = 3;
 
 //==================================================================
 class Plasma2
@@ -20,7 +24,6 @@ class Plasma2
     std::vector<float>      mBaseGrid;
     const size_t            BLOCKS_NL2      {0};
 
-    std::unique_ptr<Rand2D> mGen_oRandPool;
     size_t                  mGen_IterIX     {0};
     size_t                  mGen_IterIY     {0};
 
@@ -28,11 +31,36 @@ public:
     struct Params
     {
         float       *pDest      {};
+        size_t      destPitch   {};     // of the rows of pDest, 0 for the size
         size_t      sizL2       {8};
         size_t      baseSizL2   {4};
         uint32_t    seed        {};
         float       sca         {1};
         float       rough       {0.5f};
+        bool        useSIMD     {true};     // false for the scalar reference
+
+        // the rows of map as pDest, and its size as sizL2
+        void SetDest( Map2D<float> &map ) { setDest( *this, map ); }
+    };
+
+    // a tile of an unbounded map, at world texel coordinates (x0, y0).
+    // The octaves go from cells of (1 << topCellL2) texels down to 1,
+    // with lattice values picked by world coordinates, so that the
+    // tiles match at the edges, whatever their size and position
+    struct TileParams
+    {
+        float       *pDest      {};
+        size_t      destPitch   {};     // of the rows of pDest, 0 for the size
+        size_t      sizL2       {7};
+        int64_t     x0          {};
+        int64_t     y0          {};
+        size_t      topCellL2   {5};
+        uint32_t    seed        {};
+        float       sca         {1};
+        float       rough       {0.5f};
+        bool        useSIMD     {true};
+
+        void SetDest( Map2D<float> &map ) { setDest( *this, map ); }
     };
 private:
     Params      mPar;
@@ -43,8 +71,55 @@ public:
 
     void RendBlock( size_t ix, size_t iy );
 
+    // all the blocks, spread over threadsN threads (0 for all cores).
+    // Same output as iterating on a single thread
+    void GenerateParallel( size_t threadsN=0 );
+
     bool IterateBlock();
     bool IterateRow();
+
+    // the blocks are numbered by rows, with (1 << baseSizL2) per row,
+    // and each covers (1 << GetBlockSizL2()) texels per side
+    size_t GetBlocksN() const { return (size_t)1 << (BLOCKS_NL2 * 2); }
+    size_t GetBlockSizL2() const { return mPar.sizL2 - BLOCKS_NL2; }
+
+    // blocks [sta, end), spread over threadsN threads (0 for all cores).
+    // When the blocks are fewer than the threads, they're split in bands
+    // of rows
+    void RendBlocks( size_t sta, size_t end, size_t threadsN=0 );
+
+    // the values go from 0 to this
+    float CalcMaxVal() const;
+
+    // Mpixels/s of each octave over the whole map, on a single thread.
+    // pDest is ignored, an internal map is used
+    static std::vector<double> BenchmarkOctaves( Params par, size_t repsN );
+
+    // fills par.pDest with (1 << par.sizL2)^2 values, in 0..CalcTileMaxVal()
+    static void GenerateTile( const TileParams &par );
+    static float CalcTileMaxVal( const TileParams &par );
+
+    // in values
+    static size_t GetDestPitch( const auto &par )
+    {
+        return par.destPitch ? par.destPitch : (size_t)1 << par.sizL2;
+    }
+
+private:
+    void rendBlockOctave( size_t ix, size_t iy, size_t ry0, size_t ry1, size_t d, float scaLev );
+    void rendBlockRows( size_t ix, size_t iy, size_t ry0, size_t ry1 );
+
+    size_t calcBandsL2( size_t blocksN, size_t threadsN ) const;
+
+    // a square map, with a side of a power of 2, any pitch
+    static void setDest( auto &par, Map2D<float> &map )
+    {
+        assert( map.GetW() == map.GetH() && std::has_single_bit( map.GetW() ) );
+
+        par.pDest       = map.Row( 0 );
+        par.sizL2       = (size_t)std::countr_zero( map.GetW() );
+        par.destPitch   = map.GetPitch();
+    }
 };
 
 #endif
@@ -0,0 +1,212 @@
+//==================================================================
+/// Plasma2Cache.cpp
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include "DBase.h"
+#include "MappedFile.h"
+#include "Plasma2Cache.h"
+
+namespace fs = std::filesystem;
+
+static constexpr uint32_t PL2C_VERSION = 2;
+
+//==================================================================
+static uint64_t hashFNV1a( const void *pData, size_t size )
+{
+    c_auto *p = (const uint8_t *)pData;
+
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i=0; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+//==================================================================
+static size_t getMapBytes( size_t sizL2 )
+{
+    return sizeof(float) << (sizL2 * 2);
+}
+
+//==================================================================
+Plasma2Cache::Plasma2Cache( const std::string &dirPath, uint64_t maxBytes, size_t minSizL2 )
+    : mDirPath(dirPath)
+    , mMaxBytes(maxBytes)
+    , mMinSizL2(minSizL2)
+{
+}
+
+//==================================================================
+Plasma2CacheHeader Plasma2Cache::MakeHeader( const Plasma2::Params &par )
+{
+    Plasma2CacheHeader head {};
+    memcpy( head.magic, "PL2C", 4 );
+    head.version    = PL2C_VERSION;
+    head.sizL2      = (uint32_t)par.sizL2;
+    head.baseSizL2  = (uint32_t)par.baseSizL2;
+    head.seed       = par.seed;
+    head.sca        = par.sca;
+    head.rough      = par.rough;
+    return head;
+}
+
+//==================================================================
+std::string Plasma2Cache::makePathFName( const Plasma2CacheHeader &head ) const
+{
+    char buff[64] {};
+    snprintf( buff, sizeof(buff), "plasma2_%016llx.bin",
+                (unsigned long long)hashFNV1a( &head, sizeof(head) ) );
+
+    return (fs::path( mDirPath ) / buff).string();
+}
+
+//==================================================================
+bool Plasma2Cache::Load( const Plasma2::Params &par )
+{
+    if NOT( IsCacheable( par ) )
+        return false;
+
+    c_auto head = MakeHeader( par );
+    c_auto pathFName = makePathFName( head );
+
+    MappedFile file;
+    if NOT( file.Open( pathFName ) )
+        return false;
+
+    c_auto mapBytes = getMapBytes( par.sizL2 );
+
+    // a hash collision or a damaged file is just a miss
+    if ( file.GetSize() != sizeof(head) + mapBytes ||
+         memcmp( file.GetData(), &head, sizeof(head) ) )
+    {
+        printf( "** ERROR bad cache file %s\n", pathFName.c_str() );
+        return false;
+    }
+
+    // packed in the file, by rows of the pitch of pDest in the map
+    c_auto siz = (size_t)1 << par.sizL2;
+    c_auto pitch = Plasma2::GetDestPitch( par );
+    c_auto *pSrc = (const float *)(file.GetData() + sizeof(head));
+    for (size_t y=0; y < siz; ++y)
+        memcpy( par.pDest + y * pitch, pSrc + y * siz, siz * sizeof(float) );
+
+    // mark as recently used
+    std::error_code ec;
+    fs::last_write_time( pathFName, fs::file_time_type::clock::now(), ec );
+
+    return true;
+}
+
+//==================================================================
+bool Plasma2Cache::Store( const Plasma2::Params &par )
+{
+    if NOT( IsCacheable( par ) )
+        return false;
+
+    std::error_code ec;
+    fs::create_directories( mDirPath, ec );
+
+    c_auto head = MakeHeader( par );
+    c_auto pathFName = makePathFName( head );
+
+    // write to the side and rename, so that a reader never sees a
+    // partial file
+    c_auto tmpPathFName = pathFName + ".tmp";
+    {
+        std::ofstream file( tmpPathFName, std::ios::binary );
+        if NOT( file.is_open() )
+        {
+            printf( "** ERROR could not open %s\n", tmpPathFName.c_str() );
+            return false;
+        }
+
+        file.write( (const char *)&head, sizeof(head) );
+
+        c_auto siz = (size_t)1 << par.sizL2;
+        c_auto pitch = Plasma2::GetDestPitch( par );
+        for (size_t y=0; y < siz; ++y)
+            file.write( (const char *)(par.pDest + y * pitch), (std::streamsize)(siz * sizeof(float)) );
+
+        if NOT( file.good() )
+        {
+            printf( "** ERROR failed writing %s\n", tmpPathFName.c_str() );
+            file.close();
+            fs::remove( tmpPathFName, ec );
+            return false;
+        }
+    }
+
+    fs::rename( tmpPathFName, pathFName, ec );
+    if ( ec )
+    {
+        printf( "** ERROR could not rename to %s\n", pathFName.c_str() );
+        fs::remove( tmpPathFName, ec );
+        return false;
+    }
+
+    evictOverLimit( pathFName );
+
+    return true;
+}
+
+//==================================================================
+void Plasma2Cache::evictOverLimit( const std::string &keepPathFName ) const
+{
+    struct Entry
+    {
+        fs::path            path;
+        uint64_t            size {};
+        fs::file_time_type  time {};
+    };
+    std::vector<Entry> entries;
+    uint64_t totSize = 0;
+
+    std::error_code ec;
+    for (c_auto &de : fs::directory_iterator( mDirPath, ec ))
+    {
+        c_auto name = de.path().filename().string();
+        if ( name.rfind( "plasma2_", 0 ) != 0 || de.path().extension() != ".bin" )
+            continue;
+
+        Entry e;
+        e.path = de.path();
+        e.size = de.file_size( ec );
+        e.time = de.last_write_time( ec );
+        totSize += e.size;
+        entries.push_back( std::move( e ) );
+    }
+
+    if ( totSize <= mMaxBytes )
+        return;
+
+    // oldest first
+    std::sort( entries.begin(), entries.end(), []( c_auto &l, c_auto &r )
+    {
+        return l.time < r.time;
+    });
+
+    for (c_auto &e : entries)
+    {
+        if ( totSize <= mMaxBytes )
+            break;
+
+        // the one just stored stays, even if alone over the limit
+        if ( e.path == fs::path( keepPathFName ) )
+            continue;
+
+        if ( fs::remove( e.path, ec ) )
+            totSize -= e.size;
+    }
+}
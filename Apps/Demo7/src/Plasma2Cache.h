@@ -0,0 +1,61 @@
+//==================================================================
+/// Plasma2Cache.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef PLASMA2CACHE_H
+#define PLASMA2CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include "Plasma2.h"
+
+//==================================================================
+// File layout: Plasma2CacheHeader, then (1 << sizL2)^2 floats.
+// The file name is a hash of the header, which holds all that affects
+// the output of Plasma2.
+struct Plasma2CacheHeader
+{
+    char        magic[4];       // "PL2C"
+    uint32_t    version;        // bump when the output of Plasma2 changes
+    uint32_t    sizL2;
+    uint32_t    baseSizL2;
+    uint32_t    seed;
+    float       sca;
+    float       rough;
+    uint32_t    reserved;
+};
+static_assert( sizeof(Plasma2CacheHeader) == 32 );
+
+//==================================================================
+/// Disk cache of generated maps, in a directory of its own.
+/// When over maxBytes, the least recently used maps are deleted.
+/// Maps under minSizL2 are quicker to generate, and aren't cached.
+class Plasma2Cache
+{
+    std::string     mDirPath;
+    uint64_t        mMaxBytes   {};
+    size_t          mMinSizL2   {};
+
+public:
+    Plasma2Cache( const std::string &dirPath, uint64_t maxBytes, size_t minSizL2=8 );
+
+    // fills par.pDest with the map of par, true if it was in the cache
+    bool Load( const Plasma2::Params &par );
+
+    // stores the map of par, from par.pDest
+    bool Store( const Plasma2::Params &par );
+
+    bool IsCacheable( const Plasma2::Params &par ) const { return par.sizL2 >= mMinSizL2; }
+
+    static Plasma2CacheHeader MakeHeader( const Plasma2::Params &par );
+
+private:
+    std::string makePathFName( const Plasma2CacheHeader &head ) const;
+    void evictOverLimit( const std::string &keepPathFName ) const;
+};
+
+#endif
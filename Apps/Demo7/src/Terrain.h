@@ -14,6 +14,7 @@
 #include "DBase.h"
 #include "MathBase.h"
 #include "RendBase.h"
+#include "Map2D.h"
 
 enum : uint8_t
 {
@@ -24,17 +25,28 @@ enum : uint8_t
 static constexpr auto CHROM_LAND = Float3{ 0.8f , 0.7f , 0.0f }; // chrominance for land
 static constexpr auto CHROM_SEA  = Float3{ 0.0f , 0.6f , 0.9f } * 1.5f; // chrominance for sea
 
+// the heights have a halo of a texel, with the opposite edge, see
+// Map2D::WrapHalo(), so that the stages that read the neighbors don't
+// special-case the edges, and some padding for the SIMD tails
+static constexpr size_t TERR_HEIGHTS_HALO = 1;
+static constexpr size_t TERR_HEIGHTS_PADN = 4;
+
 //==================================================================
+/// The layers are read and written by rows, with Row() and At().
+/// The heights have a halo and padding, the other layers are packed,
+/// so that the colors can also go to the GPU as they are.
+/// The shadows are bits by (y << sizL2) + x, see IsShadowed()
 class Terrain
 {
 public:
     size_t                  mSizeL2 {};
-    std::vector<float>      mHeights;
-    std::vector<uint8_t>    mTexMono;
-    std::vector<uint8_t>    mMateID;
-    std::vector<bool>       mIsShadowed;
-    std::vector<float>      mDiffLight;
-    std::vector<RBColType>  mBakedCols;
+    Map2D<float>            mHeights;
+    Map2D<uint8_t>          mTexMono;
+    Map2D<uint8_t>          mMateID;
+    std::vector<uint64_t>   mShadowBits;    // 1 bit per texel, see IsShadowed()
+    Map2D<uint8_t>          mDiffLight;     // 0..255
+    Map2D<Float3>           mNormals;       // per texel, empty unless asked to the bake
+    Map2D<RBColType>        mBakedCols;
     float                   mMinH   {0};
     float                   mMaxH   {1.5f};
 
@@ -42,21 +54,26 @@ public:
 
     Terrain( size_t sizeL2 )
         : mSizeL2(sizeL2)
-        , mHeights( (size_t)1 << ((int)sizeL2 * 2) )
     {
-        c_auto n = mHeights.size();
+        c_auto siz = GetSiz();
+        c_auto n = siz * siz;
         // initialize with default values
-        mTexMono    = std::vector<uint8_t>  ( n, 255 );
-        mMateID     = std::vector<uint8_t>  ( n, 0 );
-        mIsShadowed = std::vector<bool>     ( n, false );
-        mDiffLight  = std::vector<float>    ( n, 1.f );
-        mBakedCols  = std::vector<RBColType>( n, RBColType{255,0,255,255} );
+        mHeights.Setup( siz, siz, TERR_HEIGHTS_HALO, TERR_HEIGHTS_PADN, 0.f );
+        mTexMono.SetupPacked( siz, siz, 255 );
+        mMateID.SetupPacked( siz, siz, 0 );
+        mShadowBits = std::vector<uint64_t> ( (n + 63) / 64, 0 );
+        mDiffLight.SetupPacked( siz, siz, 1 );
+        mBakedCols.SetupPacked( siz, siz, RBColType{255,0,255,255} );
     }
 
     size_t GetSizL2() const { return mSizeL2; }
     size_t GetSiz() const { return (size_t)1 << mSizeL2; }
 
-    //size_t MakeIndexXY( size_t x, size_t y ) const { return x + (y << mSizeL2); }
+    bool IsShadowed( size_t x, size_t y ) const
+    {
+        c_auto i = (y << mSizeL2) + x;
+        return (mShadowBits[i >> 6] >> (i & 63)) & 1;
+    }
 };
 
 //==================================================================
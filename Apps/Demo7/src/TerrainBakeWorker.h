@@ -0,0 +1,220 @@
+//==================================================================
+/// TerrainBakeWorker.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef TERRAINBAKEWORKER_H
+#define TERRAINBAKEWORKER_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include "DBase.h"
+#include "ImmGL.h"
+#include "Terrain.h"
+#include "TerrainBaker.h"
+#include "TerrainLOD.h"
+#include "MU_MinMaxPyramid.h"
+
+//==================================================================
+/// Runs a TerrainBaker on a thread of its own, on a back Terrain, while
+/// the caller keeps drawing the front one.
+/// Each finished bake is copied into a Result, with what the renderer
+/// derives from it, built on the worker as well: the LOD chunk bounds,
+/// the ray cast pyramid and, if asked, the arrays of the whole map
+/// mesh that changed. The Result is handed over with an atomic pointer
+/// exchange, and the caller only has to swap it in and upload the
+/// arrays.
+/// The baker must not be used by anyone else while IsBusy(). Requests
+/// made while busy replace the pending one, only the latest counts.
+class TerrainBakeWorker
+{
+public:
+    struct Request
+    {
+        TerrainBaker::GenParams genPar;
+        TGEN_BakeParams         bakePar;
+        bool                    invalidate  {};     // the back Terrain is stale
+        size_t                  erodeStepsN {};
+        TerrainErosion::Params  eroPar;
+        bool                    resetErosion {};
+        float                   lodSca      {1};
+        bool                    makeMesh    {};     // see SetMakeMeshFn()
+    };
+
+    // the indices only change with the size, they're left to the caller
+    struct Mesh
+    {
+        IVec<IFloat3>           pos;    // only if the heights changed
+        IVec<IColor4U8>         cols;
+    };
+
+    struct Result
+    {
+        Terrain                 terr;
+        // set up on terr, to Rebind() once it's moved
+        TerrainLOD              lod;
+        // on the heights of terr, which stay put when it's moved
+        MU_MinMaxPyramid        pyr;
+        Mesh                    mesh;
+        uint32_t                stages  {};     // TGEN_STAGE_* redone
+    };
+
+    // fills what of the Mesh changed with the TGEN_STAGE_* redone
+    using MakeMeshFn = std::function<void (const Terrain &, uint32_t, Mesh &)>;
+
+private:
+    TerrainBaker                &mBaker;
+    MakeMeshFn                  mMakeMeshFn;
+
+    Terrain                     mBackTerr;
+
+    std::mutex                  mMtx;
+    std::condition_variable     mCV;
+    std::unique_ptr<Request>    moPending;
+    bool                        mQuit   {};
+
+    std::atomic<bool>           mIsBusy {};
+    std::atomic<Result *>       mpReady {};
+
+    std::thread                 mThread;
+
+public:
+    TerrainBakeWorker( TerrainBaker &baker )
+        : mBaker(baker)
+    {
+        mThread = std::thread( [this]() { threadMain(); } );
+    }
+
+    // waits for the bake in progress, if any
+    ~TerrainBakeWorker()
+    {
+        {
+            std::lock_guard lock( mMtx );
+            mQuit = true;
+        }
+        mCV.notify_one();
+        mThread.join();
+
+        delete mpReady.exchange( nullptr );
+    }
+
+    // fills the arrays of the whole map mesh, on the worker thread
+    void SetMakeMeshFn( const MakeMeshFn &fn )
+    {
+        std::lock_guard lock( mMtx );
+        mMakeMeshFn = fn;
+    }
+
+    //==================================================================
+    void Post( const Request &req )
+    {
+        {
+            std::lock_guard lock( mMtx );
+
+            // what the replaced one asked for, that must still happen
+            auto oReq = std::make_unique<Request>( req );
+            if ( moPending )
+            {
+                oReq->invalidate   |= moPending->invalidate;
+                oReq->resetErosion |= moPending->resetErosion;
+            }
+
+            moPending = std::move( oReq );
+            mIsBusy = true;
+        }
+        mCV.notify_one();
+    }
+
+    // a bake pending or in progress
+    bool IsBusy() const { return mIsBusy; }
+
+    // the latest finished bake, or nullptr. Doesn't wait
+    std::unique_ptr<Result> TakeResult()
+    {
+        return std::unique_ptr<Result>( mpReady.exchange( nullptr ) );
+    }
+
+private:
+    //==================================================================
+    void threadMain()
+    {
+        for (;;)
+        {
+            std::unique_ptr<Request> oReq;
+            MakeMeshFn makeMeshFn;
+            {
+                std::unique_lock lock( mMtx );
+                mCV.wait( lock, [&]() { return mQuit || moPending; } );
+                if ( mQuit )
+                    return;
+
+                oReq = std::move( moPending );
+                makeMeshFn = mMakeMeshFn;
+            }
+
+            if ( auto oRes = runRequest( *oReq, makeMeshFn ) )
+            {
+                // an unclaimed older one goes, but what it redid must still
+                // reach the caller. It has no GPU objects yet.
+                // Only this thread publishes, so nothing can come in between
+                if ( std::unique_ptr<Result> oOld { mpReady.exchange( nullptr ) } )
+                {
+                    oRes->stages |= oOld->stages;
+
+                    // the heights didn't change since, its positions still hold
+                    if ( oRes->mesh.pos.empty() )
+                        oRes->mesh.pos = std::move( oOld->mesh.pos );
+                }
+
+                mpReady = oRes.release();
+            }
+
+            // not busy, unless there's a new one
+            std::lock_guard lock( mMtx );
+            if NOT( moPending )
+                mIsBusy = false;
+        }
+    }
+
+    //==================================================================
+    std::unique_ptr<Result> runRequest( const Request &req, const MakeMeshFn &makeMeshFn )
+    {
+        if ( req.invalidate )
+            mBaker.Invalidate();
+
+        if ( req.resetErosion )
+            mBaker.ResetErosion();
+
+        auto changed = mBaker.Update( mBackTerr, req.genPar, req.bakePar );
+        auto stages = mBaker.mLastStages;
+
+        if ( mBaker.Erode( mBackTerr, req.eroPar, req.erodeStepsN ) )
+        {
+            changed = true;
+            stages |= mBaker.mLastStages;
+        }
+
+        if NOT( changed )
+            return {};
+
+        auto oRes = std::make_unique<Result>();
+        oRes->terr = mBackTerr;
+        oRes->stages = stages;
+        oRes->lod.Setup( oRes->terr, req.lodSca );
+        oRes->pyr.Build( oRes->terr.mHeights.GetView() );
+
+        if ( req.makeMesh && makeMeshFn )
+            makeMeshFn( oRes->terr, stages, oRes->mesh );
+
+        return oRes;
+    }
+};
+
+#endif
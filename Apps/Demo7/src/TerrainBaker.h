@@ -0,0 +1,452 @@
+//==================================================================
+/// TerrainBaker.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef TERRAINBAKER_H
+#define TERRAINBAKER_H
+
+#include <float.h>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include "DBase.h"
+#include "ParallelFor.h"
+#include "Plasma2.h"
+#include "Plasma2Cache.h"
+#include "Terrain.h"
+#include "TerrainGen.h"
+#include "TerrainErosion.h"
+
+//==================================================================
+/// Generates and bakes a Terrain, keeping what's needed to redo only
+/// the stages affected by a change of parameters. The heights from
+/// Plasma2 are kept aside, so that a change of height range doesn't
+/// need a new generation, and the baked attributes of the Terrain
+/// are reused as they are for the stages that don't need a redo.
+/// Erosion, when run, changes the heights kept aside, and the bake
+/// goes on from the eroded ones until the next generation.
+/// A generation can also be progressive, a few blocks of Plasma2 at a
+/// time, within a time budget, so that the caller stays responsive.
+class TerrainBaker
+{
+public:
+    struct GenParams
+    {
+        uint32_t    sizL2       {7};
+        uint32_t    baseSizL2   {2};
+        uint32_t    seed        {100};
+        float       rough       {0.5f};
+        bool        parallel    {true};
+        bool        useSIMD     {true};
+        bool        useCache    {true};     // if a cache was set
+
+        bool operator==( const GenParams & ) const = default;
+    };
+
+private:
+    // the part of the range of the plasma values that usually goes from
+    // minH to maxH, for the preview of a progressive generation
+    static constexpr float  PREVIEW_USUAL_LO = 0.2f;
+    static constexpr float  PREVIEW_USUAL_HI = 0.8f;
+
+    // a generation in progress, see StepGeneration()
+    struct GenJob
+    {
+        GenParams                   genPar;
+        TGEN_BakeParams             bakePar;    // the latest, for the end
+        Plasma2::Params             plasmaPar;
+        std::unique_ptr<Plasma2>    oPlasma;
+        size_t                      nextBlock   {};
+        size_t                      blocksN     {};
+        double                      timeS       {}; // spent so far
+        float                       previewLo   {};
+        float                       previewHi   {};
+    };
+
+    GenParams               mGenPar;
+    TGEN_BakeParams         mBakePar;
+    bool                    mHasBake {};
+
+    Map2D<float>            mGenHeights;    // heights before the bake, as Terrain::mHeights
+
+    TerrainErosion          mEroder;        // works on mGenHeights
+
+    std::unique_ptr<GenJob> moGenJob;
+
+    Plasma2Cache            *mpCache {};
+
+public:
+    double                  mLastGenTimeS   {};
+    bool                    mLastGenCached  {}; // loaded from the cache
+    double                  mLastBakeTimeS  {};
+    uint32_t                mLastStages     {}; // TGEN_STAGE_* redone last
+
+    // generated maps are looked up and stored there, nullptr for none
+    void SetCache( Plasma2Cache *pCache ) { mpCache = pCache; }
+
+    //==================================================================
+    /// Returns true if the terrain changed.
+    /// With progressive, a generation that isn't in the cache is only
+    /// started, on a new flat Terrain, to go on with StepGeneration().
+    /// A change of the generation parameters in the meantime restarts
+    /// it, while the bake parameters are only taken at the end.
+    bool Update(
+            Terrain &terr,
+            const GenParams &genPar,
+            const TGEN_BakeParams &bakePar,
+            bool progressive=false )
+    {
+        if ( moGenJob )
+        {
+            if ( genPar == moGenJob->genPar )
+            {
+                moGenJob->bakePar = bakePar;
+                return false;
+            }
+
+            // cancel, to restart below
+            moGenJob = {};
+        }
+
+        c_auto doGen = NOT( mHasBake ) || NOT( genPar == mGenPar );
+
+        c_auto stages = doGen
+                        ? (uint32_t)TGEN_STAGE_ALL
+                        : TGEN_CalcDirtyStages( mBakePar, bakePar );
+
+        mLastStages = stages;
+        if NOT( stages )
+            return false;
+
+        if ( doGen )
+        {
+            // started, for StepGeneration() to go on
+            if NOT( generate( terr, genPar, bakePar, progressive ) )
+                return true;
+        }
+        else
+        if ( stages & TGEN_STAGE_SHAPE )
+            terr.mHeights = mGenHeights;  // restart from the unscaled heights
+
+        c_auto bakeStartS = getSteadyTimeSecs();
+
+        TGEN_BakeTiled( terr, bakePar, stages );
+
+        mLastBakeTimeS = getSteadyTimeSecs() - bakeStartS;
+
+        mGenPar  = genPar;
+        mBakePar = bakePar;
+        mHasBake = true;
+
+        return true;
+    }
+
+    //==================================================================
+    /// Runs itersN more steps of erosion, and bakes again from the eroded
+    /// heights. Returns true if the terrain changed
+    bool Erode( Terrain &terr, const TerrainErosion::Params &erPar, size_t itersN )
+    {
+        if ( NOT( mHasBake ) || NOT( itersN ) )
+            return false;
+
+        if NOT( mEroder.IsSetup() )
+            mEroder.Setup( mGenHeights, calcErosionVertSca() );
+
+        mEroder.Run( itersN, erPar );
+        mEroder.GetHeights( mGenHeights );
+
+        c_auto bakeStartS = getSteadyTimeSecs();
+
+        terr.mHeights = mGenHeights;
+        TGEN_BakeTiled( terr, mBakePar, TGEN_STAGE_ALL );
+
+        mLastBakeTimeS = getSteadyTimeSecs() - bakeStartS;
+        mLastStages = TGEN_STAGE_ALL;
+
+        return true;
+    }
+
+    // everything is redone at the next Update(), for a different Terrain
+    void Invalidate()
+    {
+        mHasBake = false;
+        moGenJob = {};
+    }
+
+    // back to the generated heights, at the next Update()
+    void ResetErosion()
+    {
+        if ( mEroder.IsSetup() )
+            mHasBake = false;
+    }
+
+    const TerrainErosion &GetEroder() const { return mEroder; }
+
+    //==================================================================
+    /// Goes on with a progressive generation, for about budgetS seconds,
+    /// but at least a batch of blocks. The blocks done get a quick
+    /// preview in terr, and out_rect is the (x0, y0, x1, y1) of what
+    /// changed. The last one also does the full bake.
+    /// Returns true if the terrain changed
+    bool StepGeneration( Terrain &terr, double budgetS, size_t out_rect[4] )
+    {
+        if NOT( moGenJob )
+            return false;
+
+        auto &job = *moGenJob;
+        auto &plasma = *job.oPlasma;
+
+        c_auto startS = getSteadyTimeSecs();
+
+        c_auto threadsN = job.genPar.parallel ? PF_GetThreadsN() : 1;
+        c_auto staBlock = job.nextBlock;
+        do
+        {
+            c_auto endBlock = std::min( job.nextBlock + threadsN, job.blocksN );
+            plasma.RendBlocks( job.nextBlock, endBlock, threadsN );
+            job.nextBlock = endBlock;
+        }
+        while ( job.nextBlock < job.blocksN && getSteadyTimeSecs() - startS < budgetS );
+
+        job.timeS += getSteadyTimeSecs() - startS;
+
+        if ( job.nextBlock < job.blocksN )
+        {
+            // a span of blocks by rows, as a rect
+            c_auto rowL2 = (size_t)job.plasmaPar.baseSizL2;
+            c_auto blkL2 = plasma.GetBlockSizL2();
+            c_auto by0 = staBlock >> rowL2;
+            c_auto by1 = (job.nextBlock - 1) >> rowL2;
+            c_auto isOneRow = by0 == by1;
+            size_t rect[4];
+            rect[0] = isOneRow ? (staBlock & (((size_t)1 << rowL2) - 1)) << blkL2 : 0;
+            rect[1] = by0 << blkL2;
+            rect[2] = isOneRow ? (((job.nextBlock - 1) & (((size_t)1 << rowL2) - 1)) + 1) << blkL2
+                               : terr.GetSiz();
+            rect[3] = (by1 + 1) << blkL2;
+
+            bakePreviewRect( terr, rect, out_rect );
+            return true;
+        }
+
+        // done, the whole bake
+        auto oJob = std::move( moGenJob );
+
+        if ( mpCache && oJob->genPar.useCache )
+            mpCache->Store( oJob->plasmaPar );
+
+        mLastGenTimeS  = oJob->timeS;
+        mLastGenCached = false;
+
+        c_auto bakeStartS = getSteadyTimeSecs();
+
+        terr.mHeights = mGenHeights;
+        TGEN_BakeTiled( terr, oJob->bakePar, TGEN_STAGE_ALL );
+
+        mLastBakeTimeS = getSteadyTimeSecs() - bakeStartS;
+        mLastStages = TGEN_STAGE_ALL;
+
+        mGenPar  = oJob->genPar;
+        mBakePar = oJob->bakePar;
+        mHasBake = true;
+
+        out_rect[0] = 0;
+        out_rect[1] = 0;
+        out_rect[2] = terr.GetSiz();
+        out_rect[3] = terr.GetSiz();
+        return true;
+    }
+
+    bool IsGenerating() const { return !!moGenJob; }
+
+    // of the generation in progress, 0..1
+    float GetGenProgress() const
+    {
+        return moGenJob ? (float)moGenJob->nextBlock / (float)moGenJob->blocksN : 1.f;
+    }
+
+private:
+    //==================================================================
+    // the erosion works in texels, as the heights will be after the bake
+    float calcErosionVertSca() const
+    {
+        float mi =  FLT_MAX;
+        float ma = -FLT_MAX;
+        for (size_t y=0; y < mGenHeights.GetH(); ++y)
+        {
+            c_auto *pRow = mGenHeights.Row( y );
+            c_auto [rmi, rma] = std::minmax_element( pRow, pRow + mGenHeights.GetW() );
+            mi = std::min( mi, *rmi );
+            ma = std::max( ma, *rma );
+        }
+
+        c_auto siz = (float)((size_t)1 << mGenPar.sizL2);
+        c_auto rangeH = mBakePar.maxH - mBakePar.minH;
+        return (ma != mi && rangeH > 0) ? siz * rangeH / (ma - mi) : siz;
+    }
+
+    //==================================================================
+    // returns false if it was started as a job, instead
+    bool generate(
+            Terrain &terr,
+            const GenParams &genPar,
+            const TGEN_BakeParams &bakePar,
+            bool progressive )
+    {
+        // allocate a new map
+        terr = Terrain( genPar.sizL2 );
+
+        mEroder.Clear();
+
+        // fill it with "plasma"
+        Plasma2::Params par;
+        par.SetDest( terr.mHeights );           // destination values and log2 of size
+        par.baseSizL2   = genPar.baseSizL2;     // log2 of size of initial low res map
+        par.seed        = genPar.seed;
+        par.rough       = genPar.rough;
+        par.useSIMD     = genPar.useSIMD;
+
+        c_auto genStartS = getSteadyTimeSecs();
+
+        c_auto pCache = genPar.useCache ? mpCache : nullptr;
+
+        mLastGenCached = pCache && pCache->Load( par );
+
+        if ( NOT( mLastGenCached ) && progressive )
+        {
+            beginGenJob( terr, genPar, bakePar, par );
+            return false;
+        }
+
+        if NOT( mLastGenCached )
+        {
+            Plasma2 plasma( par );
+            if ( genPar.parallel )
+                plasma.GenerateParallel();
+            else
+                while ( plasma.IterateRow() )
+                {
+                }
+
+            if ( pCache )
+                pCache->Store( par );
+        }
+
+        mLastGenTimeS = getSteadyTimeSecs() - genStartS;
+
+        mGenHeights = terr.mHeights;
+
+        return true;
+    }
+
+    //==================================================================
+    // the plasma goes to mGenHeights, and terr gets the preview
+    void beginGenJob(
+            Terrain &terr,
+            const GenParams &genPar,
+            const TGEN_BakeParams &bakePar,
+            Plasma2::Params plasmaPar )
+    {
+        // the new flat heights, with their layout
+        mGenHeights = terr.mHeights;
+        plasmaPar.SetDest( mGenHeights );
+
+        auto oJob = std::make_unique<GenJob>();
+        oJob->genPar    = genPar;
+        oJob->bakePar   = bakePar;
+        oJob->plasmaPar = plasmaPar;
+        oJob->oPlasma   = std::make_unique<Plasma2>( oJob->plasmaPar );
+        oJob->blocksN   = oJob->oPlasma->GetBlocksN();
+
+        // the final rescale needs the min/max of the whole map
+        c_auto maxVal = oJob->oPlasma->CalcMaxVal();
+        oJob->previewLo = maxVal * PREVIEW_USUAL_LO;
+        oJob->previewHi = maxVal * PREVIEW_USUAL_HI;
+
+        terr.mMinH = bakePar.minH;
+        terr.mMaxH = bakePar.maxH;
+
+        // the old bake is gone
+        mHasBake = false;
+
+        moGenJob = std::move( oJob );
+    }
+
+    //==================================================================
+    // the job's blocks in [x0, x1) x [y0, y1) to terr, with the plasma
+    // values mapped from the usual range, and no shadows.
+    // The diffuse of a texel needs its right and bottom neighbors, so the
+    // row above and the column to the left of the rect, from the previous
+    // blocks, get theirs again, now that the neighbors are there.
+    // out_rect is the rect with those, what changed in terr
+    void bakePreviewRect( Terrain &terr, const size_t rect[4], size_t out_rect[4] ) const
+    {
+        c_auto &job = *moGenJob;
+        c_auto &bp = job.bakePar;
+
+        c_auto x0 = rect[0];
+        c_auto y0 = rect[1];
+        c_auto x1 = rect[2];
+        c_auto y1 = rect[3];
+
+        auto &heights = terr.mHeights;
+        c_auto scaToH = (bp.maxH - bp.minH) / (job.previewHi - job.previewLo);
+
+        PF_ForRange( y1 - y0, 16, [&]( size_t sta, size_t end )
+        {
+            for (size_t y=y0 + sta; y < y0 + end; ++y)
+            {
+                c_auto *pGen = mGenHeights.Row( y );
+                auto *pRow = heights.Row( y );
+                for (size_t x=x0; x < x1; ++x)
+                {
+                    pRow[x] = bp.minH + (pGen[x] - job.previewLo) * scaToH;
+                    tgen_MakeMateAndTexAt( terr, x, y );
+                    pRow[x] = std::max( pRow[x], 0.f );
+                }
+            }
+        } );
+
+        // the diffuse needs the neighbors' heights, those of the edges
+        // are in the halo
+        heights.WrapHalo();
+
+        c_auto dx0 = x0 ? x0 - 1 : x0;
+        c_auto dy0 = y0 ? y0 - 1 : y0;
+
+        c_auto lightDirLS = glm::normalize( bp.lightDirLS );
+        PF_ForRange( y1 - dy0, 16, [&]( size_t sta, size_t end )
+        {
+            for (size_t y=dy0 + sta; y < dy0 + end; ++y)
+            {
+                auto *pDif = terr.mDiffLight.Row( y );
+                if ( bp.enableDiff )
+                    tgen_CalcDiffRow( heights, y, dx0, x1, lightDirLS, pDif, nullptr );
+                else
+                    std::fill( pDif + dx0, pDif + x1, 1 );
+
+                tgen_CalcBakedColsRow( terr, y, dx0, x1, bp.lightDif, bp.lightAmb );
+            }
+        } );
+
+        out_rect[0] = dx0;
+        out_rect[1] = dy0;
+        out_rect[2] = x1;
+        out_rect[3] = y1;
+    }
+
+    //==================================================================
+    static double getSteadyTimeSecs()
+    {
+        return
+            (double)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count() * 1e-6;
+    }
+};
+
+#endif
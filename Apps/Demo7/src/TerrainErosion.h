@@ -0,0 +1,463 @@
+//==================================================================
+/// TerrainErosion.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef TERRAINEROSION_H
+#define TERRAINEROSION_H
+
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <bit>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define TERO_SSE
+#endif
+#include "DBase.h"
+#include "ParallelFor.h"
+#include "Map2D.h"
+
+//==================================================================
+// the few operations of the solver, on 1 float or on 4, so that the
+// same code does both, with the same results
+inline float tero_Load( float, const float *p ) { return *p; }
+inline void  tero_Store( float *p, float v ) { *p = v; }
+inline float tero_Set( float, float v ) { return v; }
+inline float tero_Min( float a, float b ) { return a < b ? a : b; }
+inline float tero_Max( float a, float b ) { return a > b ? a : b; }
+inline float tero_Sqrt( float a ) { return sqrtf( a ); }
+
+#if defined(TERO_SSE)
+struct tero_F4
+{
+    __m128  v;
+
+    friend tero_F4 operator+( tero_F4 a, tero_F4 b ) { return { _mm_add_ps( a.v, b.v ) }; }
+    friend tero_F4 operator-( tero_F4 a, tero_F4 b ) { return { _mm_sub_ps( a.v, b.v ) }; }
+    friend tero_F4 operator*( tero_F4 a, tero_F4 b ) { return { _mm_mul_ps( a.v, b.v ) }; }
+    friend tero_F4 operator/( tero_F4 a, tero_F4 b ) { return { _mm_div_ps( a.v, b.v ) }; }
+};
+
+inline tero_F4 tero_Load( tero_F4, const float *p ) { return { _mm_loadu_ps( p ) }; }
+inline void    tero_Store( float *p, tero_F4 v ) { _mm_storeu_ps( p, v.v ); }
+inline tero_F4 tero_Set( tero_F4, float v ) { return { _mm_set1_ps( v ) }; }
+// same operand order as the scalar ones, for the same NaN handling
+inline tero_F4 tero_Min( tero_F4 a, tero_F4 b ) { return { _mm_min_ps( a.v, b.v ) }; }
+inline tero_F4 tero_Max( tero_F4 a, tero_F4 b ) { return { _mm_max_ps( a.v, b.v ) }; }
+inline tero_F4 tero_Sqrt( tero_F4 a ) { return { _mm_sqrt_ps( a.v ) }; }
+#endif
+
+//==================================================================
+/// Hydraulic and thermal erosion of a square map of heights.
+/// The water is a shallow layer moved by the "virtual pipes" between
+/// each cell and its 4 neighbors (Mei et al., 2007). Where it flows,
+/// it dissolves the ground up to a capacity that grows with speed and
+/// slope, carries the sediment and drops it where it slows down.
+/// The thermal pass then moves the ground down the slopes steeper than
+/// the talus, as loose material would.
+/// The state is kept in SoA maps with a halo of 1 cell, so that all
+/// the cells take the same path, in SIMD. The maps are all set up the
+/// same, so that a cell has the same index in all of them. Each pass only writes
+/// to its own cell, reading the neighbors from what the previous pass
+/// left, or from a second buffer, so that the rows can go in parallel.
+/// The water that reaches the border leaves the map.
+/// Heights are in texels, vertSca converts to them from the map.
+class TerrainErosion
+{
+public:
+    struct Params
+    {
+        float       dt          {0.05f};    // time step
+        float       pipeAccel   {1.f};      // gravity x pipe section / length
+        float       rain        {0.2f};     // water added per unit of time
+        float       evap        {0.5f};     // fraction lost per unit of time
+        float       capacity    {0.03f};    // sediment carried per speed x slope
+        float       minTilt     {0.05f};    // so that the flat ground erodes too
+        float       fullDepth   {2.f};      // water depth of the full capacity
+        float       dissolve    {0.1f};     // fraction of the free capacity taken
+        float       deposit     {0.1f};     // fraction of the excess dropped
+        float       talus       {2.f};      // max height step that holds, texels
+        float       thermal     {0.1f};     // fraction of the excess moved
+        bool        useSIMD     {true};
+        size_t      threadsN    {};         // 0 for all cores
+    };
+
+private:
+    static constexpr size_t ROWS_PER_JOB = 16;
+
+    using Map = Map2D<float>;
+
+    size_t              mSizL2      {};
+    size_t              mPitch      {};     // of all the maps
+    float               mVertSca    {1};
+
+    // state, with a halo of 1 cell
+    Map                 mB;                 // ground
+    Map                 mD;                 // water
+    Map                 mS;                 // sediment
+    Map                 mFL, mFR, mFT, mFB; // outflows, to x-1, x+1, y-1, y+1
+    Map                 mU, mV;             // velocity
+
+    // where the passes that read the neighbors write to
+    Map                 mB2;
+    Map                 mS2;
+
+    size_t              mItersN     {};
+    double              mLastCellsPerS {};
+
+public:
+    //==================================================================
+    void Setup( const Map2D<float> &heights, float vertSca )
+    {
+        assert( heights.GetW() == heights.GetH() && std::has_single_bit( heights.GetW() ) );
+
+        mSizL2   = (size_t)std::countr_zero( heights.GetW() );
+        mVertSca = vertSca;
+
+        c_auto siz = heights.GetW();
+
+        for (auto *pMap : { &mB, &mD, &mS, &mFL, &mFR, &mFT, &mFB, &mU, &mV, &mB2, &mS2 })
+            pMap->Setup( siz, siz, 1 );
+
+        mPitch = mB.GetPitch();
+
+        for (size_t y=0; y < siz; ++y)
+        {
+            c_auto *pSrc = heights.Row( y );
+            auto *pRow = mB.Row( y );
+            for (size_t x=0; x < siz; ++x)
+                pRow[x] = pSrc[x] * vertSca;
+        }
+
+        mB.ClampHalo();
+
+        mItersN = 0;
+        mLastCellsPerS = 0;
+    }
+
+    bool IsSetup() const { return NOT( mB.IsEmpty() ); }
+
+    void Clear() { *this = TerrainErosion(); }
+
+    //==================================================================
+    /// Runs itersN steps of the simulation, for a fixed budget per call
+    void Run( size_t itersN, const Params &par )
+    {
+        if ( NOT( IsSetup() ) || NOT( itersN ) )
+            return;
+
+        c_auto startS = getSteadyTimeSecs();
+
+        for (size_t i=0; i < itersN; ++i)
+        {
+            passFlux( par );
+            passWater( par );
+            passErode( par );
+            std::swap( mB, mB2 );
+            mB.ClampHalo();
+            passAdvect( par );
+            std::swap( mS, mS2 );
+            passThermal( par );
+            std::swap( mB, mB2 );
+            mB.ClampHalo();
+        }
+
+        mItersN += itersN;
+
+        c_auto siz = (size_t)1 << mSizL2;
+        c_auto elapsedS = std::max( getSteadyTimeSecs() - startS, 1e-6 );
+        mLastCellsPerS = (double)(siz * siz * itersN) / elapsedS;
+    }
+
+    //==================================================================
+    // the ground, back in the units of the map
+    void GetHeights( Map2D<float> &out_heights ) const
+    {
+        c_auto siz = (size_t)1 << mSizL2;
+        c_auto ooSca = 1.f / mVertSca;
+
+        for (size_t y=0; y < siz; ++y)
+        {
+            c_auto *pRow = mB.Row( y );
+            auto *pDst = out_heights.Row( y );
+            for (size_t x=0; x < siz; ++x)
+                pDst[x] = pRow[x] * ooSca;
+        }
+    }
+
+    size_t GetItersN() const { return mItersN; }
+
+    // cell updates per second of the last Run()
+    double GetLastCellsPerS() const { return mLastCellsPerS; }
+
+    //==================================================================
+    /// Cell updates per second, over itersN steps on a copy of the map
+    static double Benchmark(
+                    const Map2D<float> &heights,
+                    float vertSca,
+                    const Params &par,
+                    size_t itersN )
+    {
+        TerrainErosion ero;
+        ero.Setup( heights, vertSca );
+        ero.Run( itersN, par );
+        return ero.GetLastCellsPerS();
+    }
+
+private:
+    // index of a cell from Row( 0 ) of any of the maps. Those of the
+    // halo go to -1 and siz, in x and y
+    ptrdiff_t cellIdx( size_t x, size_t y ) const { return (ptrdiff_t)(y * mPitch + x); }
+
+    //==================================================================
+    // runs fn( V(), i ) for all the cells of the map, by bands of rows,
+    // where V is tero_F4 for 4 cells at i, or float for 1. The rows
+    // start aligned, so the 4 cells at i are as well
+    template <typename FN>
+    void forCells( const Params &par, const FN &fn ) const
+    {
+        c_auto siz = (size_t)1 << mSizL2;
+        c_auto useSIMD = par.useSIMD;
+
+        PF_ForRange( siz, ROWS_PER_JOB, [&]( size_t sta, size_t end )
+        {
+            for (size_t y=sta; y < end; ++y)
+            {
+                c_auto r = cellIdx( 0, y );
+                size_t x = 0;
+#if defined(TERO_SSE)
+                if ( useSIMD )
+                    for (; x + 4 <= siz; x += 4)
+                        fn( tero_F4(), r + (ptrdiff_t)x );
+#else
+                (void)useSIMD;
+#endif
+                for (; x < siz; ++x)
+                    fn( float(), r + (ptrdiff_t)x );
+            }
+        }, par.threadsN );
+    }
+
+    //==================================================================
+    // outflows from the differences of water level with the neighbors,
+    // scaled down to not take more water than there is
+    void passFlux( const Params &par )
+    {
+        c_auto P = (ptrdiff_t)mPitch;
+        c_auto *pB = mB.Row( 0 );
+        c_auto *pD = mD.Row( 0 );
+        auto *pFL = mFL.Row( 0 );
+        auto *pFR = mFR.Row( 0 );
+        auto *pFT = mFT.Row( 0 );
+        auto *pFB = mFB.Row( 0 );
+
+        forCells( par, [&]( auto vtag, ptrdiff_t i )
+        {
+            using V = decltype( vtag );
+            auto ld = [&]( const float *p ) { return tero_Load( V(), p ); };
+
+            c_auto zero = tero_Set( V(), 0.f );
+            c_auto dtg  = tero_Set( V(), par.dt * par.pipeAccel );
+
+            c_auto h = ld( pB + i ) + ld( pD + i );
+
+            auto flow = [&]( const float *pF, ptrdiff_t ni )
+            {
+                return tero_Max( ld( pF + i ) + dtg * (h - (ld( pB + ni ) + ld( pD + ni ))), zero );
+            };
+
+            c_auto fl = flow( pFL, i - 1 );
+            c_auto fr = flow( pFR, i + 1 );
+            c_auto ft = flow( pFT, i - P );
+            c_auto fb = flow( pFB, i + P );
+
+            c_auto outV = (fl + fr + ft + fb) * tero_Set( V(), par.dt );
+            c_auto k = tero_Min( ld( pD + i ) / tero_Max( outV, tero_Set( V(), 1e-6f ) ),
+                                 tero_Set( V(), 1.f ) );
+
+            tero_Store( pFL + i, fl * k );
+            tero_Store( pFR + i, fr * k );
+            tero_Store( pFT + i, ft * k );
+            tero_Store( pFB + i, fb * k );
+        } );
+    }
+
+    //==================================================================
+    // water from the flows in and out, and its velocity
+    void passWater( const Params &par )
+    {
+        c_auto P = (ptrdiff_t)mPitch;
+        c_auto *pFL = mFL.Row( 0 );
+        c_auto *pFR = mFR.Row( 0 );
+        c_auto *pFT = mFT.Row( 0 );
+        c_auto *pFB = mFB.Row( 0 );
+        auto *pD = mD.Row( 0 );
+        auto *pU = mU.Row( 0 );
+        auto *pV = mV.Row( 0 );
+
+        forCells( par, [&]( auto vtag, ptrdiff_t i )
+        {
+            using V = decltype( vtag );
+            auto ld = [&]( const float *p ) { return tero_Load( V(), p ); };
+
+            c_auto half = tero_Set( V(), 0.5f );
+
+            c_auto inL  = ld( pFR + i - 1 );    // from the left, going right
+            c_auto inR  = ld( pFL + i + 1 );
+            c_auto inT  = ld( pFB + i - P );
+            c_auto inB  = ld( pFT + i + P );
+            c_auto outL = ld( pFL + i );
+            c_auto outR = ld( pFR + i );
+            c_auto outT = ld( pFT + i );
+            c_auto outB = ld( pFB + i );
+
+            c_auto d0 = ld( pD + i );
+            c_auto d1 = tero_Max( d0 + tero_Set( V(), par.dt ) *
+                                    ((inL + inR + inT + inB) - (outL + outR + outT + outB)),
+                                  tero_Set( V(), 0.f ) );
+
+            c_auto ooDepth = tero_Set( V(), 1.f ) /
+                                tero_Max( (d0 + d1) * half, tero_Set( V(), 1e-4f ) );
+
+            tero_Store( pD + i, d1 );
+            tero_Store( pU + i, ((inL - outL) + (outR - inR)) * half * ooDepth );
+            tero_Store( pV + i, ((inT - outT) + (outB - inB)) * half * ooDepth );
+        } );
+    }
+
+    //==================================================================
+    // dissolves or deposits toward the capacity, then rain and evaporation
+    void passErode( const Params &par )
+    {
+        c_auto P = (ptrdiff_t)mPitch;
+        c_auto *pB = mB.Row( 0 );
+        c_auto *pU = mU.Row( 0 );
+        c_auto *pV = mV.Row( 0 );
+        auto *pB2 = mB2.Row( 0 );
+        auto *pD = mD.Row( 0 );
+        auto *pS = mS.Row( 0 );
+
+        forCells( par, [&]( auto vtag, ptrdiff_t i )
+        {
+            using V = decltype( vtag );
+            auto ld = [&]( const float *p ) { return tero_Load( V(), p ); };
+
+            c_auto zero = tero_Set( V(), 0.f );
+            c_auto one  = tero_Set( V(), 1.f );
+            c_auto half = tero_Set( V(), 0.5f );
+
+            // sine of the slope
+            c_auto gx = (ld( pB + i + 1 ) - ld( pB + i - 1 )) * half;
+            c_auto gy = (ld( pB + i + P ) - ld( pB + i - P )) * half;
+            c_auto g2 = gx * gx + gy * gy;
+            c_auto sinTilt = tero_Max( tero_Sqrt( g2 / (one + g2) ), tero_Set( V(), par.minTilt ) );
+
+            c_auto u = ld( pU + i );
+            c_auto v = ld( pV + i );
+            c_auto speed = tero_Sqrt( u * u + v * v );
+
+            // less in shallow water
+            c_auto d = ld( pD + i );
+            c_auto depthFac = tero_Min( d * tero_Set( V(), 1.f / par.fullDepth ), one );
+
+            c_auto cap = tero_Set( V(), par.capacity ) * sinTilt * speed * depthFac;
+
+            // > 0 to dissolve, < 0 to deposit
+            c_auto s = ld( pS + i );
+            c_auto diff = cap - s;
+            c_auto amt = tero_Set( V(), par.dissolve ) * tero_Max( diff, zero ) +
+                         tero_Set( V(), par.deposit )  * tero_Min( diff, zero );
+
+            tero_Store( pB2 + i, ld( pB + i ) - amt );
+            tero_Store( pS + i, s + amt );
+            tero_Store( pD + i, (d + tero_Set( V(), par.rain * par.dt )) *
+                                    tero_Set( V(), std::max( 1.f - par.evap * par.dt, 0.f ) ) );
+        } );
+    }
+
+    //==================================================================
+    // the sediment moves with the water, taken from upstream
+    void passAdvect( const Params &par )
+    {
+        c_auto siz = (size_t)1 << mSizL2;
+        c_auto *pS = mS.Row( 0 );
+        c_auto *pU = mU.Row( 0 );
+        c_auto *pV = mV.Row( 0 );
+        auto *pS2 = mS2.Row( 0 );
+
+        // bilinear, gathers don't go in SIMD
+        c_auto lo = 1.f;
+        c_auto hi = (float)siz;
+        PF_ForRange( siz, ROWS_PER_JOB, [&]( size_t sta, size_t end )
+        {
+            for (size_t y=sta; y < end; ++y)
+            {
+                for (size_t x=0; x < siz; ++x)
+                {
+                    c_auto i = cellIdx( x, y );
+
+                    // with the halo at 0, so that the cells go from 1
+                    c_auto sx = std::clamp( (float)(x + 1) - pU[i] * par.dt, lo, hi );
+                    c_auto sy = std::clamp( (float)(y + 1) - pV[i] * par.dt, lo, hi );
+
+                    c_auto x0 = (size_t)sx;
+                    c_auto y0 = (size_t)sy;
+                    c_auto tx = sx - (float)x0;
+                    c_auto ty = sy - (float)y0;
+
+                    // back to the cells from 0
+                    c_auto *p = pS + (y0 - 1) * mPitch + (x0 - 1);
+                    c_auto top = p[0]      + (p[1] - p[0]) * tx;
+                    c_auto bot = p[mPitch] + (p[mPitch + 1] - p[mPitch]) * tx;
+                    pS2[i] = top + (bot - top) * ty;
+                }
+            }
+        }, par.threadsN );
+    }
+
+    //==================================================================
+    // exchanges with each neighbor part of the height difference past
+    // the talus. The exchange is symmetric, so the ground is preserved
+    void passThermal( const Params &par )
+    {
+        c_auto P = (ptrdiff_t)mPitch;
+        c_auto *pB = mB.Row( 0 );
+        auto *pB2 = mB2.Row( 0 );
+
+        forCells( par, [&]( auto vtag, ptrdiff_t i )
+        {
+            using V = decltype( vtag );
+            auto ld = [&]( const float *p ) { return tero_Load( V(), p ); };
+
+            c_auto zero  = tero_Set( V(), 0.f );
+            c_auto talus = tero_Set( V(), par.talus );
+
+            c_auto b = ld( pB + i );
+
+            auto excess = [&]( ptrdiff_t ni )
+            {
+                c_auto dh = ld( pB + ni ) - b;
+                return tero_Max( dh - talus, zero ) + tero_Min( dh + talus, zero );
+            };
+
+            c_auto sum = excess( i - 1 ) + excess( i + 1 ) + excess( i - P ) + excess( i + P );
+
+            tero_Store( pB2 + i, b + sum * tero_Set( V(), par.thermal * 0.25f ) );
+        } );
+    }
+
+    //==================================================================
+    static double getSteadyTimeSecs()
+    {
+        return
+            (double)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count() * 1e-6;
+    }
+};
+
+#endif
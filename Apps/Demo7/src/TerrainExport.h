@@ -11,10 +11,44 @@
 
 #include <stdio.h>
 #include <stdarg.h>
-#include <iostream>
+#include <string.h>
+#include <array>
+#include <vector>
 #include <fstream>
+#include "ParallelFor.h"
+#include "SimpleLZ.h"
 #include "Terrain.h"
 
+// output formats
+enum : uint32_t
+{
+    TEXP_FMT_CHEADER,   // C arrays, as text
+    TEXP_FMT_BINARY,    // raw bytes
+    TEXP_FMT_DELTALZ,   // row deltas, LZ compressed (see SimpleLZ.h)
+    TEXP_FMT_N
+};
+
+//==================================================================
+// File layout of the binary formats: TerrainExportBinHeader, the text
+// of headStr (headStrLen bytes), then the heights, shades and
+// materials, each as a uint32_t of the stored size and the data.
+// Uncompressed, a section is wd * he bytes, by rows.
+// With TEXP_FMT_DELTALZ, each byte of a row is first replaced by its
+// difference (mod 256) with the one on its left.
+struct TerrainExportBinHeader
+{
+    char        magic[4];       // "TERX"
+    uint32_t    version;
+    uint32_t    format;         // TEXP_FMT_BINARY or TEXP_FMT_DELTALZ
+    uint32_t    wd;
+    uint32_t    he;
+    uint32_t    headStrLen;
+    uint32_t    reserved[2];
+};
+static_assert( sizeof(TerrainExportBinHeader) == 32 );
+
+static constexpr uint32_t TEXP_BIN_VERSION = 1;
+
 //==================================================================
 static std::string SSPrintFS( const char *pFmt, ... )
 {
@@ -27,6 +61,73 @@ static std::string SSPrintFS( const char *pFmt, ... )
 	return {buff};
 }
 
+//==================================================================
+/// Writes through a fixed buffer, flushed to the file when full
+class texp_BuffWriter
+{
+    std::ofstream           mFile;
+    std::array<char,1 << 16> mBuff;
+    size_t                  mBuffN  {};
+
+public:
+    texp_BuffWriter( const std::string &pathFName )
+        : mFile( pathFName, std::ios::binary )
+    {
+    }
+
+    ~texp_BuffWriter() { Flush(); }
+
+    bool IsOpen() const { return mFile.is_open(); }
+    bool IsGood() const { return mFile.good(); }
+
+    void Write( const void *pData, size_t n )
+    {
+        // big ones go straight to the file
+        if ( n > mBuff.size() )
+        {
+            Flush();
+            mFile.write( (const char *)pData, (std::streamsize)n );
+            return;
+        }
+
+        if ( mBuffN + n > mBuff.size() )
+            Flush();
+
+        memcpy( mBuff.data() + mBuffN, pData, n );
+        mBuffN += n;
+    }
+
+    void WriteStr( const std::string &str ) { Write( str.data(), str.size() ); }
+
+    template <typename T>
+    void WriteVal( const T &val ) { Write( &val, sizeof(val) ); }
+
+    void Flush()
+    {
+        if ( mBuffN )
+            mFile.write( mBuff.data(), (std::streamsize)mBuffN );
+        mBuffN = 0;
+    }
+};
+
+//==================================================================
+// "%3i," (or "%i," for unpadded) of each byte value, to avoid a
+// printf per texel
+static const auto &texp_GetBytesAsText( bool padded )
+{
+    auto makeTab = []( bool padded )
+    {
+        std::array<std::string,256> tab;
+        for (int i=0; i < 256; ++i)
+            tab[i] = SSPrintFS( padded ? "%3i," : "%i,", i );
+        return tab;
+    };
+
+    static const std::array<std::string,256> sTabs[2] = { makeTab( false ), makeTab( true ) };
+
+    return sTabs[ padded ? 1 : 0 ];
+}
+
 //==================================================================
 static void TerrainExport(
         const Terrain &terr,
@@ -34,117 +135,167 @@ static void TerrainExport(
         const std::string &headStr,
         const int quantMaxH,
         const int quantShade,
-        const uint32_t cropWH[2] )
+        const uint32_t cropWH[2],
+        uint32_t format=TEXP_FMT_CHEADER )
 {
-    std::string str { headStr + "\n" };
-
     c_auto cropRC = TERR_MakeCropRC( terr.GetSiz(), cropWH );
     c_auto x1 = cropRC[0];
     c_auto y1 = cropRC[1];
     c_auto x2 = cropRC[2];
     c_auto y2 = cropRC[3];
 
+    c_auto wd = x2 - x1;
+    c_auto he = y2 - y1;
+
     auto forEach = [&]( c_auto &fn )
     {
         for (size_t y=y1; y < y2; ++y)
             for (size_t x=x1; x < x2; ++x)
-                fn( x + (y << terr.GetSizL2()) );
+                fn( x, y );
     };
 
-    //
-    str += SSPrintFS( "const unsigned int TERR_WD = %zu;\n", x2 - x1 );
-    str += SSPrintFS( "const unsigned int TERR_HE = %zu;\n", y2 - y1 );
-
-    //
+    // the arrays are of unsigned char
     auto quantize = []( float unitVal, int quantVal )
     {
-        return (int)std::clamp( quantVal * unitVal, 0.f, (float)quantVal );
+        quantVal = std::clamp( quantVal, 0, 255 );
+        return (uint8_t)std::clamp( quantVal * unitVal, 0.f, (float)quantVal );
     };
 
     //----------------------------------------
-    //--- dump heights
-    {
-        str += "\n";
-        str += "const unsigned char terr_heights[TERR_HE][TERR_WD] = {\n";
+    // the 3 sections, quantized, each on its own thread
+    enum { SEC_HEIGHTS, SEC_SHADES, SEC_MATES, SEC_N };
+    std::array<std::vector<uint8_t>,SEC_N> secs;
 
+    auto makeHeights = [&]( auto &out )
+    {
         // calc min/max heights to quantize
         float srcMinH =  FLT_MAX;
         float srcMaxH = -FLT_MAX;
-        forEach( [&]( c_auto cellIdx )
+        forEach( [&]( c_auto x, c_auto y )
         {
-            c_auto srcH = terr.mHeights[ cellIdx ];
+            c_auto srcH = terr.mHeights( x, y );
 
             srcMinH = std::min( srcMinH, srcH );
             srcMaxH = std::max( srcMaxH, srcH );
         });
 
-        // output quantized heights
-        c_auto ooH = 1.f / (srcMaxH - srcMinH);
-        size_t dataIdx = 0;
-        forEach( [&]( c_auto cellIdx )
+        c_auto ooH = (srcMaxH != srcMinH) ? 1.f / (srcMaxH - srcMinH) : 0.f;
+        forEach( [&]( c_auto x, c_auto y )
         {
-            c_auto srcH = terr.mHeights[ cellIdx ];
-
-            str += SSPrintFS( "%3i,", quantize( (srcH - srcMinH) * ooH, quantMaxH ) );
-
-            if NOT( ++dataIdx & 31 )
-                str += "\n";
+            out.push_back( quantize( (terr.mHeights( x, y ) - srcMinH) * ooH, quantMaxH ) );
         });
-        str += "};\n";
-    }
+    };
 
-    //----------------------------------------
-    //--- dump shading
+    auto makeShades = [&]( auto &out )
     {
-        str += "\n";
-        str += "const unsigned char terr_shades[TERR_HE][TERR_WD] = {\n";
-
-        size_t dataIdx = 0;
-        forEach( [&]( c_auto cellIdx )
+        forEach( [&]( c_auto x, c_auto y )
         {
-            c_auto dif = terr.mDiffLight[ cellIdx ] / 255.f;
-            c_auto sha = terr.mIsShadowed[ cellIdx ] ? 0.f : 1.f;
+            c_auto dif = terr.mDiffLight( x, y ) / 255.f;
+            c_auto sha = terr.IsShadowed( x, y ) ? 0.f : 1.f;
 
-            str += SSPrintFS( "%3i,", quantize( dif * sha, quantShade ) );
+            out.push_back( quantize( dif * sha, quantShade ) );
+        });
+    };
 
-            if NOT( ++dataIdx & 31 )
-                str += "\n";
+    auto makeMates = [&]( auto &out )
+    {
+        forEach( [&]( c_auto x, c_auto y )
+        {
+            out.push_back( terr.mMateID( x, y ) );
         });
-        str += "};\n";
-    }
+    };
 
-    //----------------------------------------
-    //--- dump material
+    // row deltas, then LZ
+    auto compress = [&]( auto &sec )
     {
-        str += "\n";
-        str += "const unsigned char terr_materials[TERR_HE][TERR_WD] = {\n";
+        for (size_t y=0; y < he; ++y)
+        {
+            auto *pRow = sec.data() + y * wd;
+            for (size_t x=wd; x-- > 1;)
+                pRow[x] = (uint8_t)(pRow[x] - pRow[x-1]);
+        }
+        sec = SLZ_Compress( sec.data(), sec.size() );
+    };
+
+    PF_RunJobs( SEC_N, [&]( size_t si )
+    {
+        auto &sec = secs[si];
+        sec.reserve( wd * he );
 
-        size_t dataIdx = 0;
-        forEach( [&]( c_auto cellIdx )
+        switch ( si )
         {
-            str += SSPrintFS( "%i,", (int)terr.mMateID[ cellIdx ] );
+        case SEC_HEIGHTS:   makeHeights( sec ); break;
+        case SEC_SHADES:    makeShades( sec );  break;
+        case SEC_MATES:     makeMates( sec );   break;
+        }
 
-            if NOT( ++dataIdx & 31 )
-                str += "\n";
-        });
-        str += "};\n";
-    }
+        if ( format == TEXP_FMT_DELTALZ )
+            compress( sec );
+    } );
 
     //----------------------------------------
     //--- write to file
-    std::ofstream file;
-    file.open( pathFName );
-    if NOT( file.is_open() )
+    texp_BuffWriter file( pathFName );
+    if NOT( file.IsOpen() )
     {
         printf( "** ERROR could not open %s\n", pathFName.c_str() );
         return;
     }
 
-    file << str;
-    file.close();
+    if ( format == TEXP_FMT_CHEADER )
+    {
+        file.WriteStr( headStr + "\n" );
+        file.WriteStr( SSPrintFS( "const unsigned int TERR_WD = %zu;\n", wd ) );
+        file.WriteStr( SSPrintFS( "const unsigned int TERR_HE = %zu;\n", he ) );
+
+        auto writeArray = [&]( const char *pName, const auto &sec, bool padded )
+        {
+            c_auto &tab = texp_GetBytesAsText( padded );
+
+            file.WriteStr( "\n" );
+            file.WriteStr( SSPrintFS( "const unsigned char %s[TERR_HE][TERR_WD] = {\n", pName ) );
+            for (size_t i=0; i < sec.size(); ++i)
+            {
+                file.WriteStr( tab[ sec[i] ] );
+
+                if NOT( (i + 1) & 31 )
+                    file.WriteStr( "\n" );
+            }
+            file.WriteStr( "};\n" );
+        };
+
+        writeArray( "terr_heights",   secs[SEC_HEIGHTS], true );
+        writeArray( "terr_shades",    secs[SEC_SHADES],  true );
+        writeArray( "terr_materials", secs[SEC_MATES],   false );
+    }
+    else
+    {
+        TerrainExportBinHeader head {};
+        memcpy( head.magic, "TERX", 4 );
+        head.version    = TEXP_BIN_VERSION;
+        head.format     = format;
+        head.wd         = (uint32_t)wd;
+        head.he         = (uint32_t)he;
+        head.headStrLen = (uint32_t)headStr.size();
+
+        file.WriteVal( head );
+        file.WriteStr( headStr );
+
+        for (c_auto &sec : secs)
+        {
+            file.WriteVal( (uint32_t)sec.size() );
+            file.Write( sec.data(), sec.size() );
+        }
+    }
+
+    file.Flush();
+    if NOT( file.IsGood() )
+    {
+        printf( "** ERROR failed writing %s\n", pathFName.c_str() );
+        return;
+    }
 
     printf( "** Successfully exported to %s\n", pathFName.c_str() );
 }
 
 #endif
-
@@ -9,31 +9,61 @@
 #ifndef TERRAINGEN_H
 #define TERRAINGEN_H
 
+#include <string.h>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define TGEN_SSE
+#endif
 #include "DBase.h"
 #include "MathBase.h"
+#include "ParallelFor.h"
 #include "MU_ParallelOcclChecker.h"
+#include "MU_WrapMap.h"
 #include "Terrain.h"
 
+// side of the square tiles used by TGEN_BakeTiled() (log2)
+static constexpr size_t TGEN_TILE_L2 = 6;
+
+//==================================================================
+// runs fn( x0, y0, x1, y1 ) for each tile of the map, in parallel
+template <typename FN>
+static void tgen_ForTiles( size_t sizL2, const FN &fn )
+{
+    c_auto siz = (size_t)1 << sizL2;
+    c_auto tileSiz = (size_t)1 << std::min( sizL2, TGEN_TILE_L2 );
+
+    M2D_ForTiles( siz, siz, tileSiz, tileSiz, fn );
+}
+
 //==================================================================
 static void TGEN_ScaleHeights( auto &terr, float newMin, float newMax )
 {
-    auto *p = terr.mHeights.data();
-    c_auto n = (size_t)1 << ((int)terr.mSizeL2 * 2);
+    auto &heights = terr.mHeights;
+    c_auto siz = terr.GetSiz();
 
     float mi =  FLT_MAX;
     float ma = -FLT_MAX;
-    for (size_t i=0; i < n; ++i)
+    for (size_t y=0; y < siz; ++y)
     {
-        mi = std::min( mi, p[i] );
-        ma = std::max( ma, p[i] );
+        c_auto *pRow = heights.Row( y );
+        for (size_t x=0; x < siz; ++x)
+        {
+            mi = std::min( mi, pRow[x] );
+            ma = std::max( ma, pRow[x] );
+        }
     }
 
     // rescale and offset
     c_auto scaToNew = (ma != mi) ? ((newMax - newMin) / (ma - mi)) : 0.f;
-    for (size_t i=0; i < n; ++i)
-        p[i] = newMin + (p[i] - mi) * scaToNew;
+    for (size_t y=0; y < siz; ++y)
+    {
+        auto *pRow = heights.Row( y );
+        for (size_t x=0; x < siz; ++x)
+            pRow[x] = newMin + (pRow[x] - mi) * scaToNew;
+    }
 
     // update the terrain values
     terr.mMinH = newMin;
@@ -48,110 +78,280 @@ inline auto remapRange( c_auto &v, c_auto &srcL, c_auto &srcR, c_auto &desL, c_a
 }
 
 //==================================================================
-static void TGEN_MakeMateAndTex( auto &terr )
+inline void tgen_MakeMateAndTexAt( auto &terr, size_t x, size_t y )
 {
-    for (size_t i=0; i < terr.mHeights.size(); ++i)
-    {
-        auto &h = terr.mHeights[i];
+    c_auto h = terr.mHeights( x, y );
 
-        // material
-        terr.mMateID[ i ] = (h >= 0 ? MATEID_LAND : MATEID_SEA);
+    // material
+    auto &mate = terr.mMateID( x, y );
+    mate = (h >= 0 ? MATEID_LAND : MATEID_SEA);
 
-        // only build a "texture" for the sea
-        terr.mTexMono[ i ] = terr.mMateID[ i ] == MATEID_LAND
-                ? 255
-                : (uint8_t)remapRange( h, terr.mMinH, 0, 40.f, 255.f );
-    }
+    // only build a "texture" for the sea
+    terr.mTexMono( x, y ) = mate == MATEID_LAND
+            ? 255
+            : (uint8_t)remapRange( h, terr.mMinH, 0, 40.f, 255.f );
+}
+
+//==================================================================
+static void TGEN_MakeMateAndTex( auto &terr )
+{
+    c_auto siz = terr.GetSiz();
+    for (size_t y=0; y < siz; ++y)
+        for (size_t x=0; x < siz; ++x)
+            tgen_MakeMateAndTexAt( terr, x, y );
 }
 
 //==================================================================
 static void TGEN_FlattenSeaBed( auto &terr )
 {
-    for (auto &h : terr.mHeights)
-        h = std::max( h, 0.f );
+    c_auto siz = terr.GetSiz();
+    for (size_t y=0; y < siz; ++y)
+    {
+        auto *pRow = terr.mHeights.Row( y );
+        for (size_t x=0; x < siz; ++x)
+            pRow[x] = std::max( pRow[x], 0.f );
+    }
+}
+
+//==================================================================
+// packs n bytes (0 or not) into bits, 64 per word
+inline void tgen_PackBits( uint64_t *pDst, const uint8_t *pSrc, size_t n )
+{
+    // the last partial word
+    if ( c_auto tailN = n & 63 )
+    {
+        uint64_t bits = 0;
+        for (size_t j=0; j < tailN; ++j)
+            bits |= (uint64_t)(pSrc[n - tailN + j] != 0) << j;
+        pDst[n / 64] = bits;
+    }
+
+    PF_ForRange( n / 64, 1024, [&]( size_t sta, size_t end )
+    {
+        for (size_t wi=sta; wi < end; ++wi)
+        {
+            c_auto *pS = pSrc + wi * 64;
+#if defined(TGEN_SSE)
+            c_auto zero = _mm_setzero_si128();
+            uint64_t zeroBits = 0;
+            for (size_t j=0; j < 4; ++j)
+            {
+                c_auto v = _mm_loadu_si128( (const __m128i *)(pS + j * 16) );
+                zeroBits |= (uint64_t)(uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( v, zero ) ) << (j * 16);
+            }
+            pDst[wi] = ~zeroBits;
+#else
+            uint64_t bits = 0;
+            for (size_t j=0; j < 64; ++j)
+                bits |= (uint64_t)(pS[j] != 0) << j;
+            pDst[wi] = bits;
+#endif
+        }
+    } );
 }
 
 //==================================================================
 // geenrate colors and flatten the heights below sea level
-static void TGEN_CalcShadows( auto &terr, Float3 lightDirLS )
+// with the horizon sweep, that can differ from a march per texel on the
+// shadow edges. exact is for the march, as a reference, it's O(N^3)
+static void TGEN_CalcShadows( auto &terr, Float3 lightDirLS, bool exact=false )
 {
     lightDirLS = glm::normalize( lightDirLS );
 
     auto checker = MU_ParallelOcclChecker(
-                        terr.mHeights.data(),
+                        terr.mHeights.GetView(),
                         lightDirLS,
                         terr.mMinH,
-                        terr.mMaxH,
-                        terr.mSizeL2 );
+                        terr.mMaxH );
+
+    // bytes, so that threads can write freely
+    std::vector<uint8_t> isOccl( terr.GetSiz() * terr.GetSiz() );
 
-    c_auto siz = (int)terr.GetSiz();
-    size_t cellIdx = 0;
-	for (int yi=0; yi < siz; ++yi)
-	{
-        for (int xi=0; xi < siz; ++xi, ++cellIdx)
-		{
-            terr.mIsShadowed[cellIdx] = checker.IsOccludedAtPoint( xi, yi );
-		}
-	}
+    if ( exact )
+        checker.CalcAllOccluded( isOccl.data() );
+    else
+        checker.CalcAllOccludedApprox( isOccl.data() );
+
+    tgen_PackBits( terr.mShadowBits.data(), isOccl.data(), isOccl.size() );
 }
 
 //==================================================================
-static void TGEN_CalcDiffLight( auto &terr, Float3 lightDirLS )
+// 1 / sqrt( v ). With SSE, the estimate and a Newton step, as done by
+// tgen_CalcDiffRow() 8 at a time, so that both give the same result
+inline float tgen_RSqrt( float v )
 {
-    lightDirLS = glm::normalize( lightDirLS );
-#if 1
-    c_auto siz = (int)terr.GetSiz();
-
-    c_auto ix1 = (size_t)0;
-    c_auto ix2 = (size_t)siz;
-    c_auto iy1 = (size_t)0;
-    c_auto iy2 = (size_t)siz;
-
-    c_auto &heights = terr.mHeights;
-      auto &diffLight = terr.mDiffLight;
-
-    c_auto &shadows = terr.mIsShadowed;
+#if defined(TGEN_SSE)
+    c_auto r0 = _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss( v ) ) );
+    return r0 * (1.5f - 0.5f * v * r0 * r0);
+#else
+    return 1.f / sqrtf( v );
+#endif
+}
 
+//==================================================================
+// diffuse term (0..255) of the cell at c00 of the row pRow0, using its
+// right and bottom neighbors, pRow1 being the next row. Those of the
+// last row and column are in the halo of the map. The normal can go
+// to pOutNor
+inline uint8_t tgen_CalcDiffAt(
+                    const float *pRow0,
+                    const float *pRow1,
+                    size_t siz,
+                    size_t c00,
+                    const Float3 &lightDirLS,
+                    Float3 *pOutNor=nullptr )
+{
     c_auto cellUnit = 1.f / siz;
     c_auto y = -2 * cellUnit;
     c_auto ySqrt = y * y;
 
-    for (auto iy=iy1, r00=iy1*siz; iy < iy2; ++iy, r00 += siz)
-    {
-        c_auto r10 = (iy == siz-1) ? (size_t)0 : r00 + siz;
+    c_auto a = pRow0[c00+0];    // a----b
+    c_auto b = pRow0[c00+1];    // |    |
+    c_auto c = pRow1[c00+0];    // |    |
+    c_auto d = pRow1[c00+1];    // c----d
 
-        for (auto c00=ix1; c00 < ix2; ++c00)
-        {
-            c_auto c01 = (c00 == siz-1) ? (size_t)0 : c00 + 1;
+    c_auto dh1 = b - a;
+    c_auto dv1 = c - a;
+    c_auto dh2 = c - d;
+    c_auto dv2 = b - d;
+
+    c_auto x = (float)(dh1 - dh2);
+    c_auto z = (float)(dv1 - dv2);
+
+    c_auto nOoMag = -tgen_RSqrt( x * x + ySqrt + z * z );
+
+    c_auto nor = nOoMag * Float3( x, y, z );
+
+    if ( pOutNor )
+        *pOutNor = nor;
+
+    c_auto NdotL = glm::dot( nor, lightDirLS );
+
+    return (uint8_t)std::clamp( std::max( NdotL * 255.f, 0.f ), 0.f, 255.f );
+}
+
+//==================================================================
+// tgen_CalcDiffAt() for the cells [x0, x1) of the row y, to the rows
+// pOutDiff and pOutNor (if not null), indexed by x.
+// The heights wrap through their halo, see Map2D::WrapHalo(), so the
+// edges take the same path, 8 cells at a time
+inline void tgen_CalcDiffRow(
+                    const Map2D<float> &heights,
+                    size_t y,
+                    size_t x0,
+                    size_t x1,
+                    const Float3 &lightDirLS,
+                    uint8_t *pOutDiff,
+                    Float3 *pOutNor )
+{
+    assert( heights.GetHalo() >= 1 );
+
+    c_auto siz = heights.GetW();
+    c_auto *pRow0 = heights.Row( y );
+    c_auto *pRow1 = heights.Row( y + 1 );
 
-            c_auto a = heights[r00+c00];    // a----b
-            c_auto b = heights[r00+c01];    // |    |
-            c_auto c = heights[r10+c00];    // |    |
-            c_auto d = heights[r10+c01];    // c----d
+    size_t x = x0;
+#if defined(TGEN_SSE)
+    c_auto cellUnit = 1.f / siz;
+    c_auto ny = -2 * cellUnit;
+
+    c_auto vy     = _mm_set1_ps( ny );
+    c_auto vySqr  = _mm_set1_ps( ny * ny );
+    c_auto vlx    = _mm_set1_ps( lightDirLS[0] );
+    c_auto vly    = _mm_set1_ps( lightDirLS[1] );
+    c_auto vlz    = _mm_set1_ps( lightDirLS[2] );
+    c_auto vhalf  = _mm_set1_ps( 0.5f );
+    c_auto v1_5   = _mm_set1_ps( 1.5f );
+    c_auto v255   = _mm_set1_ps( 255.f );
+    c_auto vzero  = _mm_setzero_ps();
+    c_auto vsign  = _mm_set1_ps( -0.f );
+
+    auto calc4 = [&]( size_t cx, Float3 *pNor )
+    {
+        c_auto a = _mm_loadu_ps( pRow0 + cx );
+        c_auto b = _mm_loadu_ps( pRow0 + cx + 1 );
+        c_auto c = _mm_loadu_ps( pRow1 + cx );
+        c_auto d = _mm_loadu_ps( pRow1 + cx + 1 );
 
-            c_auto dh1 = b - a;
-            c_auto dv1 = c - a;
-            c_auto dh2 = c - d;
-            c_auto dv2 = b - d;
+        c_auto nx = _mm_sub_ps( _mm_sub_ps( b, a ), _mm_sub_ps( c, d ) );
+        c_auto nz = _mm_sub_ps( _mm_sub_ps( c, a ), _mm_sub_ps( b, d ) );
 
-            c_auto x = (float)(dh1 - dh2);
-            c_auto z = (float)(dv1 - dv2);
+        c_auto lenSqr = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, nx ), vySqr ), _mm_mul_ps( nz, nz ) );
 
-            c_auto nOoMag = -1.f / sqrtf( x * x + ySqrt + z * z );
+        // rsqrt and a Newton step, as tgen_RSqrt()
+        c_auto r0 = _mm_rsqrt_ps( lenSqr );
+        c_auto r1 = _mm_mul_ps( r0, _mm_sub_ps( v1_5,
+                        _mm_mul_ps( _mm_mul_ps( _mm_mul_ps( vhalf, lenSqr ), r0 ), r0 ) ) );
 
-            c_auto nor = nOoMag * Float3( x, y, z );
+        c_auto nOoMag = _mm_xor_ps( r1, vsign );
 
-            c_auto NdotL = glm::dot( nor, lightDirLS );
+        c_auto norX = _mm_mul_ps( nOoMag, nx );
+        c_auto norY = _mm_mul_ps( nOoMag, vy );
+        c_auto norZ = _mm_mul_ps( nOoMag, nz );
 
-            diffLight[ r00 + c00 ] =
-                (uint8_t)std::clamp( std::max( NdotL * 255.f, 0.f ), 0.f, 255.f );
+        if ( pNor )
+        {
+            alignas(16) float xs[4], ys[4], zs[4];
+            _mm_store_ps( xs, norX );
+            _mm_store_ps( ys, norY );
+            _mm_store_ps( zs, norZ );
+            for (size_t i=0; i < 4; ++i)
+                pNor[i] = Float3( xs[i], ys[i], zs[i] );
         }
+
+        // same order as glm::dot()
+        c_auto NdotL = _mm_add_ps(
+                            _mm_add_ps( _mm_mul_ps( norX, vlx ), _mm_mul_ps( norY, vly ) ),
+                            _mm_mul_ps( norZ, vlz ) );
+
+        return _mm_cvttps_epi32( _mm_min_ps( _mm_max_ps( _mm_mul_ps( NdotL, v255 ), vzero ), v255 ) );
+    };
+
+    for (; (x + 8) <= x1; x += 8)
+    {
+        c_auto lo = calc4( x + 0, pOutNor ? pOutNor + x + 0 : nullptr );
+        c_auto hi = calc4( x + 4, pOutNor ? pOutNor + x + 4 : nullptr );
+
+        // 8 x int32 to 8 x uint8
+        c_auto u8 = _mm_packus_epi16( _mm_packs_epi32( lo, hi ), _mm_setzero_si128() );
+        _mm_storel_epi64( (__m128i *)(pOutDiff + x), u8 );
     }
 #endif
+    // what's left (or everything, without SIMD)
+    for (; x < x1; ++x)
+        pOutDiff[ x ] = tgen_CalcDiffAt(
+                            pRow0, pRow1, siz, x, lightDirLS,
+                            pOutNor ? pOutNor + x : nullptr );
 }
 
 //==================================================================
-static void TGEN_CalcBakedColors( auto &terr, const Float3 &lightDif, const Float3 &amb )
+static void TGEN_CalcDiffLight( auto &terr, Float3 lightDirLS, bool keepNormals=false )
+{
+    lightDirLS = glm::normalize( lightDirLS );
+
+    c_auto siz = terr.GetSiz();
+
+    if ( keepNormals )
+        terr.mNormals.SetupPacked( siz, siz );
+    else
+        terr.mNormals.Clear();
+
+    // the neighbors of the edges
+    terr.mHeights.WrapHalo();
+
+    PF_ForRange( siz, 16, [&]( size_t sta, size_t end )
+    {
+        for (size_t iy=sta; iy < end; ++iy)
+            tgen_CalcDiffRow(
+                terr.mHeights, iy, 0, siz, lightDirLS,
+                terr.mDiffLight.Row( iy ),
+                keepNormals ? terr.mNormals.Row( iy ) : nullptr );
+    } );
+}
+
+//==================================================================
+inline RBColType tgen_CalcBakedColAt(
+                    const auto &terr, size_t x, size_t y, const Float3 &lightDif, const Float3 &amb )
 {
     auto makeU8 = []( c_auto valf ) -> std::array<uint8_t,3>
     {
@@ -162,18 +362,291 @@ static void TGEN_CalcBakedColors( auto &terr, const Float3 &lightDif, const Floa
                  (uint8_t)valf8[2] };
     };
 
-    for (size_t i=0; i < terr.mHeights.size(); ++i)
+    c_auto chr = (terr.mMateID( x, y ) == MATEID_LAND ? CHROM_LAND : CHROM_SEA);
+    c_auto tex = (terr.mTexMono( x, y ) * (1.f/255));
+    c_auto dif = (terr.mDiffLight( x, y ) * (1.f/255));
+    c_auto sha = (terr.IsShadowed( x, y ) ? 0.0f : 1.f);
+
+    c_auto colU8 = makeU8( chr * tex * (amb + lightDif * dif * sha) );
+
+    return { colU8[0], colU8[1], colU8[2], 255 };
+}
+
+//==================================================================
+// same as tgen_CalcBakedColAt() for the texels [x0, x1) of the row y,
+// 4 at a time. Same operations in the same order, so that the results
+// are identical
+inline void tgen_CalcBakedColsRow(
+                    auto &terr, size_t y, size_t x0, size_t x1, const Float3 &lightDif, const Float3 &amb )
+{
+    size_t x = x0;
+#if defined(TGEN_SSE)
+    c_auto *pMate = terr.mMateID.Row( y );
+    c_auto *pTex  = terr.mTexMono.Row( y );
+    c_auto *pDif  = terr.mDiffLight.Row( y );
+    c_auto *pSha  = terr.mShadowBits.data();
+    auto   *pCol  = terr.mBakedCols.Row( y );
+
+    // of the shadow bits
+    c_auto r00 = y << terr.GetSizL2();
+
+    // 4 bytes to 4 floats
+    auto loadU8x4 = []( const uint8_t *p )
+    {
+        int32_t v;
+        memcpy( &v, p, 4 );
+        c_auto zero = _mm_setzero_si128();
+        c_auto v16 = _mm_unpacklo_epi8( _mm_cvtsi32_si128( v ), zero );
+        return _mm_unpacklo_epi16( v16, zero );
+    };
+
+    c_auto oo255   = _mm_set1_ps( 1.f/255 );
+    c_auto v255    = _mm_set1_ps( 255.f );
+    c_auto vzero   = _mm_setzero_ps();
+    c_auto shaBits = _mm_setr_epi32( 1, 2, 4, 8 );
+    c_auto landID  = _mm_set1_epi32( MATEID_LAND );
+
+    // up to the first 4-aligned texel, so that the 4 shadow bits are
+    // in the same word
+    for (; x < x1 && ((r00 + x) & 3); ++x)
+        pCol[x] = tgen_CalcBakedColAt( terr, x, y, lightDif, amb );
+
+    for (; (x + 4) <= x1; x += 4)
     {
-        c_auto chr = (terr.mMateID[i] == MATEID_LAND ? CHROM_LAND : CHROM_SEA);
-        c_auto tex = (terr.mTexMono[i] * (1.f/255));
-        c_auto dif = (terr.mDiffLight[i] * (1.f/255));
-        c_auto sha = (terr.mIsShadowed[i] ? 0.0f : 1.f);
+        c_auto isLand = _mm_castsi128_ps( _mm_cmpeq_epi32( loadU8x4( pMate + x ), landID ) );
+        c_auto tex    = _mm_mul_ps( _mm_cvtepi32_ps( loadU8x4( pTex + x ) ), oo255 );
+        c_auto dif    = _mm_mul_ps( _mm_cvtepi32_ps( loadU8x4( pDif + x ) ), oo255 );
+
+        // lit where the shadow bit is clear
+        c_auto i = r00 + x;
+        c_auto shaNib = _mm_set1_epi32( (int)((pSha[i >> 6] >> (i & 63)) & 15) );
+        c_auto isLit  = _mm_castsi128_ps(
+                            _mm_cmpeq_epi32( _mm_and_si128( shaNib, shaBits ), _mm_setzero_si128() ) );
+        c_auto sha    = _mm_and_ps( isLit, _mm_set1_ps( 1.f ) );
+
+        __m128i chans[3];
+        for (int c=0; c < 3; ++c)
+        {
+            c_auto chr = _mm_or_ps(
+                            _mm_and_ps( isLand, _mm_set1_ps( CHROM_LAND[c] ) ),
+                            _mm_andnot_ps( isLand, _mm_set1_ps( CHROM_SEA[c] ) ) );
 
-        c_auto colU8 = makeU8( chr * tex * (amb + lightDif * dif * sha) );
+            // chr * tex * (amb + lightDif * dif * sha)
+            c_auto lit = _mm_add_ps(
+                            _mm_set1_ps( amb[c] ),
+                            _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( lightDif[c] ), dif ), sha ) );
 
-        // assign the final color
-        terr.mBakedCols[i] = { colU8[0], colU8[1], colU8[2], 255 };
+            c_auto val = _mm_mul_ps( v255, _mm_mul_ps( _mm_mul_ps( chr, tex ), lit ) );
+
+            chans[c] = _mm_cvttps_epi32( _mm_min_ps( _mm_max_ps( val, vzero ), v255 ) );
+        }
+
+        // RGBA8, alpha at 255
+        c_auto rgba = _mm_or_si128(
+                        _mm_or_si128( chans[0], _mm_slli_epi32( chans[1], 8 ) ),
+                        _mm_or_si128( _mm_slli_epi32( chans[2], 16 ),
+                                      _mm_set1_epi32( (int)0xff000000 ) ) );
+
+        static_assert( sizeof(pCol[0]) == 4 );
+        _mm_storeu_si128( (__m128i *)(pCol + x), rgba );
     }
+#endif
+    // what's left (or everything, without SIMD)
+    for (; x < x1; ++x)
+        terr.mBakedCols( x, y ) = tgen_CalcBakedColAt( terr, x, y, lightDif, amb );
+}
+
+//==================================================================
+static void TGEN_CalcBakedColors( auto &terr, const Float3 &lightDif, const Float3 &amb )
+{
+    c_auto siz = terr.GetSiz();
+    for (size_t y=0; y < siz; ++y)
+        tgen_CalcBakedColsRow( terr, y, 0, siz, lightDif, amb );
+}
+
+//==================================================================
+struct TGEN_BakeParams
+{
+    float       minH        {};
+    float       maxH        {};
+    bool        wrapEdges   {};
+    bool        enableDiff  {true};
+    bool        enableSha   {true};
+    bool        exactSha    {};         // a march per texel, as a reference
+    bool        keepNormals {};         // fill Terrain::mNormals with the diffuse
+    Float3      lightDirLS  {0,1,0};
+    Float3      lightDif    {1,1,1};
+    Float3      lightAmb    {0,0,0};
+};
+
+// stages of TGEN_BakeTiled(), each one depends on those before it
+enum : uint32_t
+{
+    TGEN_STAGE_SHAPE    = 1 << 0,   // heights rescale and wrap, materials
+    TGEN_STAGE_DIFF     = 1 << 1,   // diffuse term
+    TGEN_STAGE_SHA      = 1 << 2,   // shadows
+    TGEN_STAGE_COLS     = 1 << 3,   // baked colors
+    TGEN_STAGE_ALL      = (1 << 4) - 1,
+};
+
+//==================================================================
+// the stages to redo to go from the bake of oldPar to the one of newPar
+inline uint32_t TGEN_CalcDirtyStages( const TGEN_BakeParams &oldPar, const TGEN_BakeParams &newPar )
+{
+    uint32_t stages = 0;
+
+    if ( oldPar.minH != newPar.minH ||
+         oldPar.maxH != newPar.maxH ||
+         oldPar.wrapEdges != newPar.wrapEdges )
+        stages |= TGEN_STAGE_ALL;
+
+    c_auto lightMoved = oldPar.lightDirLS != newPar.lightDirLS;
+
+    if ( lightMoved ||
+         oldPar.enableDiff != newPar.enableDiff ||
+         oldPar.keepNormals != newPar.keepNormals )
+        stages |= TGEN_STAGE_DIFF | TGEN_STAGE_COLS;
+
+    if ( lightMoved ||
+         oldPar.enableSha != newPar.enableSha ||
+         oldPar.exactSha != newPar.exactSha )
+        stages |= TGEN_STAGE_SHA | TGEN_STAGE_COLS;
+
+    if ( oldPar.lightDif != newPar.lightDif ||
+         oldPar.lightAmb != newPar.lightAmb )
+        stages |= TGEN_STAGE_COLS;
+
+    return stages;
+}
+
+//==================================================================
+/// Same result as running the TGEN_* passes one by one, but the
+/// per-texel stages are fused and run by tiles on all cores. Only the
+/// min/max reduction, the edges wrapping and the shadows need the
+/// whole map, and stay separate stages.
+/// Stages not in the stages mask are assumed to be still valid from a
+/// previous bake. TGEN_STAGE_SHAPE expects the unscaled heights.
+static void TGEN_BakeTiled( auto &terr, const TGEN_BakeParams &par, uint32_t stages=TGEN_STAGE_ALL )
+{
+    c_auto sizL2 = terr.GetSizL2();
+    c_auto siz   = terr.GetSiz();
+    auto &heights = terr.mHeights;
+
+    if ( stages & TGEN_STAGE_SHAPE )
+    {
+        // min/max, by tiles
+        std::mutex mtx;
+        float mi =  FLT_MAX;
+        float ma = -FLT_MAX;
+        tgen_ForTiles( sizL2, [&]( size_t x0, size_t y0, size_t x1, size_t y1 )
+        {
+            float tmi =  FLT_MAX;
+            float tma = -FLT_MAX;
+            for (size_t y=y0; y < y1; ++y)
+            {
+                c_auto *pRow = heights.Row( y );
+                for (size_t x=x0; x < x1; ++x)
+                {
+                    tmi = std::min( tmi, pRow[x] );
+                    tma = std::max( tma, pRow[x] );
+                }
+            }
+
+            std::lock_guard lock( mtx );
+            mi = std::min( mi, tmi );
+            ma = std::max( ma, tma );
+        } );
+
+        terr.mMinH = par.minH;
+        terr.mMaxH = par.maxH;
+
+        c_auto scaToNew = (ma != mi) ? ((par.maxH - par.minH) / (ma - mi)) : 0.f;
+
+        // rescale, material, texture and sea bed flattening
+        auto heightsStage = [&]( bool doScale, bool doMate )
+        {
+            tgen_ForTiles( sizL2, [&]( size_t x0, size_t y0, size_t x1, size_t y1 )
+            {
+                for (size_t y=y0; y < y1; ++y)
+                {
+                    auto *pRow = heights.Row( y );
+                    for (size_t x=x0; x < x1; ++x)
+                    {
+                        auto &h = pRow[x];
+
+                        if ( doScale )
+                            h = par.minH + (h - mi) * scaToNew;
+
+                        if ( doMate )
+                        {
+                            tgen_MakeMateAndTexAt( terr, x, y );
+                            h = std::max( h, 0.f );
+                        }
+                    }
+                }
+            } );
+        };
+
+        // the wrapping needs the whole scaled map, before the rest
+        if ( par.wrapEdges )
+        {
+            heightsStage( true, false );
+            MU_WrapMap( heights, siz / 3 );
+            heightsStage( false, true );
+        }
+        else
+            heightsStage( true, true );
+    }
+
+    c_auto lightDirLS = glm::normalize( par.lightDirLS );
+
+    if ( stages & TGEN_STAGE_SHA )
+    {
+        if ( par.enableSha )
+            TGEN_CalcShadows( terr, lightDirLS, par.exactSha );
+        else
+            std::fill( terr.mShadowBits.begin(), terr.mShadowBits.end(), 0 );
+    }
+
+    c_auto doDiff = (stages & TGEN_STAGE_DIFF) != 0;
+    c_auto doCols = (stages & TGEN_STAGE_COLS) != 0;
+
+    if ( doDiff && NOT( par.enableDiff ) )
+        terr.mDiffLight.Fill( 1 );
+
+    if NOT( (doDiff && par.enableDiff) || doCols )
+        return;
+
+    // normals, if asked, come with the diffuse term
+    if ( doDiff )
+    {
+        if ( par.enableDiff && par.keepNormals )
+            terr.mNormals.SetupPacked( siz, siz );
+        else
+            terr.mNormals.Clear();
+    }
+
+    c_auto hasNor = NOT( terr.mNormals.IsEmpty() );
+
+    // the neighbors of the edges, for the diffuse
+    if ( doDiff && par.enableDiff )
+        heights.WrapHalo();
+
+    // diffuse and final color
+    tgen_ForTiles( sizL2, [&]( size_t x0, size_t y0, size_t x1, size_t y1 )
+    {
+        for (size_t y=y0; y < y1; ++y)
+        {
+            if ( doDiff && par.enableDiff )
+                tgen_CalcDiffRow(
+                    heights, y, x0, x1, lightDirLS,
+                    terr.mDiffLight.Row( y ),
+                    hasNor ? terr.mNormals.Row( y ) : nullptr );
+
+            if ( doCols )
+                tgen_CalcBakedColsRow( terr, y, x0, x1, par.lightDif, par.lightAmb );
+        }
+    } );
 }
 
 #endif
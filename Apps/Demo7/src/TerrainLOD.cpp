@@ -0,0 +1,368 @@
+//==================================================================
+/// TerrainLOD.cpp
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include "TerrainLOD.h"
+
+//==================================================================
+static bool isBoxOutOfView( const Matrix44 &xform, const Float3 &bmin, const Float3 &bmax )
+{
+    // out-codes, a plane culls the box if all the verts are outside of it
+    uint32_t andCode = 0x3f;
+    for (size_t i=0; i < 8; ++i)
+    {
+        c_auto v = Float3( (i & 1) ? bmax[0] : bmin[0],
+                           (i & 2) ? bmax[1] : bmin[1],
+                           (i & 4) ? bmax[2] : bmin[2] );
+
+        c_auto h = xform * glm::vec4( v, 1.f );
+
+        uint32_t code = 0;
+        if ( h[0] < -h[3] ) code |= 1 << 0;
+        if ( h[0] >  h[3] ) code |= 1 << 1;
+        if ( h[1] < -h[3] ) code |= 1 << 2;
+        if ( h[1] >  h[3] ) code |= 1 << 3;
+        if ( h[2] < -h[3] ) code |= 1 << 4;
+        if ( h[2] >  h[3] ) code |= 1 << 5;
+
+        andCode &= code;
+    }
+    return andCode != 0;
+}
+
+//==================================================================
+// cellsN x cellsN cells. On the stitched edges, the odd vertices are
+// collapsed onto an even neighbor, so that the edge only uses the
+// vertices of the next coarser level. The collapse goes toward the
+// (0,0) corner on the negative edges and toward (n,n) on the positive
+// ones, away from the diagonal of the quads, so that no triangle flips
+std::vector<uint32_t> TerrainLOD::makeIdxTab( size_t cellsN, uint32_t edges )
+{
+    c_auto n = cellsN;
+
+    // no odd vertices to remove
+    if ( n < 2 )
+        edges = 0;
+
+    auto vidx = [&]( size_t i, size_t j ) -> uint32_t
+    {
+        if ( (edges & EDGE_XN) && i == 0 && (j & 1) ) --j;
+        if ( (edges & EDGE_XP) && i == n && (j & 1) ) ++j;
+        if ( (edges & EDGE_YN) && j == 0 && (i & 1) ) --i;
+        if ( (edges & EDGE_YP) && j == n && (i & 1) ) ++i;
+        return (uint32_t)(j * (n + 1) + i);
+    };
+
+    std::vector<uint32_t> idx;
+    idx.reserve( n * n * 6 );
+
+    auto addTri = [&]( uint32_t a, uint32_t b, uint32_t c )
+    {
+        // collapsed ones are gone
+        if ( a == b || b == c || c == a )
+            return;
+
+        idx.push_back( a );
+        idx.push_back( b );
+        idx.push_back( c );
+    };
+
+    for (size_t j=0; j < n; ++j)
+    {
+        for (size_t i=0; i < n; ++i)
+        {
+            // same split as ImmGL_MakeQuadOfTrigs()
+            c_auto i00 = vidx( i+0, j+0 );
+            c_auto i01 = vidx( i+1, j+0 );
+            c_auto i10 = vidx( i+0, j+1 );
+            c_auto i11 = vidx( i+1, j+1 );
+            addTri( i00, i01, i10 );
+            addTri( i10, i01, i11 );
+        }
+    }
+
+    return idx;
+}
+
+//==================================================================
+void TerrainLOD::Setup( const Terrain &terr, float sca )
+{
+    mpTerr = &terr;
+    mSca = sca;
+    mChunks.clear();
+    mIdxTabs.clear();
+
+    c_auto sizL2 = terr.GetSizL2();
+    c_auto siz = terr.GetSiz();
+
+    if ( siz < 2 )
+        return;
+
+    mChunkL2 = std::min( CHUNK_L2, sizL2 );
+    mChunksPerSideL2 = sizL2 - mChunkL2;
+
+    c_auto chunkSiz = (size_t)1 << mChunkL2;
+
+    for (int lev=0; lev < getLevelsN(); ++lev)
+        for (uint32_t edges=0; edges <= EDGE_ALL; ++edges)
+            mIdxTabs.push_back( makeIdxTab( chunkSiz >> lev, edges ) );
+
+    c_auto chunksPerSide = (size_t)1 << mChunksPerSideL2;
+    mChunks.resize( chunksPerSide * chunksPerSide );
+
+    for (size_t cy=0; cy < chunksPerSide; ++cy)
+        for (size_t cx=0; cx < chunksPerSide; ++cx)
+            updateChunkBounds( cx, cy );
+}
+
+//==================================================================
+void TerrainLOD::UpdateRect( size_t x0, size_t y0, size_t x1, size_t y1 )
+{
+    if ( mChunks.empty() || x0 >= x1 || y0 >= y1 )
+        return;
+
+    // a chunk also uses the first samples of the next one
+    c_auto chunksPerSide = (size_t)1 << mChunksPerSideL2;
+    c_auto cx0 = (x0 ? x0 - 1 : 0) >> mChunkL2;
+    c_auto cy0 = (y0 ? y0 - 1 : 0) >> mChunkL2;
+    c_auto cx1 = std::min( ((x1 - 1) >> mChunkL2) + 1, chunksPerSide );
+    c_auto cy1 = std::min( ((y1 - 1) >> mChunkL2) + 1, chunksPerSide );
+
+    for (size_t cy=cy0; cy < cy1; ++cy)
+    {
+        for (size_t cx=cx0; cx < cx1; ++cx)
+        {
+            updateChunkBounds( cx, cy );
+
+            // rebuilt at the next draw
+            auto &chunk = mChunks[ (cy << mChunksPerSideL2) + cx ];
+            chunk.oList = {};
+            chunk.listLevel = -1;
+        }
+    }
+}
+
+//==================================================================
+void TerrainLOD::updateChunkBounds( size_t cx, size_t cy )
+{
+    c_auto &terr = *mpTerr;
+    c_auto siz = terr.GetSiz();
+    c_auto oosiz = 1.f / siz;
+
+    c_auto chunkSiz = (size_t)1 << mChunkL2;
+
+    // samples used by the chunk, the last ones clamped to the map
+    c_auto x0 = cx << mChunkL2;
+    c_auto y0 = cy << mChunkL2;
+    c_auto x1 = std::min( x0 + chunkSiz, siz - 1 );
+    c_auto y1 = std::min( y0 + chunkSiz, siz - 1 );
+
+    float minH =  FLT_MAX;
+    float maxH = -FLT_MAX;
+    for (size_t y=y0; y <= y1; ++y)
+    {
+        c_auto *pRow = terr.mHeights.Row( y );
+        for (size_t x=x0; x <= x1; ++x)
+        {
+            minH = std::min( minH, pRow[x] );
+            maxH = std::max( maxH, pRow[x] );
+        }
+    }
+
+    auto &chunk = mChunks[ (cy << mChunksPerSideL2) + cx ];
+    chunk.bmin = mSca * Float3( glm::mix( -0.5f, 0.5f, x0 * oosiz ),
+                                minH,
+                                glm::mix( -0.5f, 0.5f, y0 * oosiz ) );
+    chunk.bmax = mSca * Float3( glm::mix( -0.5f, 0.5f, x1 * oosiz ),
+                                maxH,
+                                glm::mix( -0.5f, 0.5f, y1 * oosiz ) );
+}
+
+//==================================================================
+void TerrainLOD::selectLevels( const Float3 &camPosObj, const Params &par, int bias )
+{
+    c_auto maxLev = getLevelsN() - 1;
+
+    // by distance, doubling the cell size at every doubling of the distance
+    for (auto &chunk : mChunks)
+    {
+        c_auto dist = glm::length( glm::clamp( camPosObj, chunk.bmin, chunk.bmax ) - camPosObj );
+
+        c_auto lev = dist < par.lodDist
+                        ? 0
+                        : (int)floorf( log2f( dist / par.lodDist ) ) + 1;
+
+        chunk.level = std::clamp( lev + bias, 0, maxLev );
+    }
+
+    // no more than one level of difference between neighbors,
+    // so that the stitching works
+    c_auto chunksPerSide = (size_t)1 << mChunksPerSideL2;
+    for (bool changed=true; changed;)
+    {
+        changed = false;
+        for (size_t cy=0; cy < chunksPerSide; ++cy)
+        {
+            for (size_t cx=0; cx < chunksPerSide; ++cx)
+            {
+                auto &lev = mChunks[ (cy << mChunksPerSideL2) + cx ].level;
+
+                auto limitTo = [&]( size_t nx, size_t ny )
+                {
+                    c_auto nlev = mChunks[ (ny << mChunksPerSideL2) + nx ].level;
+                    if ( lev > nlev + 1 )
+                    {
+                        lev = nlev + 1;
+                        changed = true;
+                    }
+                };
+
+                if ( cx > 0 )                   limitTo( cx - 1, cy );
+                if ( cx < chunksPerSide - 1 )   limitTo( cx + 1, cy );
+                if ( cy > 0 )                   limitTo( cx, cy - 1 );
+                if ( cy < chunksPerSide - 1 )   limitTo( cx, cy + 1 );
+            }
+        }
+    }
+}
+
+//==================================================================
+uint32_t TerrainLOD::calcEdges( size_t cx, size_t cy ) const
+{
+    c_auto chunksPerSide = (size_t)1 << mChunksPerSideL2;
+    c_auto lev = mChunks[ (cy << mChunksPerSideL2) + cx ].level;
+
+    auto isCoarser = [&]( size_t nx, size_t ny )
+    {
+        return mChunks[ (ny << mChunksPerSideL2) + nx ].level > lev;
+    };
+
+    uint32_t edges = 0;
+    if ( cx > 0                 && isCoarser( cx - 1, cy ) ) edges |= EDGE_XN;
+    if ( cx < chunksPerSide - 1 && isCoarser( cx + 1, cy ) ) edges |= EDGE_XP;
+    if ( cy > 0                 && isCoarser( cx, cy - 1 ) ) edges |= EDGE_YN;
+    if ( cy < chunksPerSide - 1 && isCoarser( cx, cy + 1 ) ) edges |= EDGE_YP;
+    return edges;
+}
+
+//==================================================================
+void TerrainLOD::updateChunkList( Chunk &chunk, size_t cx, size_t cy, uint32_t edges )
+{
+    if ( chunk.oList && chunk.listLevel == chunk.level && chunk.listEdges == edges )
+        return;
+
+    if NOT( chunk.oList )
+    {
+        chunk.oList = std::make_unique<ImmGLList>();
+        chunk.listLevel = -1;
+    }
+
+    auto &lst = *chunk.oList;
+
+    // vertices only change with the level
+    c_auto newVerts = chunk.listLevel != chunk.level;
+    if ( newVerts )
+    {
+        lst.ClearList();
+
+        c_auto &terr = *mpTerr;
+        c_auto siz = terr.GetSiz();
+        c_auto oosiz = 1.f / siz;
+
+        c_auto n = ((size_t)1 << mChunkL2) >> chunk.level;
+        c_auto step = (size_t)1 << chunk.level;
+        c_auto x0 = cx << mChunkL2;
+        c_auto y0 = cy << mChunkL2;
+
+        auto *pPos = lst.AllocPos( (n + 1) * (n + 1) );
+        auto *pCol = lst.AllocColU8( (n + 1) * (n + 1) );
+        for (size_t j=0; j <= n; ++j)
+        {
+            c_auto sy = std::min( y0 + j * step, siz - 1 );
+            c_auto y = glm::mix( -0.5f, 0.5f, sy * oosiz );
+            for (size_t i=0; i <= n; ++i)
+            {
+                c_auto sx = std::min( x0 + i * step, siz - 1 );
+                c_auto x = glm::mix( -0.5f, 0.5f, sx * oosiz );
+                *pPos++ = mSca * Float3( x, terr.mHeights( sx, sy ), y );
+
+                *pCol++ = terr.mBakedCols( sx, sy );
+            }
+        }
+    }
+
+    c_auto &tab = mIdxTabs[ (size_t)chunk.level * (EDGE_ALL + 1) + edges ];
+    lst.mIdx.assign( tab.begin(), tab.end() );
+
+    if ( newVerts )
+        lst.CompileList();
+    else
+        lst.UpdateIdxBuffer(); // only the stitching changed
+
+    chunk.listLevel = chunk.level;
+    chunk.listEdges = edges;
+}
+
+//==================================================================
+void TerrainLOD::Draw(
+            ImmGL &immgl,
+            const Matrix44 &proj_obj,
+            const Float3 &camPosObj,
+            const Params &par )
+{
+    mLastTrisN = 0;
+
+    if ( mChunks.empty() )
+        return;
+
+    for (auto &chunk : mChunks)
+    {
+        chunk.isVisible = !isBoxOutOfView( proj_obj, chunk.bmin, chunk.bmax );
+
+        // don't hold on to what's out of view
+        if NOT( chunk.isVisible )
+            chunk.oList = {};
+    }
+
+    // coarser everywhere, until the triangles fit the budget
+    c_auto chunkTrisN = (size_t)2 << (mChunkL2 * 2);
+    int bias = 0;
+    for (;; ++bias)
+    {
+        selectLevels( camPosObj, par, bias );
+
+        size_t trisN = 0;
+        for (c_auto &chunk : mChunks)
+            if ( chunk.isVisible )
+                trisN += chunkTrisN >> (chunk.level * 2);
+
+        mLastTrisN = trisN;
+        if ( trisN <= par.trisBudget || bias == getLevelsN() - 1 )
+            break;
+    }
+    mLastBias = bias;
+
+    immgl.SetMtxPS( proj_obj );
+
+    c_auto chunksPerSide = (size_t)1 << mChunksPerSideL2;
+    for (size_t cy=0; cy < chunksPerSide; ++cy)
+    {
+        for (size_t cx=0; cx < chunksPerSide; ++cx)
+        {
+            auto &chunk = mChunks[ (cy << mChunksPerSideL2) + cx ];
+            if NOT( chunk.isVisible )
+                continue;
+
+            updateChunkList( chunk, cx, cy, calcEdges( cx, cy ) );
+
+            immgl.CallList( *chunk.oList );
+        }
+    }
+}
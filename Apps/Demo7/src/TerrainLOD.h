@@ -0,0 +1,99 @@
+//==================================================================
+/// TerrainLOD.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef TERRAINLOD_H
+#define TERRAINLOD_H
+
+#include <vector>
+#include "DBase.h"
+#include "MathBase.h"
+#include "ImmGL.h"
+#include "Terrain.h"
+
+//==================================================================
+/// Chunked LOD rendering of a Terrain (geomipmapping).
+/// The map is split in chunks of CHUNK_L2 cells, each drawn at a level
+/// of detail chosen per frame from the distance to the camera, where
+/// level l takes one sample every 1 << l.
+/// Neighbor chunks differ by at most one level, and the finer chunk's
+/// edge is stitched to the coarser one by precomputed index buffers,
+/// so that there are no cracks.
+class TerrainLOD
+{
+public:
+    static constexpr size_t CHUNK_L2 = 6;
+
+    // stitched edges, where the neighbor is coarser
+    enum : uint32_t
+    {
+        EDGE_XN = 1 << 0,
+        EDGE_XP = 1 << 1,
+        EDGE_YN = 1 << 2,
+        EDGE_YP = 1 << 3,
+        EDGE_ALL = (1 << 4) - 1,
+    };
+
+    struct Params
+    {
+        float       lodDist     {1.f};      // full detail up to this distance
+        size_t      trisBudget  {1u << 20}; // max triangles in view
+    };
+
+private:
+    struct Chunk
+    {
+        Float3          bmin;
+        Float3          bmax;
+        int             level       {};
+        bool            isVisible   {};
+
+        ImmGLListPtr    oList;
+        int             listLevel   {-1};   // what's in oList
+        uint32_t        listEdges   {};
+    };
+
+    const Terrain           *mpTerr {};
+    float                   mSca    {1};
+    size_t                  mChunkL2        {};
+    size_t                  mChunksPerSideL2 {};
+    std::vector<Chunk>      mChunks;
+
+    // indices of a chunk, [level][edges]
+    std::vector<std::vector<uint32_t>>  mIdxTabs;
+
+    size_t                  mLastTrisN {};
+    int                     mLastBias {};
+
+public:
+    // terr must stay valid until the next Setup(). The chunks are
+    // rebuilt as needed when drawing
+    void Setup( const Terrain &terr, float sca );
+
+    // terr now holds what Setup() was given, moved from another Terrain
+    void Rebind( const Terrain &terr ) { mpTerr = &terr; }
+
+    // after a change of the samples in [x0, x1) x [y0, y1)
+    void UpdateRect( size_t x0, size_t y0, size_t x1, size_t y1 );
+
+    void Draw( ImmGL &immgl, const Matrix44 &proj_obj, const Float3 &camPosObj, const Params &par );
+
+    size_t GetLastTrisN() const { return mLastTrisN; }
+    int GetLastBias() const { return mLastBias; }
+
+private:
+    int getLevelsN() const { return (int)mChunkL2 + 1; }
+
+    void updateChunkBounds( size_t cx, size_t cy );
+    void selectLevels( const Float3 &camPosObj, const Params &par, int bias );
+    uint32_t calcEdges( size_t cx, size_t cy ) const;
+    void updateChunkList( Chunk &chunk, size_t cx, size_t cy, uint32_t edges );
+
+    static std::vector<uint32_t> makeIdxTab( size_t cellsN, uint32_t edges );
+};
+
+#endif
@@ -0,0 +1,523 @@
+//==================================================================
+/// TerrainWorld.cpp
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#include <math.h>
+#include <float.h>
+#include <chrono>
+#include <queue>
+#include <algorithm>
+#include "ParallelFor.h"
+#include "Plasma2.h"
+#include "Terrain.h"
+#include "TerrainWorld.h"
+
+// the sum of the octaves is rarely far from the middle of its range,
+// this part of it is what goes from minH to maxH
+static constexpr float WORLD_USUAL_LO = 0.2f;
+static constexpr float WORLD_USUAL_HI = 0.8f;
+
+// the horizon where nothing is known, as a missing neighbor
+static constexpr float WORLD_NO_HORIZON = -FLT_MAX;
+
+//==================================================================
+template <typename T>
+static bool isFutureReady( const std::future<T> &fut )
+{
+    return fut.wait_for( std::chrono::seconds(0) ) == std::future_status::ready;
+}
+
+//==================================================================
+bool TerrainWorld::isSameParams( const Params &a, const Params &b )
+{
+    // what the tiles ignore doesn't count
+    auto bBake = b.bake;
+    bBake.wrapEdges = a.bake.wrapEdges;
+    bBake.exactSha  = a.bake.exactSha;
+
+    return a.tileL2     == b.tileL2     &&
+           a.baseSizL2  == b.baseSizL2  &&
+           a.seed       == b.seed       &&
+           a.rough      == b.rough      &&
+           a.useSIMD    == b.useSIMD    &&
+           TGEN_CalcDirtyStages( a.bake, bBake ) == 0;
+}
+
+//==================================================================
+// runs on a worker thread, par is a copy
+std::unique_ptr<TerrainWorld::TileData> TerrainWorld::makeTileData(
+                                            Params par, int64_t tx, int64_t ty )
+{
+    c_auto tileSiz = (int64_t)1 << par.tileL2;
+    c_auto apron = tileSiz / 2;
+
+    // the tile in the middle of a map of twice its size
+    Terrain terr( par.tileL2 + 1 );
+
+    Plasma2::TileParams tpar;
+    tpar.SetDest( terr.mHeights );
+    tpar.x0         = tx * tileSiz - apron;
+    tpar.y0         = ty * tileSiz - apron;
+    tpar.topCellL2  = tpar.sizL2 - std::min( (size_t)par.baseSizL2, tpar.sizL2 );
+    tpar.seed       = par.seed;
+    tpar.rough      = par.rough;
+    tpar.useSIMD    = par.useSIMD;
+    Plasma2::GenerateTile( tpar );
+
+    // the same mapping for all the tiles, where a single map would
+    // rescale by its own min/max
+    c_auto maxVal = Plasma2::CalcTileMaxVal( tpar );
+    c_auto lo = maxVal * WORLD_USUAL_LO;
+    c_auto hi = maxVal * WORLD_USUAL_HI;
+    auto toHeight = [&]( float v )
+    {
+        return par.bake.minH + (v - lo) * ((par.bake.maxH - par.bake.minH) / (hi - lo));
+    };
+
+    for (size_t y=0; y < terr.GetSiz(); ++y)
+    {
+        auto *pRow = terr.mHeights.Row( y );
+        for (size_t x=0; x < terr.GetSiz(); ++x)
+            pRow[x] = toHeight( pRow[x] );
+    }
+
+    terr.mMinH = toHeight( 0 );
+    terr.mMaxH = toHeight( maxVal );
+
+    TGEN_MakeMateAndTex( terr );
+    TGEN_FlattenSeaBed( terr );
+
+    // the colors lit and in shadow, the shadows need the neighbors,
+    // and are left to calcTileShadows()
+    auto bpar = par.bake;
+    bpar.enableSha = false;
+    TGEN_BakeTiled( terr, bpar, TGEN_STAGE_ALL & ~TGEN_STAGE_SHAPE );
+
+    c_auto colsLit = terr.mBakedCols;
+    if ( par.bake.enableSha )
+    {
+        std::fill( terr.mShadowBits.begin(), terr.mShadowBits.end(), ~(uint64_t)0 );
+        TGEN_CalcBakedColors( terr, par.bake.lightDif, par.bake.lightAmb );
+    }
+
+    // one more row and column, shared with the neighbors
+    c_auto vertsN = (size_t)tileSiz + 1;
+
+    auto oData = std::make_unique<TileData>();
+    oData->pos.resize( vertsN * vertsN );
+    oData->colsLit.resize( vertsN * vertsN );
+    oData->colsSha.resize( par.bake.enableSha ? vertsN * vertsN : 0 );
+    for (size_t j=0; j < vertsN; ++j)
+    {
+        for (size_t i=0; i < vertsN; ++i)
+        {
+            c_auto sx = (ptrdiff_t)apron + (ptrdiff_t)i;
+            c_auto sy = (ptrdiff_t)apron + (ptrdiff_t)j;
+            c_auto di = j * vertsN + i;
+            oData->pos[ di ] = Float3( (float)i, terr.mHeights( sx, sy ), (float)j );
+            oData->colsLit[ di ] = colsLit( sx, sy );
+            if ( par.bake.enableSha )
+                oData->colsSha[ di ] = terr.mBakedCols( sx, sy );
+        }
+    }
+
+    // lit, until the shadows are done
+    oData->cols = oData->colsLit;
+
+    return oData;
+}
+
+//==================================================================
+TerrainWorld::LightStep TerrainWorld::makeLightStep( const Params &par )
+{
+    LightStep ls;
+
+    c_auto l = glm::normalize( par.bake.lightDirLS );
+    c_auto lMajor = std::max( std::abs( l[0] ), std::abs( l[2] ) );
+    if NOT( par.bake.enableSha && lMajor > 0 )
+        return ls;
+
+    ls.isOn     = true;
+    ls.isMajorY = std::abs( l[2] ) > std::abs( l[0] );
+
+    c_auto l0 = ls.isMajorY ? l[2] : l[0];
+    c_auto l2 = ls.isMajorY ? l[0] : l[2];
+
+    ls.d0 = l0 > 0 ? 1 : -1;
+
+    // at 45 degrees, a whole step is taken as the rest, so that the
+    // reads stay within the halo
+    c_auto d2 = l2 / lMajor;
+    ls.minor0 = (int)floorf( d2 );
+    ls.minorT = d2 - (float)ls.minor0;
+    if ( ls.minor0 > 0 )
+    {
+        ls.minor0 = 0;
+        ls.minorT = 1.f;
+    }
+
+    // the tiles are baked as a map of 2 tiles
+    ls.d1 = l[1] / lMajor / (float)(2 << par.tileL2);
+
+    auto sign = []( float v ) { return (v > 0) - (v < 0); };
+    ls.toLightTX = sign( l[0] );
+    ls.toLightTY = sign( l[2] );
+
+    return ls;
+}
+
+//==================================================================
+// the shadows of a tile, with the horizon of each vertex from the one of
+// its next vertex toward the light, a line of the major axis at a time,
+// from the side of the light. The minor coordinate of a step is mostly
+// between two vertices, and their horizons are interpolated.
+// The halo has the horizons of the neighbors, where they have them.
+// Returns true if the horizons changed
+bool TerrainWorld::calcTileShadows( Tile &tile )
+{
+    c_auto &ls = mLightStep;
+    c_auto n = (ptrdiff_t)GetTileSiz();
+    c_auto vertsN = (size_t)n + 1;
+
+    const Map2D<float> *pNeighs[3][3] {};
+    for (int dy=-1; dy <= 1; ++dy)
+    {
+        for (int dx=-1; dx <= 1; ++dx)
+        {
+            auto it = mTiles.find( makeKey( tile.tx + dx, tile.ty + dy ) );
+            if ( it != mTiles.end() && NOT( it->second.horizons.IsEmpty() ) )
+                pNeighs[dy+1][dx+1] = &it->second.horizons;
+        }
+    }
+
+    Map2D<float> hor( vertsN, vertsN, 1, 0, WORLD_NO_HORIZON );
+
+    auto fromNeigh = [&]( ptrdiff_t x, ptrdiff_t y )
+    {
+        c_auto nx = x < 0 ? 0 : (x > n ? 2 : 1);
+        c_auto ny = y < 0 ? 0 : (y > n ? 2 : 1);
+        if ( c_auto *pNeigh = pNeighs[ny][nx] )
+            hor( x, y ) = (*pNeigh)( x - (nx - 1) * n, y - (ny - 1) * n );
+    };
+
+    for (ptrdiff_t x=-1; x <= n+1; ++x)
+    {
+        fromNeigh( x, -1 );
+        fromNeigh( x, n+1 );
+    }
+    for (ptrdiff_t y=0; y <= n; ++y)
+    {
+        fromNeigh( -1, y );
+        fromNeigh( n+1, y );
+    }
+
+    // by major and minor coordinates
+    auto horAt = [&]( ptrdiff_t a, ptrdiff_t b ) -> float &
+    {
+        return ls.isMajorY ? hor( b, a ) : hor( a, b );
+    };
+
+    auto &data = *tile.oData;
+    c_auto t = ls.minorT;
+    for (ptrdiff_t k=0; k <= n; ++k)
+    {
+        c_auto a = ls.d0 > 0 ? n - k : k;
+        c_auto aLight = a + ls.d0;
+        for (ptrdiff_t b=0; b <= n; ++b)
+        {
+            c_auto bLight = b + ls.minor0;
+
+            // the ray to the light has to clear this
+            c_auto rayHor = horAt( aLight, bLight ) * (1 - t) +
+                            horAt( aLight, bLight + 1 ) * t - ls.d1;
+
+            c_auto x = ls.isMajorY ? b : a;
+            c_auto y = ls.isMajorY ? a : b;
+            c_auto vi = (size_t)y * vertsN + (size_t)x;
+            c_auto h = data.pos[ vi ][1];
+
+            data.cols[ vi ] = rayHor > h ? data.colsSha[ vi ] : data.colsLit[ vi ];
+            horAt( a, b ) = std::max( h, rayHor );
+        }
+    }
+
+    auto isChanged = tile.horizons.IsEmpty();
+    for (ptrdiff_t y=0; y <= n && NOT( isChanged ); ++y)
+        isChanged = NOT( std::equal( hor.Row( y ), hor.Row( y ) + vertsN, tile.horizons.Row( y ) ) );
+
+    tile.horizons = std::move( hor );
+    tile.isColsDirty = true;
+
+    return isChanged;
+}
+
+//==================================================================
+// the tiles with shadows to do, from the farthest toward the light, so
+// that the neighbors that they start from are done first. A tile whose
+// horizons changed has its neighbors away from the light done again.
+// This goes on for up to shaBudgetMS, at least a tile, the tiles left
+// are still dirty and are done in the next calls
+void TerrainWorld::updateShadows()
+{
+    c_auto &ls = mLightStep;
+    if NOT( ls.isOn )
+        return;
+
+    c_auto startT = std::chrono::steady_clock::now();
+    auto isOverBudget = [&]()
+    {
+        c_auto elapsed = std::chrono::steady_clock::now() - startT;
+        return std::chrono::duration<double,std::milli>( elapsed ).count() >= mPar.shaBudgetMS;
+    };
+
+    auto calcOrder = [&]( const Tile &tile )
+    {
+        return tile.tx * ls.toLightTX + tile.ty * ls.toLightTY;
+    };
+
+    std::priority_queue<std::pair<int64_t, uint64_t>> todo;
+    for (c_auto &[key, tile] : mTiles)
+        if ( tile.isShaDirty )
+            todo.push( { calcOrder( tile ), key } );
+
+    const std::pair<int, int> awayOffs[] =
+    {
+        { -ls.toLightTX, 0 },
+        { 0, -ls.toLightTY },
+        { -ls.toLightTX, -ls.toLightTY },
+    };
+
+    for (size_t doneN=0; NOT( todo.empty() ); ++doneN)
+    {
+        if ( doneN && isOverBudget() )
+            break;
+
+        auto &tile = mTiles[ todo.top().second ];
+        todo.pop();
+
+        tile.isShaDirty = false;
+        if NOT( calcTileShadows( tile ) )
+            continue;
+
+        for (c_auto &[dx, dy] : awayOffs)
+        {
+            if NOT( dx || dy )
+                continue;
+
+            auto it = mTiles.find( makeKey( tile.tx + dx, tile.ty + dy ) );
+            if ( it == mTiles.end() || NOT( it->second.oData ) || it->second.isShaDirty )
+                continue;
+
+            it->second.isShaDirty = true;
+            todo.push( { calcOrder( it->second ), it->first } );
+        }
+    }
+}
+
+//==================================================================
+size_t TerrainWorld::GetPendingN() const
+{
+    size_t n = mDiscarded.size();
+    for (c_auto &[key, tile] : mTiles)
+        n += tile.fut.valid() ? 1 : 0;
+
+    return n;
+}
+
+//==================================================================
+// the tiles in view, plus a ring, so that going back and forth over a
+// tile edge doesn't bake again
+size_t TerrainWorld::GetCapacity() const
+{
+    c_auto side = (size_t)mViewRad * 2 + 3;
+    return side * side;
+}
+
+//==================================================================
+void TerrainWorld::dropAllTiles()
+{
+    for (auto &[key, tile] : mTiles)
+        if ( tile.fut.valid() )
+            mDiscarded.push_back( std::move( tile.fut ) );
+
+    mTiles.clear();
+}
+
+//==================================================================
+void TerrainWorld::evictOverCapacity()
+{
+    while ( mTiles.size() > GetCapacity() )
+    {
+        // least recently used, not in view and not baking
+        auto itOldest = mTiles.end();
+        for (auto it=mTiles.begin(); it != mTiles.end(); ++it)
+        {
+            c_auto &tile = it->second;
+            if ( tile.fut.valid() || tile.lastUsedFrame == mFrame )
+                continue;
+
+            if ( itOldest == mTiles.end() ||
+                 tile.lastUsedFrame < itOldest->second.lastUsedFrame )
+                itOldest = it;
+        }
+
+        if ( itOldest == mTiles.end() )
+            break;
+
+        mTiles.erase( itOldest );
+    }
+}
+
+//==================================================================
+void TerrainWorld::Update( const Params &par, const double camPos[2], int viewRad )
+{
+    if ( mHasPar && NOT( isSameParams( mPar, par ) ) )
+        dropAllTiles();
+
+    // indices of a tile, same split as the whole map mesh
+    if ( NOT( mHasPar ) || mPar.tileL2 != par.tileL2 || mIdxTab.empty() )
+    {
+        c_auto n = ((size_t)1 << par.tileL2);
+        c_auto vertsN = n + 1;
+
+        mIdxTab.clear();
+        mIdxTab.reserve( n * n * 6 );
+        for (size_t j=0; j < n; ++j)
+        {
+            for (size_t i=0; i < n; ++i)
+            {
+                c_auto i00 = (uint32_t)((j+0) * vertsN + i+0);
+                c_auto i01 = (uint32_t)((j+0) * vertsN + i+1);
+                c_auto i10 = (uint32_t)((j+1) * vertsN + i+0);
+                c_auto i11 = (uint32_t)((j+1) * vertsN + i+1);
+                mIdxTab.insert( mIdxTab.end(), { i01, i11, i00, i11, i10, i00 } );
+            }
+        }
+    }
+
+    mPar = par;
+    mHasPar = true;
+    mLightStep = makeLightStep( par );
+    mViewRad = std::max( viewRad, 0 );
+    ++mFrame;
+
+    c_auto tileSiz = (double)GetTileSiz();
+    mCamTX = (int64_t)floor( camPos[0] / tileSiz );
+    mCamTY = (int64_t)floor( camPos[1] / tileSiz );
+
+    // collect the finished bakes
+    for (auto &[key, tile] : mTiles)
+    {
+        if ( tile.fut.valid() && isFutureReady( tile.fut ) )
+        {
+            tile.oData = tile.fut.get();
+            tile.isShaDirty = mLightStep.isOn;
+        }
+    }
+
+    std::erase_if( mDiscarded, []( c_auto &fut ) { return isFutureReady( fut ); } );
+
+    updateShadows();
+
+    // mark what's in view, and find what's missing
+    struct Missing
+    {
+        int64_t     dist2;
+        int64_t     tx;
+        int64_t     ty;
+    };
+    std::vector<Missing> missing;
+
+    for (int64_t dy=-mViewRad; dy <= mViewRad; ++dy)
+    {
+        for (int64_t dx=-mViewRad; dx <= mViewRad; ++dx)
+        {
+            c_auto tx = mCamTX + dx;
+            c_auto ty = mCamTY + dy;
+
+            if ( auto it = mTiles.find( makeKey( tx, ty ) ); it != mTiles.end() )
+                it->second.lastUsedFrame = mFrame;
+            else
+                missing.push_back( { dx*dx + dy*dy, tx, ty } );
+        }
+    }
+
+    // nearest first, as many jobs at a time as there are cores
+    std::sort( missing.begin(), missing.end(), []( c_auto &l, c_auto &r )
+    {
+        return l.dist2 < r.dist2;
+    });
+
+    auto pendingN = GetPendingN();
+    for (c_auto &m : missing)
+    {
+        if ( pendingN >= PF_GetThreadsN() )
+            break;
+
+        auto &tile = mTiles[ makeKey( m.tx, m.ty ) ];
+        tile.tx = m.tx;
+        tile.ty = m.ty;
+        tile.lastUsedFrame = mFrame;
+        tile.fut = std::async( std::launch::async, makeTileData, mPar, m.tx, m.ty );
+        ++pendingN;
+    }
+
+    evictOverCapacity();
+}
+
+//==================================================================
+void TerrainWorld::Draw( ImmGL &immgl, const Matrix44 &proj_local, const double origin[2] )
+{
+    c_auto tileSiz = (double)GetTileSiz();
+
+    for (auto &[key, tile] : mTiles)
+    {
+        // only what's in view
+        if ( tile.lastUsedFrame != mFrame )
+            continue;
+
+        // upload what just arrived, or the new shadows
+        if ( tile.oData && NOT( tile.oList ) )
+        {
+            tile.oList = std::make_unique<ImmGLList>();
+            auto &lst = *tile.oList;
+
+            c_auto &data = *tile.oData;
+            auto *pPos = lst.AllocPos( data.pos.size() );
+            auto *pCol = lst.AllocColU8( data.cols.size() );
+            for (size_t i=0; i < data.pos.size(); ++i)
+            {
+                pPos[i] = data.pos[i];
+                pCol[i] = data.cols[i];
+            }
+            lst.mIdx.assign( mIdxTab.begin(), mIdxTab.end() );
+            lst.CompileList();
+
+            tile.isColsDirty = false;
+        }
+        else
+        if ( tile.isColsDirty && tile.oList )
+        {
+            auto &lst = *tile.oList;
+            lst.mVtxColU8.assign( tile.oData->cols.begin(), tile.oData->cols.end() );
+            lst.UpdateBuffer( IMMGL_VT_COLU8 );
+
+            tile.isColsDirty = false;
+        }
+
+        if NOT( tile.oList )
+            continue;
+
+        // relative to the origin, to keep the floats small
+        c_auto off = Float3( (float)((double)tile.tx * tileSiz - origin[0]),
+                             0.f,
+                             (float)((double)tile.ty * tileSiz - origin[1]) );
+
+        immgl.SetMtxPS( glm::translate( proj_local, off ) );
+        immgl.CallList( *tile.oList );
+    }
+}
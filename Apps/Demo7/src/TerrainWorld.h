@@ -0,0 +1,144 @@
+//==================================================================
+/// TerrainWorld.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef TERRAINWORLD_H
+#define TERRAINWORLD_H
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <future>
+#include <unordered_map>
+#include "DBase.h"
+#include "MathBase.h"
+#include "RendBase.h"
+#include "ImmGL.h"
+#include "Map2D.h"
+#include "TerrainGen.h"
+
+//==================================================================
+/// Unbounded terrain, made of square tiles that are generated and baked
+/// on background threads, as the camera gets near them.
+/// A tile's heights come from Plasma2::GenerateTile() at the tile's
+/// world coordinates, so that neighbors match. The bake is done on the
+/// tile plus an apron of half a tile on each side, also generated, so
+/// that the diffuse term is seamless.
+/// The shadows are done by the world, once a tile is in, with a horizon
+/// per vertex that goes from tile to tile, away from the light: a tile
+/// starts from the horizons of its neighbors toward the light, and is
+/// done again when those arrive or change. So the shadows reach as far
+/// as the resident tiles go. This is done within a time budget per
+/// Update(), so a change that goes across many tiles is spread over
+/// some frames.
+/// Tiles are kept in an LRU cache of a fixed number of tiles, so the
+/// memory use doesn't grow as the camera roams.
+class TerrainWorld
+{
+public:
+    struct Params
+    {
+        uint32_t        tileL2      {7};    // tile side, in texels (log2)
+        uint32_t        baseSizL2   {2};    // as in Plasma2, for a map of 2 tiles
+        uint32_t        seed        {100};
+        float           rough       {0.5f};
+        bool            useSIMD     {true};
+        float           shaBudgetMS {2.f};  // per Update(), for the shadows
+        TGEN_BakeParams bake;               // wrapEdges and exactSha are ignored
+    };
+
+private:
+    // what's ready for the GPU, positions in texels
+    struct TileData
+    {
+        std::vector<Float3>     pos;
+        std::vector<RBColType>  cols;       // with the shadows
+        std::vector<RBColType>  colsLit;
+        std::vector<RBColType>  colsSha;    // all in shadow, if enabled
+    };
+
+    struct Tile
+    {
+        int64_t                 tx {};
+        int64_t                 ty {};
+        uint64_t                lastUsedFrame {};
+
+        std::future<std::unique_ptr<TileData>>  fut;    // while baking
+        ImmGLListPtr            oList;
+        std::unique_ptr<TileData> oData;
+        bool                    isColsDirty {};         // to upload again
+
+        // max height that the ray to the light from each vertex has to
+        // clear, or the vertex itself, if higher. See calcTileShadows()
+        Map2D<float>            horizons;
+        bool                    isShaDirty {};
+    };
+
+    // a step toward the light, along its dominant axis, as in
+    // MU_ParallelOcclChecker
+    struct LightStep
+    {
+        bool        isOn        {};     // shadows enabled, light not overhead
+        bool        isMajorY    {};     // the major axis is y (tile rows)
+        int         d0          {};     // on the major axis, +/-1
+        int         minor0      {};     // whole part on the minor axis
+        float       minorT      {};     // and the rest, to interpolate
+        float       d1          {};     // rise of the ray, in map units
+        int         toLightTX   {};     // signs of the tile offsets
+        int         toLightTY   {};     // toward the light
+    };
+
+    Params                      mPar;
+    bool                        mHasPar {};
+    uint64_t                    mFrame  {};
+    int                         mViewRad {};
+    int64_t                     mCamTX  {};
+    int64_t                     mCamTY  {};
+
+    std::unordered_map<uint64_t, Tile>  mTiles;
+
+    // jobs of dropped tiles, left to finish without waiting on them
+    std::vector<std::future<std::unique_ptr<TileData>>> mDiscarded;
+
+    std::vector<uint32_t>       mIdxTab;    // shared by all the tiles
+
+    LightStep                   mLightStep;
+
+public:
+    // streams in the tiles within viewRad tiles from camPos, in texels.
+    // A change of parameters drops all the tiles
+    void Update( const Params &par, const double camPos[2], int viewRad );
+
+    // proj_local is for a space centered at origin, with 1 unit per texel
+    // and heights in map units
+    void Draw( ImmGL &immgl, const Matrix44 &proj_local, const double origin[2] );
+
+    size_t GetTileSiz() const { return (size_t)1 << mPar.tileL2; }
+    size_t GetResidentN() const { return mTiles.size(); }
+    size_t GetPendingN() const;
+    size_t GetCapacity() const;
+
+private:
+    void dropAllTiles();
+    void evictOverCapacity();
+
+    void updateShadows();
+    bool calcTileShadows( Tile &tile );
+
+    static LightStep makeLightStep( const Params &par );
+
+    static bool isSameParams( const Params &a, const Params &b );
+
+    static uint64_t makeKey( int64_t tx, int64_t ty )
+    {
+        return ((uint64_t)(uint32_t)ty << 32) | (uint32_t)tx;
+    }
+
+    static std::unique_ptr<TileData> makeTileData( Params par, int64_t tx, int64_t ty );
+};
+
+#endif
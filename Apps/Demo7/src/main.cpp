@@ -10,8 +10,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <array>
+#include <random>
+#include <chrono>
 #include <vector>
 #include <algorithm> // for std::sort
+#include <thread>
 #include "IncludeGL.h"
 #include "DBase.h"
 #include "MathBase.h"
@@ -19,8 +22,14 @@
 #include "Plasma2.h"
 #include "Terrain.h"
 #include "TerrainGen.h"
+#include "TerrainBaker.h"
+#include "TerrainBakeWorker.h"
+#include "TerrainLOD.h"
+#include "TerrainWorld.h"
 #include "TerrainExport.h"
+#include "TerrainErosion.h"
 #include "MU_WrapMap.h"
+#include "MU_MinMaxPyramid.h"
 #include "ImmGL.h"
 #include "MinimalSDLApp.h"
 
@@ -30,6 +39,14 @@ static constexpr float DISP_TERR_SCALE  = 10.f;
 static constexpr float DISP_CAM_NEAR    = 0.01f;    // near plane (1 cm)
 static constexpr float DISP_CAM_FAR     = 1000.f;   // far plane (1000 m)
 
+// how a new terrain is made
+enum : int
+{
+    GEN_MODE_BLOCKING,      // all at once, in the frame
+    GEN_MODE_PROGRESSIVE,   // a few blocks per frame, shown as they come
+    GEN_MODE_BACKGROUND,    // on a worker, swapped in when done
+};
+
 struct DemoParams
 {
     float       DISP_CAM_FOV_DEG    = 65.f;       // field of view
@@ -38,6 +55,10 @@ struct DemoParams
     bool        DISP_ANIM_YAW       = true;
     uint32_t    DISP_CROP_WH[2]     = {0,0};
     bool        DISP_SMOOTH         = false;
+    bool        DISP_LOD            = true;    // chunked LOD mesh, when not cropping
+    float       DISP_LOD_DIST       = 1.f;     // full detail up to this distance
+    uint32_t    DISP_LOD_TRIS       = 1u << 20;// max triangles in view
+    bool        DISP_PICK_VIEW      = false;   // mark the terrain at the view center
 
     float       GEN_MIN_H           = -0.15f;
     float       GEN_MAX_H           =  0.10f;
@@ -46,9 +67,26 @@ struct DemoParams
     uint32_t    GEN_SEED            = 100;     // random seed
     float       GEN_ROUGH           = 0.5f;
     bool        GEN_WRAP_EDGES      = false;
+    bool        GEN_PARALLEL        = true;
+    bool        GEN_SIMD            = true;
+    bool        GEN_USE_CACHE       = true;
+    int         GEN_MODE            = GEN_MODE_BACKGROUND;
+    float       GEN_BUDGET_MS       = 8.f;     // per frame, when progressive
+
+    bool        WORLD_ENABLE        = false;   // streamed tiles, instead of the map
+    uint32_t    WORLD_TILE_L2       = 7;       // 128 x 128 tiles
+    int         WORLD_VIEW_RAD      = 2;       // tiles around the camera
+    float       WORLD_ROAM_SPEED    = 0.5f;    // texels per frame
+    float       WORLD_SHA_BUDGET_MS = 2.f;     // per frame, for the shadows
+    double      WORLD_POS[2]        = {0,0};   // camera target, in texels
+
+    bool        ERO_ENABLE          = false;   // erode a few steps every frame
+    uint32_t    ERO_STEPS_PER_FRAME = 4;
+    TerrainErosion::Params ERO_PAR  {};
 
     bool        LIGHT_ENABLE_DIFF   = true;
     bool        LIGHT_ENABLE_SHA    = true;
+    bool        LIGHT_EXACT_SHA     = false;
     Float3      LIGHT_DIFF_COL      = {1.0f, 1.0f, 1.0f};
     Float3      LIGHT_AMB_COL       = {0.3f, 0.3f, 0.3f};
     Float2      LIGHT_DIR_LAT_LONG  = {20.f, 70.f};
@@ -56,12 +94,49 @@ struct DemoParams
     std::string EXP_PATHFNAME       {"exported_terr.h"};
     int         EXP_QUANT_HEIGHT    {46};
     int         EXP_QUANT_SHADE     {8};
+    int         EXP_FORMAT          {TEXP_FMT_CHEADER};
 };
 
 static DemoParams   _sPar;
 
 static int _sForceDebugRendCnt = 0;
 
+// keeps what's needed to only redo the stages affected by a change
+static TerrainBaker _sBaker;
+
+// chunked LOD rendering of the terrain
+static TerrainLOD _sTerrLOD;
+
+// for ray casts on the terrain, rebuilt when the heights change
+static MU_MinMaxPyramid _sTerrPyr;
+static MU_MinMaxPyramid::Hit _sViewHit;
+static double _sRayBenchMRaysS;
+
+// unbounded terrain, streamed around the camera
+static TerrainWorld _sWorld;
+
+// generated maps of 256 x 256 and up, up to 512 MB on disk
+static Plasma2Cache _sPlasmaCache( "plasma_cache", (uint64_t)512 << 20, 8 );
+
+// bakes with _sBaker on a back terrain, in GEN_MODE_BACKGROUND.
+// _sBaker is used by one side at a time, the worker or the main loop
+static TerrainBakeWorker _sBakeWorker( _sBaker );
+static bool _sBakerOnWorker;
+
+// Mpixels/s per octave, scalar and SIMD
+static std::vector<double> _sBenchMPixS[2];
+
+// erosion Mcells/s, scalar and SIMD
+static double _sEroBenchMCellsS[2];
+
+//==================================================================
+static double getSteadyTimeSecs()
+{
+    return
+        (double)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count() * 1e-6;
+}
+
 //==================================================================
 inline float DEG2RAD( float deg )
 {
@@ -75,11 +150,11 @@ inline Float3 calcLightDir( const Float2 &the_phi_deg )
 }
 
 //==================================================================
-static std::vector<Float3> makeTerrVerts( auto &terr, float sca )
+static void makeTerrVerts( IVec<IFloat3> &verts, auto &terr, float sca )
 {
     c_auto siz = terr.GetSiz();
 
-    std::vector<Float3> verts( siz * siz );
+    verts.resize( siz * siz );
 
     c_auto oosiz = 1.f / siz;
     size_t idx = 0;
@@ -89,145 +164,399 @@ static std::vector<Float3> makeTerrVerts( auto &terr, float sca )
         for (size_t xi=0; xi < siz; ++xi, ++idx)
         {
             c_auto x = glm::mix( -0.5f, 0.5f, xi * oosiz );
-            verts[ idx ] = { sca * Float3( x, terr.mHeights[ idx ], y ) };
+            verts[ idx ] = { sca * Float3( x, terr.mHeights( xi, yi ), y ) };
         }
     }
+}
+
+//==================================================================
+// whole map mesh, the vertices are shared by the quads.
+// Each triangle ends with the top-left vertex of its quad, so that
+// flat shading gives the quad the color of that texel
+static void makeTerrIndices( IVec<uint32_t> &idx, size_t sizL2 )
+{
+    c_auto siz = (size_t)1 << sizL2;
 
-    return verts;
+    idx.resize( (siz - 1) * (siz - 1) * 6 );
+
+    auto *pIdx = idx.data();
+    for (size_t yi=0; yi < siz-1; ++yi)
+    {
+        c_auto row0 = (yi+0) << sizL2;
+        c_auto row1 = (yi+1) << sizL2;
+        for (size_t xi=0; xi < siz-1; ++xi)
+        {
+            c_auto i00 = (uint32_t)(row0 + xi+0);
+            c_auto i01 = (uint32_t)(row0 + xi+1);
+            c_auto i10 = (uint32_t)(row1 + xi+0);
+            c_auto i11 = (uint32_t)(row1 + xi+1);
+            *pIdx++ = i01; *pIdx++ = i11; *pIdx++ = i00;
+            *pIdx++ = i11; *pIdx++ = i10; *pIdx++ = i00;
+        }
+    }
 }
 
 //==================================================================
-static auto makeRendCol = []( RBColType src )
+// what of the terrain mesh needs an upload
+static bool _sTerrMeshPosDirty = true;
+static bool _sTerrMeshColDirty = true;
+
+//==================================================================
+static void updateTerrMesh( auto &oList, const auto &terr, const uint32_t cropWH[2] )
 {
-    return IColor4((float)src[0],(float)src[1],(float)src[2],(float)src[3]) * (1.f/255);
-};
+    if NOT( oList )
+    {
+        oList = std::make_unique<ImmGLList>();
+        _sTerrMeshPosDirty = true;
+        _sTerrMeshColDirty = true;
+    }
+
+    auto &lst = *oList;
+
+    c_auto siz = terr.GetSiz();
+
+    // positions, only when the heights change
+    if ( _sTerrMeshPosDirty )
+    {
+        _sTerrMeshPosDirty = false;
+        makeTerrVerts( lst.mVtxPos, terr, DISP_TERR_SCALE );
+        lst.UpdateBuffer( IMMGL_VT_POS );
+    }
+
+    // indices, only when the size changes
+    if ( lst.mIdx.size() != (siz - 1) * (siz - 1) * 6 )
+    {
+        makeTerrIndices( lst.mIdx, terr.GetSizL2() );
+        lst.UpdateIdxBuffer();
+    }
+
+    // RGBA8 colors, straight from the bake
+    if ( _sTerrMeshColDirty )
+    {
+        _sTerrMeshColDirty = false;
+        lst.mVtxColU8.assign( terr.mBakedCols.begin(), terr.mBakedCols.end() );
+        lst.UpdateBuffer( IMMGL_VT_COLU8 );
+    }
+
+    // the crop is a range of quads per row, nothing to upload
+    lst.mIdxRanges.clear();
+    if ( cropWH[0] || cropWH[1] )
+    {
+        c_auto cropRC = TERR_MakeCropRC( siz, cropWH );
+        c_auto xi1 = cropRC[0];
+        c_auto yi1 = cropRC[1];
+        c_auto xi2 = cropRC[2] - 1;
+        c_auto yi2 = cropRC[3] - 1;
+
+        for (size_t yi=yi1; yi < yi2; ++yi)
+            lst.mIdxRanges.push_back( { (yi * (siz - 1) + xi1) * 6, (xi2 - xi1) * 6 } );
+
+        // an empty range list would draw everything
+        if ( lst.mIdxRanges.empty() )
+            lst.mIdxRanges.push_back( { 0, 0 } );
+    }
+}
 
 //==================================================================
-static void makeTerrGeometry(
-        auto &immgl,
-        auto &oList,
-        const auto &terr,
-        const uint32_t cropWH[2],
-        const bool smoothShade )
+// the crop is for previewing the export, and needs the full mesh
+static bool isLODDisplay()
 {
-    c_auto terrVerts = makeTerrVerts( terr, DISP_TERR_SCALE );
+    return _sPar.DISP_LOD && !_sPar.DISP_CROP_WH[0] && !_sPar.DISP_CROP_WH[1];
+}
 
-    c_auto cropRC = TERR_MakeCropRC( terr.GetSiz(), cropWH );
-    c_auto xi1 = cropRC[0];
-    c_auto yi1 = cropRC[1];
-    c_auto xi2 = cropRC[2] - 1;
-    c_auto yi2 = cropRC[3] - 1;
+//==================================================================
+//=== Generation
+//==================================================================
+static TGEN_BakeParams makeBakeParams()
+{
+    TGEN_BakeParams bpar;
+    bpar.minH       = _sPar.GEN_MIN_H;
+    bpar.maxH       = _sPar.GEN_MAX_H;
+    bpar.wrapEdges  = _sPar.GEN_WRAP_EDGES;
+    bpar.enableDiff = _sPar.LIGHT_ENABLE_DIFF;
+    bpar.enableSha  = _sPar.LIGHT_ENABLE_SHA;
+    bpar.exactSha   = _sPar.LIGHT_EXACT_SHA;
+    bpar.lightDirLS = calcLightDir( _sPar.LIGHT_DIR_LAT_LONG );
+    bpar.lightDif   = _sPar.LIGHT_DIFF_COL;
+    bpar.lightAmb   = _sPar.LIGHT_AMB_COL;
+    return bpar;
+}
 
-    oList = immgl.NewList( [&]( ImmGLList &lst )
+//==================================================================
+// what's derived from the terrain, after a bake
+static void updateTerrDisplay( ImmGLListPtr &oList, const Terrain &terr, bool changed )
+{
+    if ( changed )
     {
-        if ( smoothShade )
+        _sTerrLOD.Setup( terr, DISP_TERR_SCALE );
+
+        if ( _sBaker.mLastStages & TGEN_STAGE_SHAPE )
         {
-            // verts
-            {
-                auto *pPos = lst.AllocPos( terrVerts.size() );
-                auto *pCol = lst.AllocCol( terrVerts.size() );
-                for (size_t i=0; i < terrVerts.size(); ++i)
-                {
-                    pPos[i] = terrVerts[i];
-                    pCol[i] = makeRendCol( terr.mBakedCols[ i ] );
-                }
-            }
-            // indexes
-            for (size_t yi=yi1; yi < yi2; ++yi)
-            {
-                c_auto row0 = (yi+0) << terr.GetSizL2();
-                c_auto row1 = (yi+1) << terr.GetSizL2();
-                for (size_t xi=xi1; xi < xi2; ++xi)
-                {
-                    c_auto i00 = (uint32_t)(row0 + xi+0);
-                    c_auto i01 = (uint32_t)(row0 + xi+1);
-                    c_auto i10 = (uint32_t)(row1 + xi+0);
-                    c_auto i11 = (uint32_t)(row1 + xi+1);
-                    ImmGL_MakeQuadOfTrigs( lst.AllocIdx( 6 ), i00, i01, i10, i11 );
-                }
-            }
+            _sTerrMeshPosDirty = true;
+            _sTerrPyr.Build( terr.mHeights.GetView() );
         }
-        else
+
+        _sTerrMeshColDirty = true;
+    }
+
+    // the whole map mesh is only kept when used
+    if ( isLODDisplay() )
+        oList = {};
+    else
+        updateTerrMesh( oList, terr, _sPar.DISP_CROP_WH );
+}
+
+//==================================================================
+static TerrainBaker::GenParams makeGenParams()
+{
+    TerrainBaker::GenParams gpar;
+    gpar.sizL2      = _sPar.GEN_SIZL2;
+    gpar.baseSizL2  = _sPar.GEN_STASIZL2;
+    gpar.seed       = _sPar.GEN_SEED;
+    gpar.rough      = _sPar.GEN_ROUGH;
+    gpar.parallel   = _sPar.GEN_PARALLEL;
+    gpar.useSIMD    = _sPar.GEN_SIMD;
+    gpar.useCache   = _sPar.GEN_USE_CACHE;
+    return gpar;
+}
+
+//==================================================================
+// on the worker, what changed of the whole map mesh
+static void makeTerrMeshArrays( const Terrain &terr, uint32_t stages, TerrainBakeWorker::Mesh &mesh )
+{
+    if ( stages & TGEN_STAGE_SHAPE )
+        makeTerrVerts( mesh.pos, terr, DISP_TERR_SCALE );
+
+    mesh.cols.assign( terr.mBakedCols.begin(), terr.mBakedCols.end() );
+}
+
+//==================================================================
+// swaps in the last bake of the worker, if there's one
+static void takeBakeResult( ImmGLListPtr &oList, Terrain &terr )
+{
+    auto oRes = _sBakeWorker.TakeResult();
+    if NOT( oRes )
+        return;
+
+    terr = std::move( oRes->terr );
+
+    _sTerrLOD = std::move( oRes->lod );
+    _sTerrLOD.Rebind( terr );
+    _sTerrPyr = std::move( oRes->pyr );
+
+    if ( oRes->stages & TGEN_STAGE_SHAPE )
+        _sTerrMeshPosDirty = true;
+
+    _sTerrMeshColDirty = true;
+
+    // only the upload is left for the arrays made on the worker, into
+    // the list that stays. The rest is made by updateTerrMesh()
+    auto &mesh = oRes->mesh;
+    if NOT( mesh.cols.empty() || isLODDisplay() )
+    {
+        if NOT( oList )
+            oList = std::make_unique<ImmGLList>();
+
+        auto &lst = *oList;
+        if NOT( mesh.pos.empty() )
         {
-            for (size_t yi=yi1; yi < yi2; ++yi)
-            {
-                c_auto row0 = (yi+0) << terr.GetSizL2();
-                c_auto row1 = (yi+1) << terr.GetSizL2();
-                for (size_t xi=xi1; xi < xi2; ++xi)
-                {
-                    c_auto i00 = row0 + xi+0;
-                    c_auto i01 = row0 + xi+1;
-                    c_auto i10 = row1 + xi+0;
-                    c_auto i11 = row1 + xi+1;
-                    auto *pPos = lst.AllocPos( 6 );
-                    auto *pCol = lst.AllocCol( 6 );
-                    ImmGL_MakeQuadOfTrigs( pPos,
-                        terrVerts[ i00 ], terrVerts[ i01 ],
-                        terrVerts[ i10 ], terrVerts[ i11 ] );
-
-                    c_auto col = makeRendCol( terr.mBakedCols[ i00 ] );
-                    ImmGL_MakeQuadOfTrigs( pCol, col, col, col, col );
-                }
-            }
+            lst.mVtxPos = std::move( mesh.pos );
+            lst.UpdateBuffer( IMMGL_VT_POS );
+            _sTerrMeshPosDirty = false;
         }
-    });
+
+        lst.mVtxColU8 = std::move( mesh.cols );
+        lst.UpdateBuffer( IMMGL_VT_COLU8 );
+        _sTerrMeshColDirty = false;
+    }
+
+    updateTerrDisplay( oList, terr, false );
 }
 
 //==================================================================
-//=== Generation
+static void postBakeRequest( size_t erodeStepsN, bool resetErosion )
+{
+    TerrainBakeWorker::Request req;
+    req.genPar          = makeGenParams();
+    req.bakePar         = makeBakeParams();
+    req.erodeStepsN     = erodeStepsN;
+    req.eroPar          = _sPar.ERO_PAR;
+    req.resetErosion    = resetErosion;
+    req.lodSca          = DISP_TERR_SCALE;
+    req.makeMesh        = NOT( isLODDisplay() );
+
+    // the worker's terrain is behind the baker, if the main loop used it
+    req.invalidate      = NOT( _sBakerOnWorker );
+    _sBakerOnWorker     = true;
+
+    _sBakeWorker.Post( req );
+}
+
+//==================================================================
+// the baker back to the main loop, with the terrain of its last bake
+static void reclaimBaker( ImmGLListPtr &oList, Terrain &terr )
+{
+    if NOT( _sBakerOnWorker )
+        return;
+
+    while ( _sBakeWorker.IsBusy() )
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+    takeBakeResult( oList, terr );
+    _sBakerOnWorker = false;
+}
+
+// the baker's state can be read
+static bool isBakerFree()
+{
+    return NOT( _sBakerOnWorker && _sBakeWorker.IsBusy() );
+}
+
 //==================================================================
-static void makeTerrFromParams( auto &immgl, ImmGLListPtr &oList, auto &terr )
+static void makeTerrFromParams( ImmGLListPtr &oList, auto &terr )
 {
-    // allocate a new map
-    terr = Terrain( _sPar.GEN_SIZL2 );
-
-    // fill it with "plasma"
-    Plasma2::Params par;
-    par.pDest       = terr.mHeights.data(); // destination values
-    par.sizL2       = terr.GetSizL2();      // log2 of size (i.e. 7 = 128 pixels width/height)
-    par.baseSizL2   = _sPar.GEN_STASIZL2;// log2 of size of initial low res map
-    par.seed        = _sPar.GEN_SEED;
-    par.rough       = _sPar.GEN_ROUGH;
-
-    // generate the map
-    Plasma2 plasma( par );
-    while ( plasma.IterateRow() )
+    if ( _sPar.GEN_MODE == GEN_MODE_BACKGROUND )
     {
+        postBakeRequest( 0, false );
+
+        // the display options (crop, LOD) don't make a bake, so the
+        // terrain that we have is shown with them now, if there's one
+        if NOT( terr.mHeights.IsEmpty() )
+            updateTerrDisplay( oList, terr, false );
+        return;
     }
 
-    // transform heights to the required range
-    TGEN_ScaleHeights( terr, _sPar.GEN_MIN_H, _sPar.GEN_MAX_H );
+    reclaimBaker( oList, terr );
+
+    // bake all the attributes, from the heights
+    c_auto bpar = makeBakeParams();
 
-    // blend edges to make a continuous map
-    if ( _sPar.GEN_WRAP_EDGES )
+    // only redoes the stages that depend on what changed
+    c_auto changed = _sBaker.Update( terr, makeGenParams(), bpar,
+                                     _sPar.GEN_MODE == GEN_MODE_PROGRESSIVE );
+
+    updateTerrDisplay( oList, terr, changed );
+}
+
+//==================================================================
+// the time slice of a frame of a progressive generation. The blocks
+// done are shown as they come, until the full bake at the end
+static void generateTerrSlice( ImmGLListPtr &oList, Terrain &terr )
+{
+    size_t rect[4] {};
+    if NOT( _sBaker.StepGeneration( terr, _sPar.GEN_BUDGET_MS * 1e-3, rect ) )
+        return;
+
+    if NOT( _sBaker.IsGenerating() )
     {
-        // we wrap by cross-blending the extreme 1/3 of the samples at the edges
-        c_auto wrapSiz = terr.GetSiz() / 3;
-        MU_WrapMap<float,1>( terr.mHeights.data(), terr.GetSizL2(), wrapSiz );
+        updateTerrDisplay( oList, terr, true );
+        return;
     }
 
-    TGEN_MakeMateAndTex( terr );
+    _sTerrLOD.UpdateRect( rect[0], rect[1], rect[2], rect[3] );
+    _sTerrPyr.UpdateRect( rect[0], rect[1], rect[2], rect[3] );
+    _sTerrMeshPosDirty = true;
+    _sTerrMeshColDirty = true;
+
+    updateTerrDisplay( oList, terr, false );
+}
+
+//==================================================================
+// the fixed budget of erosion steps of a frame, and a new bake
+static void erodeTerr( ImmGLListPtr &oList, auto &terr )
+{
+    if ( _sPar.GEN_MODE == GEN_MODE_BACKGROUND )
+    {
+        // one request at a time, as the steps of a replaced one are lost
+        if NOT( _sBakeWorker.IsBusy() )
+            postBakeRequest( _sPar.ERO_STEPS_PER_FRAME, false );
+        return;
+    }
+
+    reclaimBaker( oList, terr );
+
+    c_auto changed = _sBaker.Erode( terr, _sPar.ERO_PAR, _sPar.ERO_STEPS_PER_FRAME );
+
+    updateTerrDisplay( oList, terr, changed );
+}
+
+//==================================================================
+// object space of the terrain mesh to map space, and back
+static Float3 objToMapSca( const Terrain &terr )
+{
+    c_auto siz = (float)terr.GetSiz();
+    return { siz / DISP_TERR_SCALE, 1.f / DISP_TERR_SCALE, siz / DISP_TERR_SCALE };
+}
+
+//==================================================================
+// casts a ray from the camera, through the center of the view
+static void pickViewCenter( auto &immgl, const Matrix44 &proj_obj, const Matrix44 &cam_obj, const Terrain &terr )
+{
+    c_auto obj_cam = glm::inverse( cam_obj );
+    c_auto camPos = Float3( obj_cam[3] );
+    c_auto camDir = Float3( obj_cam * glm::vec4( 0, 0, -1, 0 ) );
+
+    c_auto halfSiz = terr.GetSiz() * 0.5f;
+
+    // same t in both spaces, as the mapping is affine
+    MU_MinMaxPyramid::Ray ray;
+    ray.pos = camPos * objToMapSca( terr ) + Float3( halfSiz, 0, halfSiz );
+    ray.dir = camDir * objToMapSca( terr );
+
+    _sViewHit = _sTerrPyr.CastRay( ray );
+    if NOT( _sViewHit.IsHit() )
+        return;
 
-    TGEN_FlattenSeaBed( terr );
+    c_auto hitPos = camPos + camDir * _sViewHit.t;
+
+    immgl.SetMtxPS( proj_obj );
+    immgl.DrawLine( hitPos, hitPos + Float3( 0, DISP_TERR_SCALE * 0.05f, 0 ), {1.f,0.f,0.f,1.f} );
+}
 
-    if ( _sPar.LIGHT_ENABLE_DIFF )
-        TGEN_CalcDiffLight( terr, calcLightDir( _sPar.LIGHT_DIR_LAT_LONG ) );
+//==================================================================
+// random rays from above the terrain, all cast at once
+static double benchmarkRayCasts( const Terrain &terr, size_t raysN )
+{
+    c_auto siz = (float)terr.GetSiz();
+
+    std::default_random_engine rndGen( 0 );
+    std::uniform_real_distribution<float> dist( 0.f, 1.f );
+
+    std::vector<MU_MinMaxPyramid::Ray> rays( raysN );
+    for (auto &ray : rays)
+    {
+        ray.pos = { dist( rndGen ) * siz, _sTerrPyr.GetMaxH() + 0.1f, dist( rndGen ) * siz };
+        ray.dir = { dist( rndGen ) - 0.5f, -dist( rndGen ) * 0.1f, dist( rndGen ) - 0.5f };
+    }
 
-    if ( _sPar.LIGHT_ENABLE_SHA )
-        TGEN_CalcShadows( terr, calcLightDir( _sPar.LIGHT_DIR_LAT_LONG ) );
+    std::vector<MU_MinMaxPyramid::Hit> hits( raysN );
 
-    TGEN_CalcBakedColors( terr, _sPar.LIGHT_DIFF_COL, _sPar.LIGHT_AMB_COL );
+    c_auto startS = getSteadyTimeSecs();
+    _sTerrPyr.CastRays( rays.data(), raysN, hits.data() );
+    c_auto elapsedS = std::max( getSteadyTimeSecs() - startS, 1e-6 );
 
-    //
-    oList = {};
-    makeTerrGeometry( immgl, oList, terr, _sPar.DISP_CROP_WH, _sPar.DISP_SMOOTH );
+    return (double)raysN / elapsedS * 1e-6;
+}
+
+//==================================================================
+// same look as a map of two tiles, from the same parameters
+static TerrainWorld::Params makeWorldParams()
+{
+    TerrainWorld::Params wpar;
+    wpar.tileL2     = _sPar.WORLD_TILE_L2;
+    wpar.baseSizL2  = _sPar.GEN_STASIZL2;
+    wpar.seed       = _sPar.GEN_SEED;
+    wpar.rough      = _sPar.GEN_ROUGH;
+    wpar.useSIMD    = _sPar.GEN_SIMD;
+    wpar.shaBudgetMS = _sPar.WORLD_SHA_BUDGET_MS;
+    wpar.bake       = makeBakeParams();
+    return wpar;
 }
 
 #ifdef ENABLE_IMGUI
 //==================================================================
 static void handleUI(
             size_t frameCnt,
-            auto &immgl,
             auto &oList,
             Terrain &terr )
 {
@@ -251,7 +580,28 @@ static void handleUI(
         ImGui::Checkbox( "Anim Yaw", &_sPar.DISP_ANIM_YAW );
 
         rebuild |= ImGui::InputScalarN( "Crop", ImGuiDataType_U32, _sPar.DISP_CROP_WH, 2 );
-        rebuild |= ImGui::Checkbox( "Smooth Shading", &_sPar.DISP_SMOOTH );
+        ImGui::Checkbox( "Smooth Shading", &_sPar.DISP_SMOOTH );
+
+        rebuild |= ImGui::Checkbox( "LOD Mesh (no crop)", &_sPar.DISP_LOD );
+        ImGui::SliderFloat( "LOD Distance", &_sPar.DISP_LOD_DIST, 0.1f, DISP_TERR_SCALE );
+        {
+            uint32_t step = 1u << 16;
+            ImGui::InputScalar( "LOD Max Tris", ImGuiDataType_U32, &_sPar.DISP_LOD_TRIS, &step, nullptr, "%d" );
+        }
+        if ( isLODDisplay() )
+            ImGui::Text( "LOD tris: %zu (bias %i)", _sTerrLOD.GetLastTrisN(), _sTerrLOD.GetLastBias() );
+
+        ImGui::Checkbox( "Pick View Center", &_sPar.DISP_PICK_VIEW );
+        if ( _sPar.DISP_PICK_VIEW && _sViewHit.IsHit() )
+            ImGui::Text( "View center at texel (%u, %u)", _sViewHit.x, _sViewHit.y );
+
+        if ( ImGui::Button( "Benchmark Ray Casts" ) )
+        {
+            _sRayBenchMRaysS = benchmarkRayCasts( terr, (size_t)1 << 16 );
+            printf( "Ray casts: %.2f Mrays/s\n", _sRayBenchMRaysS );
+        }
+        if ( _sRayBenchMRaysS )
+            ImGui::Text( "Ray casts: %.2f Mrays/s", _sRayBenchMRaysS );
     }
 
     if ( header( "Generation", true ) )
@@ -267,17 +617,129 @@ static void handleUI(
 
         rebuild |= ImGui::InputFloat( "Max Height", &_sPar.GEN_MAX_H, 0.01f, 0.1f );
         rebuild |= ImGui::InputFloat( "Min Height", &_sPar.GEN_MIN_H, 0.01f, 0.1f );
-        rebuild |= slideU32( "Size Log2", &_sPar.GEN_SIZL2, 0, 9 );
+        rebuild |= slideU32( "Size Log2", &_sPar.GEN_SIZL2, 0, 12 );
         rebuild |= slideU32( "Init Size Log2", &_sPar.GEN_STASIZL2, 0, _sPar.GEN_SIZL2 );
         rebuild |= ImGui::InputFloat( "Roughness", &_sPar.GEN_ROUGH, 0.01f, 0.1f );
         rebuild |= inputU32( "Seed", &_sPar.GEN_SEED, 1 );
         rebuild |= ImGui::Checkbox( "Wrap Edges", &_sPar.GEN_WRAP_EDGES );
+        rebuild |= ImGui::Checkbox( "Parallel Plasma", &_sPar.GEN_PARALLEL );
+        rebuild |= ImGui::Checkbox( "SIMD Plasma", &_sPar.GEN_SIMD );
+        rebuild |= ImGui::Checkbox( "Plasma Disk Cache", &_sPar.GEN_USE_CACHE );
+        rebuild |= ImGui::Combo( "Gen Mode", &_sPar.GEN_MODE, "Blocking\0Progressive\0Background\0" );
+        ImGui::SliderFloat( "Budget per Frame (ms)", &_sPar.GEN_BUDGET_MS, 1.f, 50.f );
+        if NOT( isBakerFree() )
+            ImGui::Text( "Baking in the background..." );
+        else
+        {
+            if ( _sBaker.IsGenerating() )
+                ImGui::ProgressBar( _sBaker.GetGenProgress() );
+            ImGui::Text( "Plasma time: %.2f ms%s",
+                            _sBaker.mLastGenTimeS * 1000,
+                            _sBaker.mLastGenCached ? " (cached)" : "" );
+            ImGui::Text( "Bake time: %.2f ms", _sBaker.mLastBakeTimeS * 1000 );
+        }
+
+        if ( ImGui::Button( "Benchmark Plasma" ) )
+        {
+            Plasma2::Params par;
+            par.sizL2       = _sPar.GEN_SIZL2;
+            par.baseSizL2   = std::min( _sPar.GEN_STASIZL2, _sPar.GEN_SIZL2 );
+            par.seed        = _sPar.GEN_SEED;
+            par.rough       = _sPar.GEN_ROUGH;
+
+            for (size_t i=0; i < 2; ++i)
+            {
+                par.useSIMD = (i == 1);
+                _sBenchMPixS[i] = Plasma2::BenchmarkOctaves( par, 4 );
+            }
+
+            for (size_t d=0; d < _sBenchMPixS[0].size(); ++d)
+                printf( "Plasma octave %zu: scalar %.1f Mpix/s, SIMD %.1f Mpix/s\n",
+                        d, _sBenchMPixS[0][d], _sBenchMPixS[1][d] );
+        }
+
+        for (size_t d=0; d < _sBenchMPixS[0].size(); ++d)
+            ImGui::Text( "Octave %zu: %.0f / %.0f Mpix/s",
+                         d, _sBenchMPixS[0][d], _sBenchMPixS[1][d] );
+    }
+
+    if ( header( "Erosion", false ) )
+    {
+        auto &ep = _sPar.ERO_PAR;
+
+        ImGui::Checkbox( "Erode", &_sPar.ERO_ENABLE );
+        {
+            c_auto mi = (uint32_t)1;
+            c_auto ma = (uint32_t)64;
+            ImGui::SliderScalar( "Steps per Frame", ImGuiDataType_U32, &_sPar.ERO_STEPS_PER_FRAME, &mi, &ma, nullptr, 0 );
+        }
+        ImGui::InputFloat( "Rain", &ep.rain, 0.01f, 0.1f );
+        ImGui::InputFloat( "Evaporation", &ep.evap, 0.01f, 0.1f );
+        ImGui::InputFloat( "Capacity", &ep.capacity, 0.001f, 0.01f );
+        ImGui::InputFloat( "Dissolve", &ep.dissolve, 0.01f, 0.1f );
+        ImGui::InputFloat( "Deposit", &ep.deposit, 0.01f, 0.1f );
+        ImGui::InputFloat( "Talus", &ep.talus, 0.1f, 1.f );
+        ImGui::InputFloat( "Thermal", &ep.thermal, 0.01f, 0.1f );
+        ImGui::Checkbox( "SIMD Erosion", &ep.useSIMD );
+
+        if ( isBakerFree() )
+        {
+            c_auto &eroder = _sBaker.GetEroder();
+            ImGui::Text( "Steps: %zu, %.1f Mcells/s", eroder.GetItersN(), eroder.GetLastCellsPerS() * 1e-6 );
+        }
+
+        if ( ImGui::Button( "Reset Erosion" ) )
+        {
+            if ( _sPar.GEN_MODE == GEN_MODE_BACKGROUND )
+                postBakeRequest( 0, true );
+            else
+            {
+                reclaimBaker( oList, terr );
+                _sBaker.ResetErosion();
+                rebuild = true;
+            }
+        }
+
+        if ( ImGui::Button( "Benchmark Erosion" ) )
+        {
+            auto bpar = ep;
+            for (size_t i=0; i < 2; ++i)
+            {
+                bpar.useSIMD = (i == 1);
+                _sEroBenchMCellsS[i] = 1e-6 * TerrainErosion::Benchmark(
+                                            terr.mHeights,
+                                            (float)terr.GetSiz(),
+                                            bpar,
+                                            16 );
+            }
+
+            printf( "Erosion: scalar %.1f Mcells/s, SIMD %.1f Mcells/s\n",
+                    _sEroBenchMCellsS[0], _sEroBenchMCellsS[1] );
+        }
+        if ( _sEroBenchMCellsS[0] )
+            ImGui::Text( "Erosion: %.1f / %.1f Mcells/s", _sEroBenchMCellsS[0], _sEroBenchMCellsS[1] );
+    }
+
+    if ( header( "World", false ) )
+    {
+        ImGui::Checkbox( "Enable World", &_sPar.WORLD_ENABLE );
+
+        c_auto mi = (uint32_t)2;
+        c_auto ma = (uint32_t)9;
+        ImGui::SliderScalar( "Tile Size Log2", ImGuiDataType_U32, &_sPar.WORLD_TILE_L2, &mi, &ma, nullptr, 0 );
+        ImGui::SliderInt( "View Radius (tiles)", &_sPar.WORLD_VIEW_RAD, 0, 8 );
+        ImGui::SliderFloat( "Roam Speed", &_sPar.WORLD_ROAM_SPEED, -8.f, 8.f );
+        ImGui::SliderFloat( "Shadows Budget (ms)", &_sPar.WORLD_SHA_BUDGET_MS, 0.f, 20.f );
+        ImGui::InputScalarN( "Position", ImGuiDataType_Double, _sPar.WORLD_POS, 2 );
+        ImGui::Text( "Tiles: %zu resident (max %zu), %zu baking",
+                        _sWorld.GetResidentN(), _sWorld.GetCapacity(), _sWorld.GetPendingN() );
     }
 
     if ( header( "Lighting", false ) )
     {
         rebuild |= ImGui::Checkbox( "Enable Diffuse", &_sPar.LIGHT_ENABLE_DIFF );
         rebuild |= ImGui::Checkbox( "Enable Shadows", &_sPar.LIGHT_ENABLE_SHA );
+        rebuild |= ImGui::Checkbox( "Exact Shadows (slow, reference)", &_sPar.LIGHT_EXACT_SHA );
 
         auto inputF3 = []( c_auto *pName, Float3 &val, float mi, float ma )
         {
@@ -305,7 +767,7 @@ static void handleUI(
         _sPar.GEN_STASIZL2 = std::min( _sPar.GEN_STASIZL2, _sPar.GEN_SIZL2 );
         _sPar.GEN_ROUGH    = std::clamp( _sPar.GEN_ROUGH, 0.f, 1.f );
 
-        makeTerrFromParams( immgl, oList, terr );
+        makeTerrFromParams( oList, terr );
     }
 
     if ( header( "Export", false ) )
@@ -313,6 +775,7 @@ static void handleUI(
         ImGui::InputText( "Login Name", &_sPar.EXP_PATHFNAME );
         ImGui::InputInt( "Height levels", &_sPar.EXP_QUANT_HEIGHT );
         ImGui::InputInt( "Shade Levels", &_sPar.EXP_QUANT_SHADE );
+        ImGui::Combo( "Format", &_sPar.EXP_FORMAT, "C Header\0Binary\0Binary Delta+LZ\0" );
 
         if ( ImGui::Button( "Export" ) )
         {
@@ -335,7 +798,8 @@ static void handleUI(
                     headStr,
                     _sPar.EXP_QUANT_HEIGHT,
                     _sPar.EXP_QUANT_SHADE,
-                    _sPar.DISP_CROP_WH );
+                    _sPar.DISP_CROP_WH,
+                    (uint32_t)_sPar.EXP_FORMAT );
         }
     }
 }
@@ -365,8 +829,11 @@ int main( int argc, char *argv[] )
     ImmGL immgl;
     ImmGLListPtr oList;
 
+    _sBaker.SetCache( &_sPlasmaCache );
+    _sBakeWorker.SetMakeMeshFn( makeTerrMeshArrays );
+
     Terrain terr;
-    makeTerrFromParams( immgl, oList, terr );
+    makeTerrFromParams( oList, terr );
 
     // begin the main/rendering loop
     for (size_t frameCnt=0; ; ++frameCnt)
@@ -376,7 +843,7 @@ int main( int argc, char *argv[] )
             break;
 
 #ifdef ENABLE_IMGUI
-        app.DrawMainUIWin( [&]() { handleUI( frameCnt, immgl, oList, terr ); } );
+        app.DrawMainUIWin( [&]() { handleUI( frameCnt, oList, terr ); } );
 #endif
         glViewport(0, 0, app.GetDispSize()[0], app.GetDispSize()[1]);
         glClearColor( 0, 0, 0, 0 );
@@ -418,11 +885,53 @@ int main( int argc, char *argv[] )
         // obj -> proj matrix
         c_auto proj_obj = proj_camera * cam_world * world_obj;
 
-        // draw the terrain by calling the display list
-        immgl.SetMtxPS( proj_obj );
-        immgl.CallList( *oList );
+        // progressive generation, background bakes and erosion of the map
+        if ( _sPar.GEN_MODE == GEN_MODE_BACKGROUND )
+            takeBakeResult( oList, terr );
+        else
+        if ( isBakerFree() && _sBaker.IsGenerating() )
+            generateTerrSlice( oList, terr );
+
+        if ( _sPar.ERO_ENABLE && NOT( _sPar.WORLD_ENABLE ) )
+            erodeTerr( oList, terr );
+
+        // draw the terrain
+        if ( _sPar.WORLD_ENABLE )
+        {
+            _sPar.WORLD_POS[0] += _sPar.WORLD_ROAM_SPEED;
+
+            _sWorld.Update( makeWorldParams(), _sPar.WORLD_POS, _sPar.WORLD_VIEW_RAD );
+
+            // texels to meters, 2 tiles are as wide as the map
+            c_auto texSca = DISP_TERR_SCALE / (float)(2 << _sPar.WORLD_TILE_L2);
+            c_auto proj_local = glm::scale( proj_obj, Float3( texSca, DISP_TERR_SCALE, texSca ) );
+
+            _sWorld.Draw( immgl, proj_local, _sPar.WORLD_POS );
+        }
+        else
+        if ( isLODDisplay() )
+        {
+            TerrainLOD::Params lpar;
+            lpar.lodDist    = _sPar.DISP_LOD_DIST;
+            lpar.trisBudget = _sPar.DISP_LOD_TRIS;
+
+            // camera position in object space
+            c_auto camPosObj = Float3( glm::inverse( cam_world * world_obj )[3] );
+
+            _sTerrLOD.Draw( immgl, proj_obj, camPosObj, lpar );
+        }
+        else
+        if ( oList )
+        {
+            // by calling the display list
+            immgl.SetMtxPS( proj_obj );
+            immgl.CallList( *oList, true, !_sPar.DISP_SMOOTH );
+        }
 
         //
+        if ( _sPar.DISP_PICK_VIEW && NOT( _sPar.WORLD_ENABLE ) )
+            pickViewCenter( immgl, proj_obj, cam_world * world_obj, terr );
+
         if ( _sForceDebugRendCnt )
         {
             _sForceDebugRendCnt -= 1;
@@ -0,0 +1,88 @@
+//==================================================================
+/// DepthSort.cpp
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#include "DepthSort.h"
+
+//==================================================================
+// returns false if it took more than maxMovesN to sort
+bool DepthSort::sortByInsertion( size_t maxMovesN )
+{
+    auto *p = mPairs.data();
+    const auto n = mPairs.size();
+
+    size_t movesN = 0;
+    for (size_t i=1; i < n; ++i)
+    {
+        const auto cur = p[i];
+        if ( p[i-1].key <= cur.key )
+            continue;
+
+        size_t j = i;
+        do {
+            p[j] = p[j-1];
+            --j;
+        } while ( j && p[j-1].key > cur.key );
+
+        p[j] = cur;
+
+        movesN += i - j;
+        if ( movesN > maxMovesN )
+            return false;
+    }
+
+    return true;
+}
+
+//==================================================================
+void DepthSort::sortByRadix()
+{
+    constexpr size_t PASSES_N = (KEY_BITS + RADIX_BITS - 1) / RADIX_BITS;
+    constexpr size_t BUCKETS_N = (size_t)1 << RADIX_BITS;
+    constexpr uint32_t MASK = (uint32_t)BUCKETS_N - 1;
+
+    const auto n = mPairs.size();
+    mPairsTmp.resize( n );
+
+    // build the histograms for all the passes at once
+    uint32_t counts[PASSES_N][BUCKETS_N] {};
+    for (const auto &pair : mPairs)
+        for (size_t pi=0; pi < PASSES_N; ++pi)
+            counts[pi][ (pair.key >> (pi * RADIX_BITS)) & MASK ] += 1;
+
+    auto *pSrc = &mPairs;
+    auto *pDes = &mPairsTmp;
+    for (size_t pi=0; pi < PASSES_N; ++pi)
+    {
+        auto &cnt = counts[pi];
+        const auto shift = (uint32_t)(pi * RADIX_BITS);
+
+        // skip the pass if all the keys fall in the same bucket
+        if ( n && cnt[ ((*pSrc)[0].key >> shift) & MASK ] == n )
+            continue;
+
+        // counts -> offsets
+        uint32_t sum = 0;
+        for (auto &c : cnt)
+        {
+            const auto t = c;
+            c = sum;
+            sum += t;
+        }
+
+        // stable scatter
+        auto *pD = pDes->data();
+        for (const auto &pair : *pSrc)
+            pD[ cnt[ (pair.key >> shift) & MASK ]++ ] = pair;
+
+        std::swap( pSrc, pDes );
+    }
+
+    // odd number of passes done, make sure that the result is in mPairs
+    if ( pSrc != &mPairs )
+        mPairs.swap( mPairsTmp );
+}
@@ -0,0 +1,112 @@
+//==================================================================
+/// DepthSort.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef DEPTHSORT_H
+#define DEPTHSORT_H
+
+#include <stdint.h>
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+
+//==================================================================
+/// Back-to-front sorter for projected points (sprites, particles, etc).
+/// Depth is quantized into an integer key and sorted with a key-value
+/// LSD radix sort. The scratch buffers are kept across calls, so that
+/// a sorter living as long as the scene doesn't allocate every frame.
+/// With coherence enabled, the previous frame's order is tried first
+/// and fixed up with an insertion sort, falling back to the radix sort
+/// when the order changed too much.
+class DepthSort
+{
+public:
+    static constexpr uint32_t KEY_BITS   = 16;
+    static constexpr uint32_t RADIX_BITS = 8;
+
+private:
+    struct KeyIdx
+    {
+        uint32_t    key;
+        uint32_t    idx;
+    };
+
+    std::vector<KeyIdx>     mPairs;
+    std::vector<KeyIdx>     mPairsTmp;
+    std::vector<uint32_t>   mOrder;
+
+    bool                    mUseCoherence {};
+
+public:
+    DepthSort( bool useCoherence=false ) : mUseCoherence(useCoherence) {}
+
+    void SetUseCoherence( bool onOff ) { mUseCoherence = onOff; }
+    bool GetUseCoherence() const { return mUseCoherence; }
+
+    // sort n elements by depth (bigger Z first), getZ(i) returns the Z of
+    // the i-th element. The returned indices are valid until the next call
+    template <typename ZFN>
+    const std::vector<uint32_t> &SortBackToFront( size_t n, const ZFN &getZ );
+
+private:
+    bool sortByInsertion( size_t maxMovesN );
+    void sortByRadix();
+};
+
+//==================================================================
+template <typename ZFN>
+inline const std::vector<uint32_t> &DepthSort::SortBackToFront( size_t n, const ZFN &getZ )
+{
+    // depth range for the quantization
+    float minZ =  FLT_MAX;
+    float maxZ = -FLT_MAX;
+    for (size_t i=0; i < n; ++i)
+    {
+        const auto z = (float)getZ( i );
+        minZ = std::min( minZ, z );
+        maxZ = std::max( maxZ, z );
+    }
+
+    // bigger Z gets the smaller key, so that an ascending sort is back-to-front
+    constexpr auto KEY_MAX = (float)((1u << KEY_BITS) - 1);
+    const auto sca = (maxZ > minZ) ? KEY_MAX / (maxZ - minZ) : 0.f;
+    auto makeKey = [&]( size_t i )
+    {
+        return (uint32_t)std::clamp( (maxZ - (float)getZ( i )) * sca, 0.f, KEY_MAX );
+    };
+
+    mPairs.resize( n );
+
+    // same count as the last frame ? Try to start from the previous order
+    if ( mUseCoherence && mOrder.size() == n )
+    {
+        for (size_t i=0; i < n; ++i)
+        {
+            const auto idx = mOrder[i];
+            mPairs[i] = { makeKey( idx ), idx };
+        }
+
+        // allow for a few moves per element, before giving up
+        if ( !sortByInsertion( n * 4 ) )
+            sortByRadix();
+    }
+    else
+    {
+        for (size_t i=0; i < n; ++i)
+            mPairs[i] = { makeKey( i ), (uint32_t)i };
+
+        sortByRadix();
+    }
+
+    mOrder.resize( n );
+    for (size_t i=0; i < n; ++i)
+        mOrder[i] = mPairs[i].idx;
+
+    return mOrder;
+}
+
+#endif
@@ -142,7 +142,7 @@ static void check_shader_compilation( GLuint oid, bool isLink )
 }
 
 //==================================================================
-ShaderProg::ShaderProg( bool useTex )
+ShaderProg::ShaderProg( bool useTex, bool useFlat )
 {
     CHECKGLERR;
 static const IStr vtxSrouce = R"RAW(
@@ -154,7 +154,7 @@ layout (location = 2) in vec2 a_tc0;
 #endif
 
 // out varyings
-out vec4 v_col;
+COL_INTERP out vec4 v_col;
 #ifdef USE_TEX
 out vec2 v_tc0;
 #endif
@@ -173,7 +173,7 @@ void main()
 //---------------
 static const IStr frgSource = R"RAW(
 // input varyings
-in vec4 v_col;
+COL_INTERP in vec4 v_col;
 #ifdef USE_TEX
 in vec2 v_tc0;
 #endif
@@ -215,6 +215,8 @@ uniform sampler2D s_tex;
     if ( useTex )
         header += "#define USE_TEX\n";
 
+    header += useFlat ? "#define COL_INTERP flat\n" : "#define COL_INTERP\n";
+
     auto makeShader = [&]( c_auto type, const IStr &src )
     {
         c_auto obj = glCreateShader( type );
@@ -295,9 +297,10 @@ void ShaderProg::SetUniform( const char *pName, const IFloat4 &v )
 
 //==================================================================
 //==================================================================
-size_t ImmGLList::makeVAOIdx( size_t posi, size_t coli, size_t tc0i )
+size_t ImmGLList::makeVAOIdx( size_t posi, size_t coli, size_t tc0i, size_t colu8i )
 {
-    return (tc0i<<IMMGL_VT_TC0) | (coli<<IMMGL_VT_COL) | (posi<<IMMGL_VT_POS);
+    return (colu8i<<IMMGL_VT_COLU8) |
+           (tc0i<<IMMGL_VT_TC0) | (coli<<IMMGL_VT_COL) | (posi<<IMMGL_VT_POS);
 }
 
 //==================================================================
@@ -341,32 +344,37 @@ ImmGLList::ImmGLList()
         {
             for (size_t tc0i=0; tc0i < 2; ++tc0i)
             {
-                IUInt vao {};
-                glGenVertexArrays( 1, &vao );
-                CHECKGLERR;
-                glBindVertexArray( vao );
-                CHECKGLERR;
-
-                mVAOs[ makeVAOIdx( posi, coli, tc0i ) ] = vao;
-
-                if ( posi ) glEnableVertexAttribArray( 0 );
-                if ( coli ) glEnableVertexAttribArray( 1 );
-                if ( tc0i ) glEnableVertexAttribArray( 2 );
-                CHECKGLERR;
-
-                auto vap = [this]( GLuint idx, GLuint cnt )
+                // the 2 color streams share the attribute
+                for (size_t colu8i=0; colu8i < 2 - coli; ++colu8i)
                 {
-                    glBindBuffer( GL_ARRAY_BUFFER, mVBOs[idx] );
-                    glVertexAttribPointer( idx, cnt, GL_FLOAT, GL_FALSE, 0, nullptr );
-                };
-
-                if ( posi ) vap( 0, 3 );
-                if ( coli ) vap( 1, 4 );
-                if ( tc0i ) vap( 2, 2 );
-                CHECKGLERR;
-
-                glBindVertexArray( 0 );
-                CHECKGLERR;
+                    IUInt vao {};
+                    glGenVertexArrays( 1, &vao );
+                    CHECKGLERR;
+                    glBindVertexArray( vao );
+                    CHECKGLERR;
+
+                    mVAOs[ makeVAOIdx( posi, coli, tc0i, colu8i ) ] = vao;
+
+                    if ( posi ) glEnableVertexAttribArray( 0 );
+                    if ( coli || colu8i ) glEnableVertexAttribArray( 1 );
+                    if ( tc0i ) glEnableVertexAttribArray( 2 );
+                    CHECKGLERR;
+
+                    auto vap = [this]( GLuint vbi, GLuint idx, GLuint cnt, GLenum type, GLboolean norm )
+                    {
+                        glBindBuffer( GL_ARRAY_BUFFER, mVBOs[vbi] );
+                        glVertexAttribPointer( idx, cnt, type, norm, 0, nullptr );
+                    };
+
+                    if ( posi ) vap( IMMGL_VT_POS, 0, 3, GL_FLOAT, GL_FALSE );
+                    if ( coli ) vap( IMMGL_VT_COL, 1, 4, GL_FLOAT, GL_FALSE );
+                    if ( tc0i ) vap( IMMGL_VT_TC0, 2, 2, GL_FLOAT, GL_FALSE );
+                    if ( colu8i ) vap( IMMGL_VT_COLU8, 1, 4, GL_UNSIGNED_BYTE, GL_TRUE );
+                    CHECKGLERR;
+
+                    glBindVertexArray( 0 );
+                    CHECKGLERR;
+                }
             }
         }
     }
@@ -392,12 +400,38 @@ ImmGLList::~ImmGLList()
 //==================================================================
 void ImmGLList::UpdateBuffers()
 {
-    updateBuff( mVtxPos,
-        GL_ARRAY_BUFFER, mVBOs[IMMGL_VT_POS], mCurVBOSizes[IMMGL_VT_POS], true );
-    updateBuff( mVtxCol,
-        GL_ARRAY_BUFFER, mVBOs[IMMGL_VT_COL], mCurVBOSizes[IMMGL_VT_COL], true );
-    updateBuff( mVtxTc0,
-        GL_ARRAY_BUFFER, mVBOs[IMMGL_VT_TC0], mCurVBOSizes[IMMGL_VT_TC0], true );
+    for (size_t i=0; i < IMMGL_VT_N; ++i)
+        UpdateBuffer( i );
+}
+
+//==================================================================
+void ImmGLList::UpdateBuffer( size_t vtIdx )
+{
+    auto upd = [&]( c_auto &vec )
+    {
+        updateBuff( vec,
+            GL_ARRAY_BUFFER, mVBOs[vtIdx], mCurVBOSizes[vtIdx], true );
+    };
+
+    switch ( vtIdx )
+    {
+    case IMMGL_VT_POS:   upd( mVtxPos );   break;
+    case IMMGL_VT_COL:   upd( mVtxCol );   break;
+    case IMMGL_VT_TC0:   upd( mVtxTc0 );   break;
+    case IMMGL_VT_COLU8: upd( mVtxColU8 ); break;
+    }
+}
+
+//==================================================================
+void ImmGLList::UpdateIdxBuffer()
+{
+    if ( mIdx.empty() )
+        return;
+
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mVAE );
+    updateBuff( mIdx, GL_ELEMENT_ARRAY_BUFFER, mVAE, mCurVAESize, false );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    CHECKGLERR;
 }
 
 //==================================================================
@@ -406,7 +440,8 @@ void ImmGLList::BindVAO() const
     c_auto posi = (size_t)1;
     c_auto coli = (size_t)!mVtxCol.empty();
     c_auto tc0i = (size_t)!mVtxTc0.empty();
-    glBindVertexArray( mVAOs[ makeVAOIdx( posi, coli, tc0i ) ] );
+    c_auto colu8i = (size_t)(!coli && !mVtxColU8.empty());
+    glBindVertexArray( mVAOs[ makeVAOIdx( posi, coli, tc0i, colu8i ) ] );
     CHECKGLERR;
 }
 
@@ -419,13 +454,7 @@ void ImmGLList::CompileList()
     // update the vertex buffers
     UpdateBuffers();
 
-    if NOT( mIdx.empty() )
-    {
-        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mVAE );
-        updateBuff( mIdx, GL_ELEMENT_ARRAY_BUFFER, mVAE, mCurVAESize, false );
-        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
-        CHECKGLERR;
-    }
+    UpdateIdxBuffer();
 }
 
 //==================================================================
@@ -435,6 +464,21 @@ void ImmGLList::DrawList( bool isTriangles )
 
     BindVAO();
 
+    if NOT( mIdxRanges.empty() )
+    {
+        IVec<GLsizei>       cnts( mIdxRanges.size() );
+        IVec<const void *>  offs( mIdxRanges.size() );
+        for (size_t i=0; i < mIdxRanges.size(); ++i)
+        {
+            offs[i] = (const void *)(mIdxRanges[i][0] * sizeof(mIdx[0]));
+            cnts[i] = (GLsizei)mIdxRanges[i][1];
+        }
+
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mVAE );
+        glMultiDrawElements( primType, cnts.data(), GL_UNSIGNED_INT, offs.data(), (GLsizei)cnts.size() );
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    }
+    else
     if NOT( mIdx.empty() )
     {
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mVAE );
@@ -456,8 +500,11 @@ ImmGL::ImmGL()
 {
     FLUSHGLERR;
 
+    // [flat][tex]
     moShaProgs.push_back( std::make_unique<ShaderProg>( false ) );
     moShaProgs.push_back( std::make_unique<ShaderProg>( true ) );
+    moShaProgs.push_back( std::make_unique<ShaderProg>( false, true ) );
+    moShaProgs.push_back( std::make_unique<ShaderProg>( true, true ) );
 }
 
 //==================================================================
@@ -583,7 +630,7 @@ void ImmGL::FlushStdList()
 }
 
 //==================================================================
-void ImmGL::CallList( ImmGLList &lst, bool isTriangles )
+void ImmGL::CallList( ImmGLList &lst, bool isTriangles, bool isFlat )
 {
     if ( lst.mVtxPos.empty() )
         return;
@@ -605,7 +652,7 @@ void ImmGL::CallList( ImmGLList &lst, bool isTriangles )
     CHECKGLERR;
 
     // set the program
-    auto *pProg = moShaProgs[hasTex ? 1 : 0].get();
+    auto *pProg = moShaProgs[(isFlat ? 2 : 0) + (hasTex ? 1 : 0)].get();
     if ( mpCurShaProg != pProg )
     {
         mpCurShaProg = pProg;
@@ -24,6 +24,7 @@ using IFloat3 = glm::vec3;
 using IFloat4 = glm::vec4;
 using IMat4   = glm::mat4;
 using IColor4 = glm::vec4;
+using IColor4U8 = glm::vec<4, uint8_t, glm::defaultp>;
 
 using IUInt = unsigned int;
 using IStr  = std::string;
@@ -66,7 +67,7 @@ public:
 
     std::unordered_map<IStr,IUInt>  mLocs;
 
-    ShaderProg( bool useTex );
+    ShaderProg( bool useTex, bool useFlat=false );
     ~ShaderProg();
 
     const auto GetProgramID() const { return mProgramID; }
@@ -85,6 +86,7 @@ enum : size_t
     IMMGL_VT_POS,
     IMMGL_VT_COL,
     IMMGL_VT_TC0,
+    IMMGL_VT_COLU8, // RGBA8 colors, instead of IMMGL_VT_COL
     IMMGL_VT_N
 };
 
@@ -95,8 +97,12 @@ public:
     IVec<IFloat3>   mVtxPos;
     IVec<IColor4>   mVtxCol;
     IVec<IFloat2>   mVtxTc0;
+    IVec<IColor4U8> mVtxColU8;
     IVec<uint32_t>  mIdx;
 
+    // if not empty, only these (start, count) ranges of mIdx are drawn
+    IVec<std::array<size_t,2>>  mIdxRanges;
+
 private:
     IUInt           mVAOs[ 1 << IMMGL_VT_N ]  {};
     IUInt           mVBOs[IMMGL_VT_N]         {};
@@ -112,9 +118,13 @@ public:
     auto *AllocPos( size_t n ) { return grow_vec( mVtxPos, n ); }
     auto *AllocCol( size_t n ) { return grow_vec( mVtxCol, n ); }
     auto *AllocTc0( size_t n ) { return grow_vec( mVtxTc0, n ); }
+    auto *AllocColU8( size_t n ) { return grow_vec( mVtxColU8, n ); }
     auto *AllocIdx( size_t n ) { return grow_vec( mIdx, n ); }
 
     void UpdateBuffers();
+    // to only upload what changed, after CompileList()
+    void UpdateBuffer( size_t vtIdx );
+    void UpdateIdxBuffer();
 
     void BindVAO() const;
 
@@ -126,10 +136,12 @@ public:
         mVtxPos.clear();
         mVtxCol.clear();
         mVtxTc0.clear();
+        mVtxColU8.clear();
         mIdx.clear();
+        mIdxRanges.clear();
     }
 private:
-    static size_t makeVAOIdx( size_t posi, size_t coli, size_t tc0i );
+    static size_t makeVAOIdx( size_t posi, size_t coli, size_t tc0i, size_t colu8i );
 };
 
 using ImmGLListPtr = std::unique_ptr<ImmGLList>;
@@ -168,7 +180,8 @@ public:
     void FlushStdList();
 
     ImmGLListPtr NewList( const std::function<void (ImmGLList &)> &fn );
-    void CallList( ImmGLList &lst, bool isTriangles=true );
+    // isFlat takes the color of the last vertex of each primitive
+    void CallList( ImmGLList &lst, bool isTriangles=true, bool isFlat=false );
 
     void SetBlendNone();
     void SetBlendAdd();
@@ -0,0 +1,377 @@
+//==================================================================
+/// Map2D.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef MAP2D_H
+#define MAP2D_H
+
+#include <stddef.h>
+#include <assert.h>
+#include <new>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include "DBase.h"
+#include "ParallelFor.h"
+
+// alignment of the start of each row, a cache line
+static constexpr size_t M2D_ALIGN = 64;
+
+//==================================================================
+/// Runs fn( x0, y0, x1, y1 ) for each tile of tileW x tileH of a map of
+/// w x h (the last ones may be smaller), over threadsN threads (0 for
+/// all cores)
+template <typename FN>
+inline void M2D_ForTiles(
+                size_t w,
+                size_t h,
+                size_t tileW,
+                size_t tileH,
+                const FN &fn,
+                size_t threadsN=0 )
+{
+    tileW = std::max( tileW, (size_t)1 );
+    tileH = std::max( tileH, (size_t)1 );
+
+    c_auto tilesX = (w + tileW - 1) / tileW;
+    c_auto tilesY = (h + tileH - 1) / tileH;
+
+    PF_RunJobs( tilesX * tilesY, [&]( size_t ti )
+    {
+        c_auto x0 = (ti % tilesX) * tileW;
+        c_auto y0 = (ti / tilesX) * tileH;
+        fn( x0, y0, std::min( x0 + tileW, w ), std::min( y0 + tileH, h ) );
+    }, threadsN );
+}
+
+//==================================================================
+/// A rectangle of a map, of CHANS_N values of T per texel, with rows of
+/// pitch values. It doesn't own the memory, so it can also go on a
+/// plain buffer (pitch = w * CHANS_N).
+/// Coordinates can be negative, to read the halo of a Map2D
+template <typename T, size_t CHANS_N=1>
+class Map2DView
+{
+public:
+    T           *mpData {};     // texel (0, 0)
+    size_t      mW      {};
+    size_t      mH      {};
+    ptrdiff_t   mPitch  {};     // in values of T
+
+    Map2DView() {}
+
+    Map2DView( T *pData, size_t w, size_t h, ptrdiff_t pitch )
+        : mpData(pData), mW(w), mH(h), mPitch(pitch)
+    {}
+
+    // a view is also a view of const
+    operator Map2DView<const T,CHANS_N>() const { return { mpData, mW, mH, mPitch }; }
+
+    size_t      GetW() const        { return mW; }
+    size_t      GetH() const        { return mH; }
+    ptrdiff_t   GetPitch() const    { return mPitch; }
+
+    T *Row( ptrdiff_t y ) const { return mpData + y * mPitch; }
+    T *At( ptrdiff_t x, ptrdiff_t y ) const { return Row( y ) + x * (ptrdiff_t)CHANS_N; }
+
+    T &operator()( ptrdiff_t x, ptrdiff_t y, size_t c=0 ) const { return At( x, y )[c]; }
+
+    // w x h texels from (x, y)
+    Map2DView Sub( ptrdiff_t x, ptrdiff_t y, size_t w, size_t h ) const
+    {
+        return { At( x, y ), w, h, mPitch };
+    }
+};
+
+//==================================================================
+/// A map of w x h texels of CHANS_N values of T, with each row starting
+/// on M2D_ALIGN bytes, and with a halo of texels all around, that can
+/// be read as the neighbors of the edges, so that the edges take the
+/// same path as the rest.
+/// Past the right halo there are at least padN more values, for the
+/// SIMD tails, and whatever it takes to align the next row.
+/// A packed map has no halo nor padding, the rows are right after each
+/// other, so that it can also be handed around as a plain array of
+/// w x h texels, see SetupPacked().
+/// T is expected to be trivially copyable.
+template <typename T, size_t CHANS_N=1>
+class Map2D
+{
+    static_assert( std::is_trivially_copyable_v<T> );
+
+    struct AlignedDelete
+    {
+        void operator()( T *p ) const { ::operator delete( p, std::align_val_t( M2D_ALIGN ) ); }
+    };
+
+    std::unique_ptr<T,AlignedDelete>    moBuff;
+    size_t      mBuffN      {};
+    size_t      mW          {};
+    size_t      mH          {};
+    size_t      mHalo       {};
+    size_t      mPadN       {};
+    size_t      mPitch      {};     // in values of T
+    size_t      mOrigin     {};     // of texel (0, 0)
+
+public:
+    using View      = Map2DView<T,CHANS_N>;
+    using ConstView = Map2DView<const T,CHANS_N>;
+
+    Map2D() {}
+
+    Map2D( size_t w, size_t h, size_t halo=0, size_t padN=0, const T &val=T() )
+    {
+        Setup( w, h, halo, padN, val );
+    }
+
+    Map2D( const Map2D &from ) { *this = from; }
+    Map2D( Map2D &&from ) { *this = std::move( from ); }
+
+    // from is left empty, as a new map
+    Map2D &operator=( Map2D &&from )
+    {
+        if ( this == &from )
+            return *this;
+
+        moBuff  = std::move( from.moBuff );
+        mBuffN  = std::exchange( from.mBuffN, 0 );
+        mW      = std::exchange( from.mW, 0 );
+        mH      = std::exchange( from.mH, 0 );
+        mHalo   = std::exchange( from.mHalo, 0 );
+        mPadN   = std::exchange( from.mPadN, 0 );
+        mPitch  = std::exchange( from.mPitch, 0 );
+        mOrigin = std::exchange( from.mOrigin, 0 );
+
+        return *this;
+    }
+
+    Map2D &operator=( const Map2D &from )
+    {
+        if ( this == &from )
+            return *this;
+
+        if ( mBuffN != from.mBuffN )
+            moBuff.reset( allocBuff( from.mBuffN ) );
+
+        mBuffN  = from.mBuffN;
+        mW      = from.mW;
+        mH      = from.mH;
+        mHalo   = from.mHalo;
+        mPadN   = from.mPadN;
+        mPitch  = from.mPitch;
+        mOrigin = from.mOrigin;
+
+        if ( mBuffN )
+            std::copy( from.moBuff.get(), from.moBuff.get() + mBuffN, moBuff.get() );
+
+        return *this;
+    }
+
+    //==================================================================
+    // all the values to val, the halo and the padding as well
+    void Setup( size_t w, size_t h, size_t halo=0, size_t padN=0, const T &val=T() )
+    {
+        // values of T that make a multiple of M2D_ALIGN bytes
+        c_auto alignN = M2D_ALIGN / std::gcd( M2D_ALIGN, sizeof(T) );
+        auto alignUp = [&]( size_t n ) { return (n + alignN - 1) / alignN * alignN; };
+
+        // the left halo is before the aligned start of the row
+        c_auto leftN = alignUp( halo * CHANS_N );
+
+        c_auto pitch = alignUp( leftN + (w + halo) * CHANS_N + padN );
+        c_auto buffN = pitch * (h + halo * 2);
+
+        if ( buffN != mBuffN )
+            moBuff.reset( buffN ? allocBuff( buffN ) : nullptr );
+
+        mBuffN  = buffN;
+        mW      = w;
+        mH      = h;
+        mHalo   = halo;
+        mPadN   = padN;
+        mPitch  = pitch;
+        mOrigin = halo * pitch + leftN;
+
+        Fill( val );
+    }
+
+    //==================================================================
+    // the rows start aligned only if they're a multiple of M2D_ALIGN
+    // bytes, as with the power of 2 sizes that are large enough
+    void SetupPacked( size_t w, size_t h, const T &val=T() )
+    {
+        c_auto buffN = w * CHANS_N * h;
+
+        if ( buffN != mBuffN )
+            moBuff.reset( buffN ? allocBuff( buffN ) : nullptr );
+
+        mBuffN  = buffN;
+        mW      = w;
+        mH      = h;
+        mHalo   = 0;
+        mPadN   = 0;
+        mPitch  = w * CHANS_N;
+        mOrigin = 0;
+
+        Fill( val );
+    }
+
+    void Clear() { *this = Map2D(); }
+
+    bool IsEmpty() const { return NOT( mW && mH ); }
+    bool IsPacked() const { return mPitch == mW * CHANS_N && mBuffN == mPitch * mH; }
+
+    size_t GetW() const     { return mW; }
+    size_t GetH() const     { return mH; }
+    size_t GetHalo() const  { return mHalo; }
+    size_t GetPadN() const  { return mPadN; }
+    size_t GetPitch() const { return mPitch; }
+
+    //==================================================================
+    T *Row( ptrdiff_t y ) { return moBuff.get() + mOrigin + y * (ptrdiff_t)mPitch; }
+    const T *Row( ptrdiff_t y ) const { return moBuff.get() + mOrigin + y * (ptrdiff_t)mPitch; }
+
+    T *At( ptrdiff_t x, ptrdiff_t y ) { return Row( y ) + x * (ptrdiff_t)CHANS_N; }
+    const T *At( ptrdiff_t x, ptrdiff_t y ) const { return Row( y ) + x * (ptrdiff_t)CHANS_N; }
+
+    T &operator()( ptrdiff_t x, ptrdiff_t y, size_t c=0 ) { return At( x, y )[c]; }
+    const T &operator()( ptrdiff_t x, ptrdiff_t y, size_t c=0 ) const { return At( x, y )[c]; }
+
+    View GetView() { return { Row( 0 ), mW, mH, (ptrdiff_t)mPitch }; }
+    ConstView GetView() const { return { Row( 0 ), mW, mH, (ptrdiff_t)mPitch }; }
+
+    //==================================================================
+    // a packed map as a plain array of values, by (y * w + x) * CHANS_N + c
+    T *data() { assert( IsPacked() ); return moBuff.get(); }
+    const T *data() const { assert( IsPacked() ); return moBuff.get(); }
+
+    size_t size() const { assert( IsPacked() ); return mBuffN; }
+
+    T *begin() { return data(); }
+    T *end() { return data() + size(); }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size(); }
+
+    T &operator[]( size_t i ) { assert( IsPacked() ); return moBuff.get()[i]; }
+    const T &operator[]( size_t i ) const { assert( IsPacked() ); return moBuff.get()[i]; }
+
+    //==================================================================
+    void Fill( const T &val )
+    {
+        std::fill( moBuff.get(), moBuff.get() + mBuffN, val );
+    }
+
+    //==================================================================
+    // the halo takes the values of the nearest edge texel
+    void ClampHalo()
+    {
+        if ( NOT( mHalo ) || IsEmpty() )
+            return;
+
+        c_auto halo = (ptrdiff_t)mHalo;
+        c_auto w    = (ptrdiff_t)mW;
+        c_auto h    = (ptrdiff_t)mH;
+
+        for (ptrdiff_t y=0; y < h; ++y)
+        {
+            c_auto *pL = At( 0, y );
+            c_auto *pR = At( w-1, y );
+            for (ptrdiff_t i=1; i <= halo; ++i)
+            {
+                std::copy( pL, pL + CHANS_N, At( -i, y ) );
+                std::copy( pR, pR + CHANS_N, At( w-1 + i, y ) );
+            }
+        }
+
+        // whole rows, with the corners
+        c_auto rowN = (w + halo * 2) * (ptrdiff_t)CHANS_N;
+        for (ptrdiff_t i=1; i <= halo; ++i)
+        {
+            std::copy( At( -halo, 0 ), At( -halo, 0 ) + rowN, At( -halo, -i ) );
+            std::copy( At( -halo, h-1 ), At( -halo, h-1 ) + rowN, At( -halo, h-1 + i ) );
+        }
+    }
+
+    //==================================================================
+    // the halo takes the values of the opposite edge, as for a map that
+    // tiles. The halo can't be larger than the map
+    void WrapHalo()
+    {
+        if ( NOT( mHalo ) || IsEmpty() )
+            return;
+
+        c_auto halo = (ptrdiff_t)mHalo;
+        c_auto w    = (ptrdiff_t)mW;
+        c_auto h    = (ptrdiff_t)mH;
+
+        assert( halo <= w && halo <= h );
+
+        for (ptrdiff_t y=0; y < h; ++y)
+        {
+            std::copy( At( w - halo, y ), At( w, y ), At( -halo, y ) );
+            std::copy( At( 0, y ), At( halo, y ), At( w, y ) );
+        }
+
+        // whole rows, with the corners
+        c_auto rowN = (w + halo * 2) * (ptrdiff_t)CHANS_N;
+        for (ptrdiff_t i=1; i <= halo; ++i)
+        {
+            std::copy( At( -halo, h - i ), At( -halo, h - i ) + rowN, At( -halo, -i ) );
+            std::copy( At( -halo, i - 1 ), At( -halo, i - 1 ) + rowN, At( -halo, h-1 + i ) );
+        }
+    }
+
+    //==================================================================
+    // the texels from a plain buffer, with rows of srcPitch values
+    void CopyFrom( const T *pSrc, size_t srcPitch )
+    {
+        for (size_t y=0; y < mH; ++y)
+            std::copy( pSrc + y * srcPitch, pSrc + y * srcPitch + mW * CHANS_N, Row( y ) );
+    }
+
+    // the texels to a plain buffer, with rows of dstPitch values
+    void CopyTo( T *pDst, size_t dstPitch ) const
+    {
+        for (size_t y=0; y < mH; ++y)
+            std::copy( Row( y ), Row( y ) + mW * CHANS_N, pDst + y * dstPitch );
+    }
+
+    //==================================================================
+    /// Runs fn( y, pRow ) for each row, in bands of rowsPerJob rows
+    /// spread over threadsN threads (0 for all cores)
+    template <typename FN>
+    void ForEachRow( size_t rowsPerJob, const FN &fn, size_t threadsN=0 )
+    {
+        PF_ForRange( mH, rowsPerJob, [&]( size_t sta, size_t end )
+        {
+            for (size_t y=sta; y < end; ++y)
+                fn( y, Row( y ) );
+        }, threadsN );
+    }
+
+    /// Runs fn( view, x0, y0 ) for each tile of tileW x tileH, see
+    /// M2D_ForTiles()
+    template <typename FN>
+    void ForEachTile( size_t tileW, size_t tileH, const FN &fn, size_t threadsN=0 )
+    {
+        M2D_ForTiles( mW, mH, tileW, tileH,
+            [&]( size_t x0, size_t y0, size_t x1, size_t y1 )
+            {
+                fn( GetView().Sub( x0, y0, x1 - x0, y1 - y0 ), x0, y0 );
+            }, threadsN );
+    }
+
+private:
+    static T *allocBuff( size_t n )
+    {
+        return (T *)::operator new( n * sizeof(T), std::align_val_t( M2D_ALIGN ) );
+    }
+};
+
+#endif
@@ -0,0 +1,110 @@
+//==================================================================
+/// MappedFile.cpp
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#include "DBase.h"
+#include "MappedFile.h"
+
+//==================================================================
+bool MappedFile::Open( const std::string &pathFName )
+{
+    Close();
+
+#if defined(_WIN32)
+    auto hFile = CreateFileA(
+                    pathFName.c_str(),
+                    GENERIC_READ,
+                    FILE_SHARE_READ,
+                    nullptr,
+                    OPEN_EXISTING,
+                    FILE_ATTRIBUTE_NORMAL,
+                    nullptr );
+
+    if ( hFile == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER siz {};
+    if ( !GetFileSizeEx( hFile, &siz ) || siz.QuadPart == 0 )
+    {
+        CloseHandle( hFile );
+        return false;
+    }
+
+    auto hMap = CreateFileMappingA( hFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if ( !hMap )
+    {
+        CloseHandle( hFile );
+        return false;
+    }
+
+    auto *pData = MapViewOfFile( hMap, FILE_MAP_READ, 0, 0, 0 );
+    if ( !pData )
+    {
+        CloseHandle( hMap );
+        CloseHandle( hFile );
+        return false;
+    }
+
+    mhFile = hFile;
+    mhMap  = hMap;
+    mpData = (const uint8_t *)pData;
+    mSize  = (size_t)siz.QuadPart;
+#else
+    c_auto fd = open( pathFName.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return false;
+
+    struct stat st {};
+    if ( fstat( fd, &st ) != 0 || st.st_size == 0 )
+    {
+        close( fd );
+        return false;
+    }
+
+    auto *pData = mmap( nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    // the mapping stays valid after closing the descriptor
+    close( fd );
+
+    if ( pData == MAP_FAILED )
+        return false;
+
+    mpData = (const uint8_t *)pData;
+    mSize  = (size_t)st.st_size;
+#endif
+
+    return true;
+}
+
+//==================================================================
+void MappedFile::Close()
+{
+    if ( !mpData )
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile( mpData );
+    CloseHandle( (HANDLE)mhMap );
+    CloseHandle( (HANDLE)mhFile );
+    mhMap  = nullptr;
+    mhFile = nullptr;
+#else
+    munmap( (void *)mpData, mSize );
+#endif
+
+    mpData = nullptr;
+    mSize  = 0;
+}
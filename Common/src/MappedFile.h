@@ -0,0 +1,44 @@
+//==================================================================
+/// MappedFile.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stdint.h>
+#include <string>
+
+//==================================================================
+/// Read-only memory mapping of a whole file.
+/// Pages are only brought in when accessed, so opening is cheap
+/// regardless of the size of the file.
+class MappedFile
+{
+    const uint8_t   *mpData {};
+    size_t          mSize   {};
+#if defined(_WIN32)
+    void            *mhFile {};
+    void            *mhMap  {};
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile( const MappedFile & ) = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+
+    bool Open( const std::string &pathFName );
+    void Close();
+
+    bool IsOpen() const { return mpData != nullptr; }
+
+    const uint8_t *GetData() const { return mpData; }
+    size_t GetSize() const { return mSize; }
+};
+
+#endif
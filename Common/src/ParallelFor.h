@@ -0,0 +1,186 @@
+//==================================================================
+/// ParallelFor.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "DBase.h"
+
+//==================================================================
+inline size_t PF_GetThreadsN()
+{
+    return std::max( (size_t)1, (size_t)std::thread::hardware_concurrency() );
+}
+
+//==================================================================
+/// Worker threads, one less than the cores, started on the first use
+/// and kept until the exit. A call of PF_RunJobs() posts its jobs as a
+/// batch, taken by the caller and by the free workers, by an atomic
+/// counter.
+/// Batches can come from any thread, also from a job. The caller takes
+/// its own jobs as well, so a batch goes on when all the workers are
+/// busy elsewhere
+class PF_Pool
+{
+public:
+    struct Batch
+    {
+        void        (*pRunFn)( const void *pFn, size_t jobIdx ) {};
+        const void  *pFn        {};
+        size_t      jobsN       {};
+        size_t      maxUsersN   {};     // workers, besides the caller
+        size_t      usersN      {};     // workers in it now, under mMtx
+
+        std::atomic<size_t> nextJob {0};
+
+        void RunJobs()
+        {
+            for (size_t i; (i = nextJob.fetch_add( 1 )) < jobsN;)
+                pRunFn( pFn, i );
+        }
+    };
+
+private:
+    std::mutex                  mMtx;
+    std::condition_variable     mWorkCV;
+    std::condition_variable     mDoneCV;
+    std::vector<Batch *>        mBatches;   // that may have jobs left
+    std::vector<std::thread>    mThreads;
+    bool                        mQuit {};
+
+public:
+    PF_Pool( size_t threadsN )
+    {
+        for (size_t i=0; i < threadsN; ++i)
+            mThreads.emplace_back( [this]() { workerMain(); } );
+    }
+
+    ~PF_Pool()
+    {
+        {
+            std::lock_guard lock( mMtx );
+            mQuit = true;
+        }
+        mWorkCV.notify_all();
+
+        for (auto &t : mThreads)
+            t.join();
+    }
+
+    static PF_Pool &Get()
+    {
+        static PF_Pool sPool( PF_GetThreadsN() - 1 );
+        return sPool;
+    }
+
+    // returns when all the jobs of the batch are done
+    void Run( Batch &b )
+    {
+        {
+            std::lock_guard lock( mMtx );
+            mBatches.push_back( &b );
+        }
+
+        for (size_t i=0; i < std::min( b.maxUsersN, mThreads.size() ); ++i)
+            mWorkCV.notify_one();
+
+        b.RunJobs();
+
+        // no more workers can join, wait for those in it
+        std::unique_lock lock( mMtx );
+        std::erase( mBatches, &b );
+        mDoneCV.wait( lock, [&]() { return b.usersN == 0; } );
+    }
+
+private:
+    Batch *findBatch() const
+    {
+        for (auto *pB : mBatches)
+            if ( pB->usersN < pB->maxUsersN )
+                return pB;
+
+        return nullptr;
+    }
+
+    void workerMain()
+    {
+        std::unique_lock lock( mMtx );
+        for (;;)
+        {
+            Batch *pB {};
+            mWorkCV.wait( lock, [&]() { return mQuit || (pB = findBatch()); } );
+            if ( mQuit )
+                return;
+
+            ++pB->usersN;
+            lock.unlock();
+
+            pB->RunJobs();
+
+            // no jobs left to take
+            lock.lock();
+            std::erase( mBatches, pB );
+            if ( --pB->usersN == 0 )
+                mDoneCV.notify_all();
+        }
+    }
+};
+
+//==================================================================
+/// Runs fn( jobIdx ) for every job in [0, jobsN), on up to threadsN
+/// threads (0 for all cores), of PF_Pool. The calling thread takes jobs
+/// as well.
+/// Jobs are picked dynamically, so they can vary in cost, but there's
+/// no guarantee of which thread runs what: results should go in
+/// per-job storage, to be merged in job order, if the order matters.
+template <typename FN>
+inline void PF_RunJobs( size_t jobsN, const FN &fn, size_t threadsN=0 )
+{
+    if NOT( threadsN )
+        threadsN = PF_GetThreadsN();
+
+    threadsN = std::min( threadsN, jobsN );
+
+    if ( threadsN <= 1 )
+    {
+        for (size_t i=0; i < jobsN; ++i)
+            fn( i );
+        return;
+    }
+
+    PF_Pool::Batch b;
+    b.pRunFn    = []( const void *pFn, size_t i ) { (*(const FN *)pFn)( i ); };
+    b.pFn       = &fn;
+    b.jobsN     = jobsN;
+    b.maxUsersN = threadsN - 1;
+
+    PF_Pool::Get().Run( b );
+}
+
+//==================================================================
+/// Splits [0, n) in ranges of up to grainN elements and runs
+/// fn( sta, end ) for each of them, via PF_RunJobs()
+template <typename FN>
+inline void PF_ForRange( size_t n, size_t grainN, const FN &fn, size_t threadsN=0 )
+{
+    grainN = std::max( grainN, (size_t)1 );
+
+    PF_RunJobs( (n + grainN - 1) / grainN, [&]( size_t jobIdx )
+    {
+        c_auto sta = jobIdx * grainN;
+        fn( sta, std::min( sta + grainN, n ) );
+    }, threadsN );
+}
+
+#endif
@@ -0,0 +1,168 @@
+//==================================================================
+/// SimpleLZ.cpp
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#include <string.h>
+#include <algorithm>
+#include "DBase.h"
+#include "SimpleLZ.h"
+
+static constexpr size_t SLZ_MIN_MATCH   = 4;
+static constexpr size_t SLZ_MAX_OFFSET  = 65535;
+static constexpr size_t SLZ_HASH_L2     = 14;
+
+//==================================================================
+static uint32_t read32( const uint8_t *p )
+{
+    uint32_t v;
+    memcpy( &v, p, 4 );
+    return v;
+}
+
+//==================================================================
+static uint32_t hash4( uint32_t v )
+{
+    return (v * 2654435761u) >> (32 - SLZ_HASH_L2);
+}
+
+//==================================================================
+static void writeLen( std::vector<uint8_t> &out, size_t len )
+{
+    for (; len >= 255; len -= 255)
+        out.push_back( 255 );
+    out.push_back( (uint8_t)len );
+}
+
+//==================================================================
+static void writeSeq(
+            std::vector<uint8_t> &out,
+            const uint8_t *pLit,
+            size_t litN,
+            size_t matchLen,
+            size_t offset )
+{
+    c_auto litTok = std::min( litN, (size_t)15 );
+    c_auto matTok = matchLen ? std::min( matchLen - SLZ_MIN_MATCH, (size_t)15 ) : 0;
+
+    out.push_back( (uint8_t)((litTok << 4) | matTok) );
+
+    if ( litTok == 15 )
+        writeLen( out, litN - 15 );
+
+    out.insert( out.end(), pLit, pLit + litN );
+
+    if NOT( matchLen )
+        return;
+
+    out.push_back( (uint8_t)(offset & 0xff) );
+    out.push_back( (uint8_t)(offset >> 8) );
+
+    if ( matTok == 15 )
+        writeLen( out, matchLen - SLZ_MIN_MATCH - 15 );
+}
+
+//==================================================================
+std::vector<uint8_t> SLZ_Compress( const uint8_t *pSrc, size_t srcSize )
+{
+    std::vector<uint8_t> out;
+    out.reserve( srcSize / 2 + 16 );
+
+    // last position + 1 of each hashed 4 bytes, 0 for none
+    std::vector<uint32_t> table( (size_t)1 << SLZ_HASH_L2, 0 );
+
+    size_t litSta = 0;
+    size_t i = 0;
+    while ( i + SLZ_MIN_MATCH <= srcSize )
+    {
+        c_auto v = read32( pSrc + i );
+        auto &slot = table[ hash4( v ) ];
+        c_auto cand = (size_t)slot;
+        slot = (uint32_t)(i + 1);
+
+        if ( cand == 0 || i - (cand - 1) > SLZ_MAX_OFFSET || read32( pSrc + cand - 1 ) != v )
+        {
+            ++i;
+            continue;
+        }
+
+        c_auto ref = cand - 1;
+        size_t len = SLZ_MIN_MATCH;
+        while ( i + len < srcSize && pSrc[ref + len] == pSrc[i + len] )
+            ++len;
+
+        writeSeq( out, pSrc + litSta, i - litSta, len, i - ref );
+
+        i += len;
+        litSta = i;
+    }
+
+    // what's left, as literals
+    writeSeq( out, pSrc + litSta, srcSize - litSta, 0, 0 );
+
+    return out;
+}
+
+//==================================================================
+bool SLZ_Decompress( const uint8_t *pSrc, size_t srcSize, uint8_t *pDst, size_t dstSize )
+{
+    c_auto *pSrcEnd = pSrc + srcSize;
+    size_t di = 0;
+
+    auto readLen = [&]( size_t len ) -> size_t
+    {
+        if ( len != 15 )
+            return len;
+
+        for (;;)
+        {
+            if ( pSrc == pSrcEnd )
+                return (size_t)-1;
+
+            c_auto b = *pSrc++;
+            len += b;
+            if ( b != 255 )
+                return len;
+        }
+    };
+
+    while ( pSrc < pSrcEnd )
+    {
+        c_auto tok = *pSrc++;
+
+        c_auto litN = readLen( tok >> 4 );
+        if ( litN > (size_t)(pSrcEnd - pSrc) || litN > dstSize - di )
+            return false;
+
+        memcpy( pDst + di, pSrc, litN );
+        pSrc += litN;
+        di += litN;
+
+        // the last sequence
+        if ( pSrc == pSrcEnd )
+            break;
+
+        if ( pSrcEnd - pSrc < 2 )
+            return false;
+
+        c_auto offset = (size_t)pSrc[0] | ((size_t)pSrc[1] << 8);
+        pSrc += 2;
+
+        c_auto lenExtra = readLen( tok & 15 );
+        if ( lenExtra == (size_t)-1 )
+            return false;
+
+        c_auto len = lenExtra + SLZ_MIN_MATCH;
+        if ( offset == 0 || offset > di || len > dstSize - di )
+            return false;
+
+        // byte by byte, as the match can overlap what it writes
+        for (size_t j=0; j < len; ++j, ++di)
+            pDst[di] = pDst[di - offset];
+    }
+
+    return di == dstSize;
+}
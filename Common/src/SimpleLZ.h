@@ -0,0 +1,34 @@
+//==================================================================
+/// SimpleLZ.h
+///
+/// Created by Davide Pasca - 2026/10/18
+/// See the file "license.txt" that comes with this project for
+/// copyright info.
+//==================================================================
+
+#ifndef SIMPLELZ_H
+#define SIMPLELZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//==================================================================
+/// Byte oriented LZ77, in the style of LZ4: a sequence of literals and
+/// a match back in the last 64 KB, with a single hash probe per
+/// position. Fast, and good on data with runs and repeats, like the
+/// row deltas of a map.
+/// Stream of sequences:
+///   token       literals count (high 4 bits), match length - 4 (low 4 bits),
+///               15 for either means that more bytes follow, adding up
+///               until one that isn't 255
+///   literals
+///   offset      2 bytes, little endian, back from the current position
+/// The last sequence only has literals. The raw size must be known to
+/// decompress.
+std::vector<uint8_t> SLZ_Compress( const uint8_t *pSrc, size_t srcSize );
+
+// false if the data is damaged, or doesn't decompress to dstSize bytes
+bool SLZ_Decompress( const uint8_t *pSrc, size_t srcSize, uint8_t *pDst, size_t dstSize );
+
+#endif